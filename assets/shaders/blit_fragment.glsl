@@ -0,0 +1,27 @@
+#version 410 core
+
+in vec2 v_TexCoord;
+flat in int v_Draw;
+out vec4 FragColor;
+
+uniform usampler2D u_Indices; // Guest framebuffer, one palette index per pixel
+uniform sampler2D u_Palette;  // 256 x 1 RGBA
+
+struct DrawBlock {
+    vec2 pos;
+    float width;
+    float height;
+    vec3 color;
+    vec2 size;
+};
+
+layout (std140) uniform Draw {
+    DrawBlock u_Draws[64]; // GL::max_batch_draws, one per instance
+};
+
+void main() {
+    vec2 size = u_Draws[v_Draw].size;
+    ivec2 pixel = clamp(ivec2(v_TexCoord * size), ivec2(0), ivec2(size) - 1);
+    uint index = texelFetch(u_Indices, pixel, 0).r;
+    FragColor = texelFetch(u_Palette, ivec2(int(index), 0), 0);
+}
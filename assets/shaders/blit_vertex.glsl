@@ -0,0 +1,25 @@
+#version 410 core
+
+layout (location = 0) in vec3 aPos;
+
+struct DrawBlock {
+    vec2 pos;
+    float width;
+    float height;
+    vec3 color;
+    vec2 size;
+};
+
+layout (std140) uniform Draw {
+    DrawBlock u_Draws[64]; // GL::max_batch_draws, one per instance
+};
+
+out vec2 v_TexCoord;
+flat out int v_Draw;
+
+void main() {
+    DrawBlock draw = u_Draws[gl_InstanceID];
+    gl_Position = vec4(draw.pos + vec2(draw.width, draw.height) * aPos.xy, 0.0f, 1.0f);
+    v_TexCoord = vec2(aPos.x, -aPos.y); // Row 0 of the framebuffer is the top of the quad
+    v_Draw = gl_InstanceID;
+}
@@ -1,10 +1,22 @@
 #version 410 core
 
+flat in int v_Draw;
 out vec4 FragColor;
 
 uniform float u_Time;
-uniform vec3 u_Color;
+
+struct DrawBlock {
+    vec2 pos;
+    float width;
+    float height;
+    vec3 color;
+    vec2 size;
+};
+
+layout (std140) uniform Draw {
+    DrawBlock u_Draws[64]; // GL::max_batch_draws, one per instance
+};
 
 void main() {
-    FragColor = vec4(0.7f*u_Color+0.05f*sin(u_Time/10000.0f),1.0f);
+    FragColor = vec4(0.7f*u_Draws[v_Draw].color+0.05f*sin(u_Time/10000.0f),1.0f);
 }
\ No newline at end of file
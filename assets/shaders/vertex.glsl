@@ -4,13 +4,25 @@ layout (location = 0) in vec3 aPos;
 
 uniform float u_Time;
 
-uniform vec2 u_Pos;
-uniform float u_Width;
-uniform float u_Height;
+struct DrawBlock {
+    vec2 pos;
+    float width;
+    float height;
+    vec3 color;
+    vec2 size;
+};
+
+layout (std140) uniform Draw {
+    DrawBlock u_Draws[64]; // GL::max_batch_draws, one per instance
+};
 
 uniform float u_AspectRatio;
 
+flat out int v_Draw;
+
 void main() {
-    gl_Position=vec4(u_Pos + vec2(u_Width, u_Height) * aPos.xy, 0.0f,1.0f);
+    DrawBlock draw = u_Draws[gl_InstanceID];
+    gl_Position=vec4(draw.pos + vec2(draw.width, draw.height) * aPos.xy, 0.0f,1.0f);
     gl_Position.x= gl_Position.x/  u_AspectRatio;
+    v_Draw = gl_InstanceID;
 }
\ No newline at end of file
@@ -1,11 +1,18 @@
 /*danielsinkin97@gmail.com*/
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstring>
 #include <optional>
+#include <span>
+#include <string_view>
 using std::optional;
+#include <type_traits>
+#include <utility>
 #include <variant>
+#include <vector>
 
 #include "../types.hpp"
 
@@ -18,7 +25,10 @@ namespace mos6502 {
 #define INSTRUCTION_TYPE_LIST                 \
     X(NONE) /* No Instruction */              \
     X(adc)  /* Add with Carry */              \
+    X(alr)  /* AND + LSR (undocumented) */    \
+    X(anc)  /* AND, N to C (undocumented) */  \
     X(and_) /* Bitwise AND (6502 “AND”) */    \
+    X(arr)  /* AND + ROR (undocumented) */    \
     X(asl)  /* Arithmetic Shift Left */       \
     X(bcc)  /* Branch if Carry Clear */       \
     X(bcs)  /* Branch if Carry Set */         \
@@ -27,6 +37,7 @@ namespace mos6502 {
     X(bmi)  /* Branch if Minus */             \
     X(bne)  /* Branch if Not Equal */         \
     X(bpl)  /* Branch if Plus */              \
+    X(bra)  /* Branch Always (65C02) */       \
     X(brk)  /* Force Break */                 \
     X(bvc)  /* Branch if Overflow Clear */    \
     X(bvs)  /* Branch if Overflow Set */      \
@@ -37,6 +48,7 @@ namespace mos6502 {
     X(cmp)  /* Compare Accumulator */         \
     X(cpx)  /* Compare X Register */          \
     X(cpy)  /* Compare Y Register */          \
+    X(dcp)  /* DEC + CMP (undocumented) */    \
     X(dec)  /* Decrement Memory */            \
     X(dex)  /* Decrement X Register */        \
     X(dey)  /* Decrement Y Register */        \
@@ -44,8 +56,10 @@ namespace mos6502 {
     X(inc)  /* Increment Memory */            \
     X(inx)  /* Increment X Register */        \
     X(iny)  /* Increment Y Register */        \
+    X(isc)  /* INC + SBC (undocumented) */    \
     X(jmp)  /* Jump */                        \
     X(jsr)  /* Jump to Subroutine */          \
+    X(lax)  /* Load A and X (undocumented) */ \
     X(lda)  /* Load Accumulator */            \
     X(ldx)  /* Load X Register */             \
     X(ldy)  /* Load Y Register */             \
@@ -54,21 +68,34 @@ namespace mos6502 {
     X(ora)  /* Bitwise OR with Accumulator */ \
     X(pha)  /* Push Accumulator */            \
     X(php)  /* Push Processor Status */       \
+    X(phx)  /* Push X Register (65C02) */     \
+    X(phy)  /* Push Y Register (65C02) */     \
     X(pla)  /* Pull Accumulator */            \
     X(plp)  /* Pull Processor Status */       \
+    X(plx)  /* Pull X Register (65C02) */     \
+    X(ply)  /* Pull Y Register (65C02) */     \
+    X(rla)  /* ROL + AND (undocumented) */    \
     X(rol)  /* Rotate Left */                 \
     X(ror)  /* Rotate Right */                \
+    X(rra)  /* ROR + ADC (undocumented) */    \
     X(rti)  /* Return from Interrupt */       \
     X(rts)  /* Return from Subroutine */      \
+    X(sax)  /* Store A & X (undocumented) */  \
     X(sbc)  /* Subtract with Carry */         \
+    X(sbx)  /* A&X - imm (undocumented) */    \
     X(sec)  /* Set Carry */                   \
     X(sed)  /* Set Decimal */                 \
     X(sei)  /* Set Interrupt Disable */       \
+    X(slo)  /* ASL + ORA (undocumented) */    \
+    X(sre)  /* LSR + EOR (undocumented) */    \
     X(sta)  /* Store Accumulator */           \
     X(stx)  /* Store X Register */            \
     X(sty)  /* Store Y Register */            \
+    X(stz)  /* Store Zero (65C02) */          \
     X(tax)  /* Transfer Accumulator to X */   \
     X(tay)  /* Transfer Accumulator to Y */   \
+    X(trb)  /* Test and Reset Bits (65C02) */ \
+    X(tsb)  /* Test and Set Bits (65C02) */   \
     X(tsx)  /* Transfer Stack Pointer to X */ \
     X(txa)  /* Transfer X to Accumulator */   \
     X(txs)  /* Transfer X to Stack Pointer */ \
@@ -80,7 +107,7 @@ enum class InstructionType {
 #undef X
 };
 
-inline const char *to_string(InstructionType type) {
+constexpr const char *to_string(InstructionType type) {
     switch (type) {
 #define X(name)                 \
     case InstructionType::name: \
@@ -100,10 +127,49 @@ is_rmw_instruction(InstructionType t) -> bool {
         InstructionType::rol,
         InstructionType::ror,
         InstructionType::inc,
-        InstructionType::dec};
+        InstructionType::dec,
+        InstructionType::trb,
+        InstructionType::tsb,
+        InstructionType::slo,
+        InstructionType::rla,
+        InstructionType::sre,
+        InstructionType::rra,
+        InstructionType::dcp,
+        InstructionType::isc};
     return std::ranges::contains(rmw_instructions, t);
 }
 
+[[nodiscard]] constexpr auto
+is_store_instruction(InstructionType t) -> bool {
+    constexpr std::array store_instructions = {
+        InstructionType::sta,
+        InstructionType::stx,
+        InstructionType::sty,
+        InstructionType::stz,
+        InstructionType::sax};
+    return std::ranges::contains(store_instructions, t);
+}
+
+[[nodiscard]] constexpr auto
+is_push_instruction(InstructionType t) -> bool {
+    constexpr std::array push_instructions = {
+        InstructionType::pha,
+        InstructionType::php,
+        InstructionType::phx,
+        InstructionType::phy};
+    return std::ranges::contains(push_instructions, t);
+}
+
+[[nodiscard]] constexpr auto
+is_pull_instruction(InstructionType t) -> bool {
+    constexpr std::array pull_instructions = {
+        InstructionType::pla,
+        InstructionType::plp,
+        InstructionType::plx,
+        InstructionType::ply};
+    return std::ranges::contains(pull_instructions, t);
+}
+
 [[nodiscard]] constexpr auto
 is_branching_instruction(InstructionType t) -> bool {
     constexpr std::array branch_instructions = {
@@ -114,7 +180,8 @@ is_branching_instruction(InstructionType t) -> bool {
         InstructionType::bmi, // Branch if Minus (Negative Set)
         InstructionType::bpl, // Branch if Plus (Negative Clear)
         InstructionType::bvc, // Branch if Overflow Clear
-        InstructionType::bvs  // Branch if Overflow Set
+        InstructionType::bvs, // Branch if Overflow Set
+        InstructionType::bra  // Branch Always (65C02)
     };
     return std::ranges::contains(branch_instructions, t);
 }
@@ -134,8 +201,36 @@ enum class AddressingMode {
     absolute_y,
     relative,
     indirect,
+    zero_page_indirect,  // (zp), 65C02
+    absolute_indirect_x, // (abs,X), 65C02 jmp only
 };
 
+[[nodiscard]] constexpr auto
+instruction_length(AddressingMode mode) -> Byte {
+    switch (mode) {
+    case AddressingMode::NONE:
+    case AddressingMode::accum:
+    case AddressingMode::implied:
+        return 1;
+    case AddressingMode::immediate:
+    case AddressingMode::zero_page:
+    case AddressingMode::indirect_x:
+    case AddressingMode::indirect_y:
+    case AddressingMode::zero_page_x:
+    case AddressingMode::zero_page_y:
+    case AddressingMode::relative:
+    case AddressingMode::zero_page_indirect:
+        return 2;
+    case AddressingMode::absolute:
+    case AddressingMode::absolute_x:
+    case AddressingMode::absolute_y:
+    case AddressingMode::indirect:
+    case AddressingMode::absolute_indirect_x:
+        return 3;
+    }
+    return 1;
+}
+
 inline const char *to_string(AddressingMode mode) {
     switch (mode) {
     case AddressingMode::NONE:
@@ -166,6 +261,10 @@ inline const char *to_string(AddressingMode mode) {
         return "relative";
     case AddressingMode::indirect:
         return "indirect";
+    case AddressingMode::zero_page_indirect:
+        return "zero_page_indirect";
+    case AddressingMode::absolute_indirect_x:
+        return "absolute_indirect_x";
     default:
         assert(false);
     }
@@ -223,6 +322,7 @@ struct AddrResult {
 };
 
 struct CPU;
+struct Device;
 using ExecFunc = void (*)(CPU &cpu, optional<Byte>, optional<Address>);
 using AddrModeFunc = AddrResult (*)(CPU, bool /*is_read*/, bool /*page_penalty*/);
 
@@ -231,11 +331,170 @@ struct Instruction {
     AddressingMode mode;
 };
 
+enum class InterruptKind {
+    none,
+    irq,
+    nmi,
+    brk,
+};
+
+// Chip variant, fixed per CPU instance. Decode table and quirks are compile time properties of
+// the variant: the core is instantiated once per variant (tick<V>, run_until<V>, ...) and the
+// plain entry points switch on CPU::variant once per call, never per quirk.
+enum class Variant : Byte {
+    nmos,              // NMOS 6502, documented opcodes only
+    nmos_undocumented, // NMOS 6502 plus the stable undocumented opcodes (LAX, SAX, SLO, ...)
+    cmos,              // 65C02: BRA, STZ, PHX / PLX, TSB / TRB, (zp), fixed indirect jump
+};
+
+[[nodiscard]] constexpr auto to_string(Variant variant) -> const char * {
+    switch (variant) {
+    case Variant::nmos:
+        return "6502";
+    case Variant::nmos_undocumented:
+        return "6502 (undocumented)";
+    case Variant::cmos:
+        return "65C02";
+    }
+    return "<unknown>";
+}
+
+// Command line names: 6502, 6502u (with undocumented opcodes), 65c02
+[[nodiscard]] constexpr auto parse_variant(std::string_view name) -> optional<Variant> {
+    if (name == "6502") return Variant::nmos;
+    if (name == "6502u") return Variant::nmos_undocumented;
+    if (name == "65c02" || name == "65C02") return Variant::cmos;
+    return std::nullopt;
+}
+
+[[nodiscard]] constexpr auto is_nmos(Variant variant) -> bool { return variant != Variant::cmos; }
+
+// Calls f with the variant as std::integral_constant, the single runtime branch into a specialised core
+template <typename F>
+constexpr auto with_variant(Variant variant, F &&f) -> decltype(auto) {
+    switch (variant) {
+    case Variant::nmos_undocumented:
+        return f(std::integral_constant<Variant, Variant::nmos_undocumented>{});
+    case Variant::cmos:
+        return f(std::integral_constant<Variant, Variant::cmos>{});
+    case Variant::nmos:
+    default:
+        return f(std::integral_constant<Variant, Variant::nmos>{});
+    }
+}
+
 struct Config {
-    // There was a hardware bug which causes the high byte of the read address to wrap
-    // around to the same page, emulators usually preserve this bugged behavior
-    bool preserve_indirect_jump_page_cross_bug = true;
+    // Let run_until skip provably idle loops in bulk, the resulting state is the same as
+    // running them (see IdleLoopDetector), turn off to profile the loops themselves
+    bool fast_forward_idle_loops = true;
+    // Hybrid execution: run_until executes whole instructions and fused pairs (see fusion.hpp)
+    // and only ticks cycle by cycle around interrupts, timing sensitive devices and opcodes the
+    // instruction level engine does not cover. Off runs everything through tick().
+    bool hybrid_execution = true;
+};
+
+// Byte level coverage, build with -DMOS6502_COVERAGE=1 to enable. Compiled out, CPU::coverage is
+// an empty member and every mark_coverage call folds away. See coverage.hpp for the exports.
+#ifndef MOS6502_COVERAGE
+#define MOS6502_COVERAGE 0
+#endif
+inline constexpr bool coverage_enabled = MOS6502_COVERAGE != 0;
+
+constexpr Byte COVERAGE_OPCODE = 0b0001;  // Fetched as the first byte of an instruction
+constexpr Byte COVERAGE_OPERAND = 0b0010; // Fetched as an operand byte
+constexpr Byte COVERAGE_READ = 0b0100;    // Read as data (including stack pulls and vectors)
+constexpr Byte COVERAGE_WRITE = 0b1000;   // Written (including stack pushes)
+
+// 4 bits per address, two addresses per byte with the even one in the low nibble
+struct CoverageMap {
+    std::array<Byte, 32 * 1024> bits = {};
+
+    auto mark(Address addr, Byte flags) -> void { bits[addr >> 1] |= static_cast<Byte>(flags << ((addr & 1) * 4)); }
+    [[nodiscard]] auto get(Address addr) const -> Byte { return (bits[addr >> 1] >> ((addr & 1) * 4)) & 0x0F; }
+    auto clear() -> void { bits.fill(0); }
+};
+// Stand-in with the same interface, so callers compile unchanged when coverage is off
+struct NoCoverage {
+    auto mark(Address /*addr*/, Byte /*flags*/) -> void {}
+    [[nodiscard]] auto get(Address /*addr*/) const -> Byte { return 0; }
+    auto clear() -> void {}
+};
+
+// Bus instrumentation policy, chosen at compile time with -DMOS6502_INSTRUMENTATION=N:
+//   0  none, on_access is empty and CPU::instrumentation takes no space
+//   1  pins, CPU::addr / data_bus / rw / sync follow every bus access
+//   2  log, pins plus every cycle appended to an attached, preallocated BusLog
+// Every read and write of the core goes through bus_read() / write(), which call on_access.
+// Each tick does exactly one of them, dummy reads and writes included, so the log has one entry
+// per cycle in the order the pins of a real 6502 would show them.
+#ifndef MOS6502_INSTRUMENTATION
+#define MOS6502_INSTRUMENTATION 0
+#endif
+
+struct BusCycle {
+    uint64_t cycle = 0;
+    Address addr = 0x0000;
+    Byte data = 0x00;
+    bool read = true;
+    bool sync = false; // Opcode fetch
+};
+
+// Ring buffer sized up front, recording never allocates. Keeps the newest capacity cycles,
+// total counts all of them so a consumer knows how many were overwritten.
+struct BusLog {
+    std::vector<BusCycle> entries;
+    uint64_t total = 0;
+
+    explicit BusLog(size_t capacity)
+        : entries(std::max<size_t>(capacity, 1)) {}
+
+    auto push(const BusCycle &cycle) -> void { entries[total++ % entries.size()] = cycle; }
+};
+
+struct NoInstrumentation {
+    template <typename Cpu>
+    auto on_access(Cpu & /*cpu*/, Address /*addr*/, Byte /*data*/, bool /*read*/, bool /*sync*/) -> void {}
+};
+
+struct PinInstrumentation {
+    template <typename Cpu>
+    auto on_access(Cpu &cpu, Address addr, Byte data, bool read, bool sync) -> void {
+        cpu.addr = addr;
+        cpu.data_bus = data;
+        cpu.rw = read;
+        cpu.sync = sync;
+    }
+};
+
+struct BusLogInstrumentation {
+    BusLog *log = nullptr; // Owned elsewhere, pins are still tracked while detached
+
+    template <typename Cpu>
+    auto on_access(Cpu &cpu, Address addr, Byte data, bool read, bool sync) -> void {
+        PinInstrumentation{}.on_access(cpu, addr, data, read, sync);
+        if (log != nullptr) log->push({.cycle = cpu.cycles, .addr = addr, .data = data, .read = read, .sync = sync});
+    }
+};
+
+using Instrumentation = std::conditional_t<MOS6502_INSTRUMENTATION == 2, BusLogInstrumentation,
+    std::conditional_t<MOS6502_INSTRUMENTATION == 1, PinInstrumentation, NoInstrumentation>>;
+
+enum class CallKind {
+    jsr,
+    irq,
+    nmi,
+    brk,
 };
+
+// Notified when control enters or leaves a subroutine or interrupt handler, see profiler.hpp.
+// Both calls happen on the last cycle of jsr / the interrupt sequence and rts / rti.
+struct CallObserver {
+    virtual ~CallObserver() = default;
+    // frame_sp is SP before the return address was pushed, the matching return restores it
+    virtual auto on_call(const CPU &cpu, CallKind kind, Address target, Byte frame_sp) -> void = 0;
+    virtual auto on_return(const CPU &cpu) -> void = 0;
+};
+
 struct CPU {
     Address PC = 0x0000;
     Byte A = 0x00;
@@ -244,8 +503,12 @@ struct CPU {
     Byte SP = 0x00;
     Byte P = 0x00;
 
-    bool nmi = false;
+    bool nmi = false; // Line levels, true means asserted
     bool irq = false;
+    bool nmi_previous = false;            // NMI line level seen on the previous cycle, for edge detection
+    bool nmi_pending = false;             // Latched NMI edge, serviced at the next instruction boundary
+    Byte irq_sources = 0x00;              // One bit per device currently holding IRQ low
+    InterruptKind interrupt = InterruptKind::none; // Sequence in progress while instr is brk
 
     bool sync = false;
     bool rdy = true;
@@ -254,18 +517,77 @@ struct CPU {
     Address addr = 0x0000;
     Address temporary_address_register = 0x0000; // TAR
     Byte data_bus = 0x00;
-    bool rw;
+    bool rw = true; // High for reads
 
     Instruction instr;
     int instr_counter = 0;
+    Address instr_addr = 0x0000; // Address of the opcode of the current instruction
 
     Byte tmp = 0x00;
     uint64_t cycles = 0;
 
     AddrResult addr_result;
     Config config;
+    Variant variant = Variant::nmos;
+
+    // Bumped on every write into the corresponding 256 byte page, lets caches of
+    // derived data (disassembly, ...) detect stale pages without rescanning memory
+    std::array<uint32_t, 256> page_generation = {};
+
+    // Memory map per 256 byte page, both tables are owned elsewhere and only point into it.
+    // Reads:  rom_pages -> devices -> mem
+    // Writes: devices -> (ignored if rom_pages) -> mem
+    // A mapper can therefore serve reads straight from a mapped image while still
+    // receiving the register writes that land in its address window.
+    std::array<Device *, 256> devices = {};
+    std::array<const Byte *, 256> rom_pages = {};
+
+    // Incrementally maintained hash of mem, see cell_hash. mem_hash is the XOR of all page hashes.
+    // Kept up to date by write() and load_bytes(), anything poking mem directly calls rehash_memory()
+    std::array<uint64_t, 256> page_hash = {};
+    uint64_t mem_hash = 0;
+
+    // Bumped by every write and every device read, anything that could change state other than
+    // the registers. Two equal counts bracket a stretch of pure RAM / ROM reads.
+    uint64_t side_effects = 0;
+
+    [[no_unique_address]] std::conditional_t<coverage_enabled, CoverageMap, NoCoverage> coverage;
+    [[no_unique_address]] Instrumentation instrumentation;
+
+    CallObserver *call_observer = nullptr; // Owned elsewhere, like devices
+};
+
+inline auto mark_coverage(CPU &cpu, Address addr, Byte flags) -> void { cpu.coverage.mark(addr, flags); }
+
+// Memory mapped hardware, attached to one or more pages through CPU::devices
+struct Device {
+    virtual ~Device() = default;
+    virtual auto read(CPU &cpu, Address addr) -> Byte = 0;
+    virtual auto write(CPU &cpu, Address addr, Byte value) -> void = 0;
+    // Side effect free read used by debugger views
+    [[nodiscard]] virtual auto peek(const CPU &cpu, Address addr) const -> Byte = 0;
+    // Whether the device may react within an instruction (raise an interrupt on a specific
+    // cycle, sample the bus). Accesses to such pages always run cycle by cycle through tick().
+    [[nodiscard]] virtual auto timing_sensitive() const -> bool { return true; }
+
+    // Opaque device state for save states, stateless devices keep the defaults
+    virtual auto save_state(std::vector<Byte> & /*out*/) const -> void {}
+    virtual auto load_state(CPU & /*cpu*/, std::span<const Byte> state) -> bool { return state.empty(); }
 };
 
+inline auto attach_device(CPU &cpu, Device &device, Address first, Address last) -> void {
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page) {
+        cpu.devices[page] = &device;
+        ++cpu.page_generation[page];
+    }
+}
+
+// Points the given page at 256 bytes of read-only storage, nullptr unmaps it again
+inline auto map_rom_page(CPU &cpu, Byte page, const Byte *data) -> void {
+    cpu.rom_pages[page] = data;
+    ++cpu.page_generation[page];
+}
+
 constexpr Byte C_FLAG = 0b00000001; // Carry
 constexpr Byte Z_FLAG = 0b00000010; // Zero
 constexpr Byte I_FLAG = 0b00000100; // Interrupt Disable
@@ -300,6 +622,27 @@ inline auto set_flag_I(CPU &cpu, bool do_set) -> void {
         cpu.P &= static_cast<Byte>(~I_FLAG);
     }
 }
+inline auto set_flag_V(CPU &cpu, bool do_set) -> void {
+    if (do_set) {
+        cpu.P |= V_FLAG;
+    } else {
+        cpu.P &= static_cast<Byte>(~V_FLAG);
+    }
+}
+inline auto set_flag_Z(CPU &cpu, bool do_set) -> void {
+    if (do_set) {
+        cpu.P |= Z_FLAG;
+    } else {
+        cpu.P &= static_cast<Byte>(~Z_FLAG);
+    }
+}
+inline auto set_flag_N(CPU &cpu, bool do_set) -> void {
+    if (do_set) {
+        cpu.P |= N_FLAG;
+    } else {
+        cpu.P &= static_cast<Byte>(~N_FLAG);
+    }
+}
 
 inline auto check_branching_condition(CPU &cpu) -> bool {
     switch (cpu.instr.type) {
@@ -319,28 +662,251 @@ inline auto check_branching_condition(CPU &cpu) -> bool {
         return ((cpu.P & V_FLAG) == 0);
     case InstructionType::bvs: // Branch if Overflow Set
         return ((cpu.P & V_FLAG) != 0);
+    case InstructionType::bra: // Branch Always (65C02)
+        return true;
     default:
         assert(false);
     }
 }
 
+constexpr Address stack_base = 0x0100;
+constexpr Address nmi_vector = 0xFFFA;
+constexpr Address reset_vector = 0xFFFC;
+constexpr Address irq_vector = 0xFFFE;
+
+// IRQ is level triggered and shared, each device owns one bit of irq_sources
+inline auto set_irq(CPU &cpu, Byte source_mask, bool asserted) -> void {
+    if (asserted) {
+        cpu.irq_sources |= source_mask;
+    } else {
+        cpu.irq_sources &= static_cast<Byte>(~source_mask);
+    }
+    cpu.irq = cpu.irq_sources != 0;
+}
+
+inline auto set_nmi(CPU &cpu, bool asserted) -> void { cpu.nmi = asserted; }
+
+[[nodiscard]] inline auto interrupt_pending(const CPU &cpu) -> bool {
+    return cpu.nmi_pending || (cpu.irq && (cpu.P & I_FLAG) == 0);
+}
+
+// splitmix64 finalizer
+[[nodiscard]] constexpr auto mix64(uint64_t x) -> uint64_t {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Zobrist style: memory hashes to the XOR of cell_hash over all cells, so a write only XORs the
+// old cell out and the new one in. Zero cells contribute nothing, zeroed memory hashes to 0.
+[[nodiscard]] constexpr auto cell_hash(Address addr, Byte value) -> uint64_t {
+    return value == 0 ? 0 : mix64((static_cast<uint64_t>(addr) << 8) | value);
+}
+
+inline auto update_memory_hash(CPU &cpu, Address addr, Byte old_value, Byte new_value) -> void {
+    const uint64_t delta = cell_hash(addr, old_value) ^ cell_hash(addr, new_value);
+    cpu.page_hash[addr >> 8] ^= delta;
+    cpu.mem_hash ^= delta;
+}
+
+inline auto rehash_memory(CPU &cpu) -> void {
+    cpu.mem_hash = 0;
+    for (size_t page = 0; page < cpu.page_hash.size(); ++page) {
+        uint64_t hash = 0;
+        for (size_t i = 0; i < 256; ++i) {
+            const size_t addr = page * 256 + i;
+            hash ^= cell_hash(static_cast<Address>(addr), cpu.mem[addr]);
+        }
+        cpu.page_hash[page] = hash;
+        cpu.mem_hash ^= hash;
+    }
+}
+
+// Hash of RAM plus the architectural state, O(1). Only meaningful at instruction boundaries,
+// the micro-op state of an instruction in flight is not part of it. ROM and device contents
+// are not included either, they are either static or covered by their own save state.
+[[nodiscard]] inline auto state_hash(const CPU &cpu) -> uint64_t {
+    const uint64_t registers = static_cast<uint64_t>(cpu.PC) | (static_cast<uint64_t>(cpu.A) << 16) |
+                               (static_cast<uint64_t>(cpu.X) << 24) | (static_cast<uint64_t>(cpu.Y) << 32) |
+                               (static_cast<uint64_t>(cpu.SP) << 40) | (static_cast<uint64_t>(cpu.P) << 48);
+    const uint64_t lines = static_cast<uint64_t>(cpu.irq_sources) | (static_cast<uint64_t>(cpu.nmi) << 8) |
+                           (static_cast<uint64_t>(cpu.nmi_pending) << 9);
+    return mix64(mix64(cpu.mem_hash ^ registers) ^ lines);
+}
+
 struct CPUSnapshot {
     CPU cpu;
+    std::vector<Byte> devices; // encode_devices / decode_devices (save_state.hpp)
 };
 
+// Bus read without coverage bookkeeping, callers mark how the byte was used
+[[nodiscard]] inline auto bus_read(CPU &cpu, Address addr, bool sync = false) -> Byte {
+    const auto page = static_cast<size_t>(addr >> 8);
+    Byte value;
+    if (const Byte *rom = cpu.rom_pages[page]) {
+        value = rom[addr & 0xFF];
+    } else if (Device *device = cpu.devices[page]) {
+        ++cpu.side_effects;
+        value = device->read(cpu, addr);
+    } else {
+        value = cpu.mem[addr];
+    }
+    cpu.instrumentation.on_access(cpu, addr, value, true, sync);
+    return value;
+}
 // Note that uint16_t overflowing is part of the C++ standard and not UB so this is safe
-[[nodiscard]] auto fetch(CPU &cpu) -> Byte { return cpu.mem[cpu.PC++]; }
+[[nodiscard]] auto read(CPU &cpu, Address addr) -> Byte {
+    mark_coverage(cpu, addr, COVERAGE_READ);
+    return bus_read(cpu, addr);
+}
+// Same lookup as read but without triggering device side effects
+[[nodiscard]] inline auto peek(const CPU &cpu, Address addr) -> Byte {
+    const auto page = static_cast<size_t>(addr >> 8);
+    if (const Byte *rom = cpu.rom_pages[page]) return rom[addr & 0xFF];
+    if (const Device *device = cpu.devices[page]) return device->peek(cpu, addr);
+    return cpu.mem[addr];
+}
+[[nodiscard]] auto fetch(CPU &cpu) -> Byte {
+    mark_coverage(cpu, cpu.PC, COVERAGE_OPERAND);
+    return bus_read(cpu, cpu.PC++);
+}
 auto fetch_to_tmp(CPU &cpu) -> void { cpu.tmp = fetch(cpu); }
-[[nodiscard]] auto read(CPU &cpu, Address addr) -> Byte { return cpu.mem[addr]; }
-auto read_tar(CPU &cpu) -> void { cpu.tmp = cpu.mem[cpu.temporary_address_register]; }
+auto read_tar(CPU &cpu) -> void { cpu.tmp = read(cpu, cpu.temporary_address_register); }
 
 // Combines current location of PC as high part with cpu.tmp value as low part into one address
 // and stores it in cpu.temporary_address_register
 auto fetch_to_tar(CPU &cpu) -> void {
     cpu.temporary_address_register = static_cast<Address>(fetch(cpu) << 8) | static_cast<Address>(cpu.tmp);
 }
-auto write(CPU &cpu, Address addr, Byte val) -> void { cpu.mem[addr] = val; }
+auto write(CPU &cpu, Address addr, Byte val) -> void {
+    mark_coverage(cpu, addr, COVERAGE_WRITE);
+    cpu.instrumentation.on_access(cpu, addr, val, false, false);
+    ++cpu.side_effects;
+    const auto page = static_cast<size_t>(addr >> 8);
+    if (Device *device = cpu.devices[page]) {
+        device->write(cpu, addr, val);
+        return;
+    }
+    if (cpu.rom_pages[page] != nullptr) return; // Writes to ROM are ignored
+    update_memory_hash(cpu, addr, cpu.mem[addr], val);
+    cpu.mem[addr] = val;
+    ++cpu.page_generation[page];
+}
+
+// Bulk copy of a program/ROM image into memory, one memcpy plus page invalidation and rehash
+inline auto load_bytes(CPU &cpu, Address addr, std::span<const Byte> bytes) -> void {
+    assert(addr + bytes.size() <= cpu.mem.size());
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        update_memory_hash(cpu, static_cast<Address>(addr + i), cpu.mem[addr + i], bytes[i]);
+    }
+    std::memcpy(cpu.mem.data() + addr, bytes.data(), bytes.size());
+    if (bytes.empty()) return;
+    for (size_t page = addr >> 8; page <= (addr + bytes.size() - 1) >> 8; ++page) {
+        ++cpu.page_generation[page];
+    }
+}
+
+// ADC. In decimal mode both parts correct A and C the same way, the NMOS part takes N and V from
+// the sum before the high digit is corrected and Z from the binary sum, the 65C02 takes N and Z
+// from the corrected result. The 65C02 spends one more cycle on decimal ADC / SBC, not modelled.
+template <Variant V>
+inline auto add_with_carry(CPU &cpu, Byte value) -> void {
+    const int carry = cpu.P & C_FLAG;
+    const int binary = cpu.A + value + carry;
+    if ((cpu.P & D_FLAG) == 0) {
+        set_flag_V(cpu, ((cpu.A ^ binary) & (value ^ binary) & 0x80) != 0);
+        set_flag_C(cpu, binary > 0xFF);
+        cpu.A = static_cast<Byte>(binary);
+        set_flags_ZN(cpu, cpu.A);
+        return;
+    }
+    int low = (cpu.A & 0x0F) + (value & 0x0F) + carry;
+    if (low >= 0x0A) low = ((low + 0x06) & 0x0F) + 0x10;
+    int sum = (cpu.A & 0xF0) + (value & 0xF0) + low;
+    const int signed_sum = static_cast<int8_t>(cpu.A & 0xF0) + static_cast<int8_t>(value & 0xF0) + low;
+    set_flag_V(cpu, signed_sum < -128 || signed_sum > 127);
+    if constexpr (is_nmos(V)) {
+        set_flag_Z(cpu, (binary & 0xFF) == 0);
+        set_flag_N(cpu, sum & 0x80);
+    }
+    if (sum >= 0xA0) sum += 0x60;
+    set_flag_C(cpu, sum > 0xFF);
+    cpu.A = static_cast<Byte>(sum);
+    if constexpr (!is_nmos(V)) set_flags_ZN(cpu, cpu.A);
+}
+
+// SBC. Flags come from the binary difference except N and Z on the 65C02 in decimal mode, which
+// follow the corrected result. The two parts correct a decimal difference differently.
+template <Variant V>
+inline auto subtract_with_borrow(CPU &cpu, Byte value) -> void {
+    const int borrow = 1 - (cpu.P & C_FLAG);
+    const int binary = cpu.A - value - borrow;
+    set_flag_V(cpu, ((cpu.A ^ value) & (cpu.A ^ binary) & 0x80) != 0);
+    set_flag_C(cpu, binary >= 0);
+    if ((cpu.P & D_FLAG) == 0) {
+        cpu.A = static_cast<Byte>(binary);
+        set_flags_ZN(cpu, cpu.A);
+        return;
+    }
+    int low = (cpu.A & 0x0F) - (value & 0x0F) - borrow;
+    if constexpr (is_nmos(V)) {
+        if (low < 0) low = ((low - 0x06) & 0x0F) - 0x10;
+        int difference = (cpu.A & 0xF0) - (value & 0xF0) + low;
+        if (difference < 0) difference -= 0x60;
+        cpu.A = static_cast<Byte>(difference);
+        set_flags_ZN(cpu, static_cast<Byte>(binary));
+    } else {
+        int difference = binary;
+        if (difference < 0) difference -= 0x60;
+        if (low < 0) difference -= 0x06;
+        cpu.A = static_cast<Byte>(difference);
+        set_flags_ZN(cpu, cpu.A);
+    }
+}
+
+// CMP / CPX / CPY: flags of reg - value, registers unchanged
+inline auto compare(CPU &cpu, Byte reg, Byte value) -> void {
+    set_flag_C(cpu, reg >= value);
+    set_flags_ZN(cpu, static_cast<Byte>(reg - value));
+}
+
+// The modify step of a read-modify-write, undocumented combinations use the instruction their
+// name starts with (SLO is ASL then ORA, DCP is DEC then CMP, ...). Shifts and rotates move C.
+[[nodiscard]] inline auto modify(CPU &cpu, Byte value) -> Byte {
+    const bool carry_in = (cpu.P & C_FLAG) != 0;
+    switch (cpu.instr.type) {
+    case InstructionType::asl:
+    case InstructionType::slo:
+        set_flag_C(cpu, value & 0x80);
+        return static_cast<Byte>(value << 1);
+    case InstructionType::rol:
+    case InstructionType::rla:
+        set_flag_C(cpu, value & 0x80);
+        return static_cast<Byte>((value << 1) | (carry_in ? 0x01 : 0x00));
+    case InstructionType::lsr:
+    case InstructionType::sre:
+        set_flag_C(cpu, value & 0x01);
+        return static_cast<Byte>(value >> 1);
+    case InstructionType::ror:
+    case InstructionType::rra:
+        set_flag_C(cpu, value & 0x01);
+        return static_cast<Byte>((value >> 1) | (carry_in ? 0x80 : 0x00));
+    case InstructionType::inc:
+    case InstructionType::isc:
+        return static_cast<Byte>(value + 1);
+    case InstructionType::dec:
+    case InstructionType::dcp:
+        return static_cast<Byte>(value - 1);
+    default:
+        assert(false);
+    }
+    return value;
+}
 
+template <Variant V>
 inline auto exec_func(CPU &cpu, optional<Byte> value, optional<Address> addr) -> void {
     if (cpu.instr.mode == AddressingMode::accum) {
         assert(!value.has_value() && !addr.has_value());
@@ -348,38 +914,101 @@ inline auto exec_func(CPU &cpu, optional<Byte> value, optional<Address> addr) ->
 
     switch (cpu.instr.type) {
     case InstructionType::adc:
-        assert(false);
+        add_with_carry<V>(cpu, *value);
+        break;
     case InstructionType::and_: {
         cpu.A &= *value;
         set_flags_ZN(cpu, cpu.A);
         break;
     }
-    case InstructionType::asl: {
-        Byte read_value;
-        if (cpu.instr.mode == AddressingMode::accum) {
-            read_value = cpu.A;
-        } else {
-            read_value = read(cpu, *addr);
-        }
-        set_flag_C(cpu, read_value & 0x80);
-        read_value <<= 1;
-        set_flags_ZN(cpu, read_value);
-        if (cpu.instr.mode == AddressingMode::accum) {
-            cpu.A = read_value;
+    case InstructionType::asl:
+    case InstructionType::lsr:
+    case InstructionType::rol:
+    case InstructionType::ror:
+    case InstructionType::inc:
+    case InstructionType::dec: {
+        const bool accum = cpu.instr.mode == AddressingMode::accum;
+        const Byte result = modify(cpu, accum ? cpu.A : cpu.tmp); // tmp was read by addr_mode_rmw
+        set_flags_ZN(cpu, result);
+        if (accum) {
+            cpu.A = result;
         } else {
-            write(cpu, *addr, read_value);
+            write(cpu, *addr, result);
         }
         break;
     }
+    case InstructionType::bit:
+        set_flag_Z(cpu, (cpu.A & *value) == 0);
+        if (cpu.instr.mode != AddressingMode::immediate) { // BIT #imm (65C02) only sets Z
+            set_flag_N(cpu, *value & N_FLAG);
+            set_flag_V(cpu, *value & V_FLAG);
+        }
+        break;
+    case InstructionType::clc:
+        set_flag_C(cpu, false);
+        break;
+    case InstructionType::cld:
+        set_flag_D(cpu, false);
+        break;
+    case InstructionType::clv:
+        set_flag_V(cpu, false);
+        break;
+    case InstructionType::cmp:
+        compare(cpu, cpu.A, *value);
+        break;
+    case InstructionType::cpx:
+        compare(cpu, cpu.X, *value);
+        break;
+    case InstructionType::cpy:
+        compare(cpu, cpu.Y, *value);
+        break;
+    case InstructionType::dex:
+        --cpu.X;
+        set_flags_ZN(cpu, cpu.X);
+        break;
+    case InstructionType::dey:
+        --cpu.Y;
+        set_flags_ZN(cpu, cpu.Y);
+        break;
+    case InstructionType::eor:
+        cpu.A ^= *value;
+        set_flags_ZN(cpu, cpu.A);
+        break;
+    case InstructionType::inx:
+        ++cpu.X;
+        set_flags_ZN(cpu, cpu.X);
+        break;
+    case InstructionType::iny:
+        ++cpu.Y;
+        set_flags_ZN(cpu, cpu.Y);
+        break;
     case InstructionType::lda:
         set_flags_ZN(cpu, *value);
         cpu.A = *value;
         break;
+    case InstructionType::ldx:
+        set_flags_ZN(cpu, *value);
+        cpu.X = *value;
+        break;
+    case InstructionType::ldy:
+        set_flags_ZN(cpu, *value);
+        cpu.Y = *value;
+        break;
     case InstructionType::jmp:
         cpu.PC = *addr;
         break;
     case InstructionType::nop:
         break;
+    case InstructionType::ora:
+        cpu.A |= *value;
+        set_flags_ZN(cpu, cpu.A);
+        break;
+    case InstructionType::sbc:
+        subtract_with_borrow<V>(cpu, *value);
+        break;
+    case InstructionType::cli:
+        set_flag_I(cpu, false);
+        break;
     case InstructionType::sec:
         set_flag_C(cpu, true);
         break;
@@ -390,13 +1019,13 @@ inline auto exec_func(CPU &cpu, optional<Byte> value, optional<Address> addr) ->
         set_flag_I(cpu, true);
         break;
     case InstructionType::sta:
-        cpu.mem[*addr] = cpu.A;
+        write(cpu, *addr, cpu.A);
         break;
     case InstructionType::stx:
-        cpu.mem[*addr] = cpu.X;
+        write(cpu, *addr, cpu.X);
         break;
     case InstructionType::sty:
-        cpu.mem[*addr] = cpu.Y;
+        write(cpu, *addr, cpu.Y);
         break;
     case InstructionType::tax:
         cpu.X = cpu.A;
@@ -410,216 +1039,616 @@ inline auto exec_func(CPU &cpu, optional<Byte> value, optional<Address> addr) ->
         cpu.X = cpu.SP;
         set_flags_ZN(cpu, cpu.X);
         break;
-    case InstructionType::txs:
+    case InstructionType::txa:
+        cpu.A = cpu.X;
+        set_flags_ZN(cpu, cpu.A);
+        break;
+    case InstructionType::txs: // The only transfer that leaves the flags alone
         cpu.SP = cpu.X;
-        set_flags_ZN(cpu, cpu.SP);
         break;
     case InstructionType::tya:
         cpu.A = cpu.Y;
         set_flags_ZN(cpu, cpu.A);
         break;
+
+    // 65C02
+    case InstructionType::stz:
+        write(cpu, *addr, 0x00);
+        break;
+    case InstructionType::trb:
+    case InstructionType::tsb: {
+        const Byte read_value = cpu.tmp;
+        set_flag_Z(cpu, (cpu.A & read_value) == 0);
+        write(cpu, *addr, cpu.instr.type == InstructionType::tsb ? static_cast<Byte>(read_value | cpu.A)
+                                                                 : static_cast<Byte>(read_value & ~cpu.A));
+        break;
+    }
+
+    // Undocumented NMOS
+    case InstructionType::lax:
+        set_flags_ZN(cpu, *value);
+        cpu.A = *value;
+        cpu.X = *value;
+        break;
+    case InstructionType::sax:
+        write(cpu, *addr, cpu.A & cpu.X);
+        break;
+    case InstructionType::anc:
+        cpu.A &= *value;
+        set_flags_ZN(cpu, cpu.A);
+        set_flag_C(cpu, cpu.A & 0x80);
+        break;
+    case InstructionType::alr:
+        cpu.A &= *value;
+        set_flag_C(cpu, cpu.A & 0x01);
+        cpu.A >>= 1;
+        set_flags_ZN(cpu, cpu.A);
+        break;
+    case InstructionType::arr:
+        cpu.A &= *value;
+        cpu.A = static_cast<Byte>((cpu.A >> 1) | ((cpu.P & C_FLAG) << 7));
+        set_flags_ZN(cpu, cpu.A);
+        set_flag_C(cpu, cpu.A & 0x40);
+        set_flag_V(cpu, ((cpu.A >> 6) ^ (cpu.A >> 5)) & 0x01);
+        break;
+    case InstructionType::sbx: {
+        const int result = (cpu.A & cpu.X) - *value;
+        set_flag_C(cpu, result >= 0);
+        cpu.X = static_cast<Byte>(result);
+        set_flags_ZN(cpu, cpu.X);
+        break;
+    }
+    case InstructionType::slo:
+    case InstructionType::rla:
+    case InstructionType::sre:
+    case InstructionType::rra:
+    case InstructionType::dcp:
+    case InstructionType::isc: {
+        const Byte result = modify(cpu, cpu.tmp);
+        write(cpu, *addr, result);
+        switch (cpu.instr.type) {
+        case InstructionType::slo:
+            cpu.A |= result;
+            set_flags_ZN(cpu, cpu.A);
+            break;
+        case InstructionType::rla:
+            cpu.A &= result;
+            set_flags_ZN(cpu, cpu.A);
+            break;
+        case InstructionType::sre:
+            cpu.A ^= result;
+            set_flags_ZN(cpu, cpu.A);
+            break;
+        case InstructionType::rra:
+            add_with_carry<V>(cpu, result);
+            break;
+        case InstructionType::dcp:
+            compare(cpu, cpu.A, result);
+            break;
+        default:
+            subtract_with_borrow<V>(cpu, result);
+            break;
+        }
+        break;
+    }
     default:
         assert(false);
     }
 }
 
-std::array<Instruction, 256> instructions{};
-void initialize_instructions() {
+// Built at compile time so constexpr/consteval code (the assembler) can look up opcodes
+template <Variant V>
+[[nodiscard]] constexpr auto make_instruction_table() -> std::array<Instruction, 256> {
+    std::array<Instruction, 256> table{};
+
     /* 1.  Set every slot to “no instruction” ------------------------ */
-    instructions.fill({InstructionType::NONE, AddressingMode::NONE});
+    table.fill({InstructionType::NONE, AddressingMode::NONE});
 
     /* 2.  Official 6510/6502 instruction set (151 opcodes) ---------- */
 
     /* $00-$1F -------------------------------------------------------- */
-    instructions[0x00] = {InstructionType::brk, AddressingMode::implied};
-    instructions[0x01] = {InstructionType::ora, AddressingMode::indirect_x};
-    instructions[0x05] = {InstructionType::ora, AddressingMode::zero_page};
-    instructions[0x06] = {InstructionType::asl, AddressingMode::zero_page};
-    instructions[0x08] = {InstructionType::php, AddressingMode::implied};
-    instructions[0x09] = {InstructionType::ora, AddressingMode::immediate};
-    instructions[0x0A] = {InstructionType::asl, AddressingMode::accum};
-    instructions[0x0D] = {InstructionType::ora, AddressingMode::absolute};
-    instructions[0x0E] = {InstructionType::asl, AddressingMode::absolute};
-    instructions[0x10] = {InstructionType::bpl, AddressingMode::relative};
-    instructions[0x11] = {InstructionType::ora, AddressingMode::indirect_y};
-    instructions[0x15] = {InstructionType::ora, AddressingMode::zero_page_x};
-    instructions[0x16] = {InstructionType::asl, AddressingMode::zero_page_x};
-    instructions[0x18] = {InstructionType::clc, AddressingMode::implied};
-    instructions[0x19] = {InstructionType::ora, AddressingMode::absolute_y};
-    instructions[0x1D] = {InstructionType::ora, AddressingMode::absolute_x};
-    instructions[0x1E] = {InstructionType::asl, AddressingMode::absolute_x};
+    table[0x00] = {InstructionType::brk, AddressingMode::implied};
+    table[0x01] = {InstructionType::ora, AddressingMode::indirect_x};
+    table[0x05] = {InstructionType::ora, AddressingMode::zero_page};
+    table[0x06] = {InstructionType::asl, AddressingMode::zero_page};
+    table[0x08] = {InstructionType::php, AddressingMode::implied};
+    table[0x09] = {InstructionType::ora, AddressingMode::immediate};
+    table[0x0A] = {InstructionType::asl, AddressingMode::accum};
+    table[0x0D] = {InstructionType::ora, AddressingMode::absolute};
+    table[0x0E] = {InstructionType::asl, AddressingMode::absolute};
+    table[0x10] = {InstructionType::bpl, AddressingMode::relative};
+    table[0x11] = {InstructionType::ora, AddressingMode::indirect_y};
+    table[0x15] = {InstructionType::ora, AddressingMode::zero_page_x};
+    table[0x16] = {InstructionType::asl, AddressingMode::zero_page_x};
+    table[0x18] = {InstructionType::clc, AddressingMode::implied};
+    table[0x19] = {InstructionType::ora, AddressingMode::absolute_y};
+    table[0x1D] = {InstructionType::ora, AddressingMode::absolute_x};
+    table[0x1E] = {InstructionType::asl, AddressingMode::absolute_x};
 
     /* $20-$3F -------------------------------------------------------- */
-    instructions[0x20] = {InstructionType::jsr, AddressingMode::absolute};
-    instructions[0x21] = {InstructionType::and_, AddressingMode::indirect_x};
-    instructions[0x24] = {InstructionType::bit, AddressingMode::zero_page};
-    instructions[0x25] = {InstructionType::and_, AddressingMode::zero_page};
-    instructions[0x26] = {InstructionType::rol, AddressingMode::zero_page};
-    instructions[0x28] = {InstructionType::plp, AddressingMode::implied};
-    instructions[0x29] = {InstructionType::and_, AddressingMode::immediate};
-    instructions[0x2A] = {InstructionType::rol, AddressingMode::accum};
-    instructions[0x2C] = {InstructionType::bit, AddressingMode::absolute};
-    instructions[0x2D] = {InstructionType::and_, AddressingMode::absolute};
-    instructions[0x2E] = {InstructionType::rol, AddressingMode::absolute};
-    instructions[0x30] = {InstructionType::bmi, AddressingMode::relative};
-    instructions[0x31] = {InstructionType::and_, AddressingMode::indirect_y};
-    instructions[0x35] = {InstructionType::and_, AddressingMode::zero_page_x};
-    instructions[0x36] = {InstructionType::rol, AddressingMode::zero_page_x};
-    instructions[0x38] = {InstructionType::sec, AddressingMode::implied};
-    instructions[0x39] = {InstructionType::and_, AddressingMode::absolute_y};
-    instructions[0x3D] = {InstructionType::and_, AddressingMode::absolute_x};
-    instructions[0x3E] = {InstructionType::rol, AddressingMode::absolute_x};
+    table[0x20] = {InstructionType::jsr, AddressingMode::absolute};
+    table[0x21] = {InstructionType::and_, AddressingMode::indirect_x};
+    table[0x24] = {InstructionType::bit, AddressingMode::zero_page};
+    table[0x25] = {InstructionType::and_, AddressingMode::zero_page};
+    table[0x26] = {InstructionType::rol, AddressingMode::zero_page};
+    table[0x28] = {InstructionType::plp, AddressingMode::implied};
+    table[0x29] = {InstructionType::and_, AddressingMode::immediate};
+    table[0x2A] = {InstructionType::rol, AddressingMode::accum};
+    table[0x2C] = {InstructionType::bit, AddressingMode::absolute};
+    table[0x2D] = {InstructionType::and_, AddressingMode::absolute};
+    table[0x2E] = {InstructionType::rol, AddressingMode::absolute};
+    table[0x30] = {InstructionType::bmi, AddressingMode::relative};
+    table[0x31] = {InstructionType::and_, AddressingMode::indirect_y};
+    table[0x35] = {InstructionType::and_, AddressingMode::zero_page_x};
+    table[0x36] = {InstructionType::rol, AddressingMode::zero_page_x};
+    table[0x38] = {InstructionType::sec, AddressingMode::implied};
+    table[0x39] = {InstructionType::and_, AddressingMode::absolute_y};
+    table[0x3D] = {InstructionType::and_, AddressingMode::absolute_x};
+    table[0x3E] = {InstructionType::rol, AddressingMode::absolute_x};
 
     /* $40-$5F -------------------------------------------------------- */
-    instructions[0x40] = {InstructionType::rti, AddressingMode::implied};
-    instructions[0x41] = {InstructionType::eor, AddressingMode::indirect_x};
-    instructions[0x45] = {InstructionType::eor, AddressingMode::zero_page};
-    instructions[0x46] = {InstructionType::lsr, AddressingMode::zero_page};
-    instructions[0x48] = {InstructionType::pha, AddressingMode::implied};
-    instructions[0x49] = {InstructionType::eor, AddressingMode::immediate};
-    instructions[0x4A] = {InstructionType::lsr, AddressingMode::accum};
-    instructions[0x4C] = {InstructionType::jmp, AddressingMode::absolute};
-    instructions[0x4D] = {InstructionType::eor, AddressingMode::absolute};
-    instructions[0x4E] = {InstructionType::lsr, AddressingMode::absolute};
-    instructions[0x50] = {InstructionType::bvc, AddressingMode::relative};
-    instructions[0x51] = {InstructionType::eor, AddressingMode::indirect_y};
-    instructions[0x55] = {InstructionType::eor, AddressingMode::zero_page_x};
-    instructions[0x56] = {InstructionType::lsr, AddressingMode::zero_page_x};
-    instructions[0x58] = {InstructionType::cli, AddressingMode::implied};
-    instructions[0x59] = {InstructionType::eor, AddressingMode::absolute_y};
-    instructions[0x5D] = {InstructionType::eor, AddressingMode::absolute_x};
-    instructions[0x5E] = {InstructionType::lsr, AddressingMode::absolute_x};
+    table[0x40] = {InstructionType::rti, AddressingMode::implied};
+    table[0x41] = {InstructionType::eor, AddressingMode::indirect_x};
+    table[0x45] = {InstructionType::eor, AddressingMode::zero_page};
+    table[0x46] = {InstructionType::lsr, AddressingMode::zero_page};
+    table[0x48] = {InstructionType::pha, AddressingMode::implied};
+    table[0x49] = {InstructionType::eor, AddressingMode::immediate};
+    table[0x4A] = {InstructionType::lsr, AddressingMode::accum};
+    table[0x4C] = {InstructionType::jmp, AddressingMode::absolute};
+    table[0x4D] = {InstructionType::eor, AddressingMode::absolute};
+    table[0x4E] = {InstructionType::lsr, AddressingMode::absolute};
+    table[0x50] = {InstructionType::bvc, AddressingMode::relative};
+    table[0x51] = {InstructionType::eor, AddressingMode::indirect_y};
+    table[0x55] = {InstructionType::eor, AddressingMode::zero_page_x};
+    table[0x56] = {InstructionType::lsr, AddressingMode::zero_page_x};
+    table[0x58] = {InstructionType::cli, AddressingMode::implied};
+    table[0x59] = {InstructionType::eor, AddressingMode::absolute_y};
+    table[0x5D] = {InstructionType::eor, AddressingMode::absolute_x};
+    table[0x5E] = {InstructionType::lsr, AddressingMode::absolute_x};
 
     /* $60-$7F -------------------------------------------------------- */
-    instructions[0x60] = {InstructionType::rts, AddressingMode::implied};
-    instructions[0x61] = {InstructionType::adc, AddressingMode::indirect_x};
-    instructions[0x65] = {InstructionType::adc, AddressingMode::zero_page};
-    instructions[0x66] = {InstructionType::ror, AddressingMode::zero_page};
-    instructions[0x68] = {InstructionType::pla, AddressingMode::implied};
-    instructions[0x69] = {InstructionType::adc, AddressingMode::immediate};
-    instructions[0x6A] = {InstructionType::ror, AddressingMode::accum};
-    instructions[0x6C] = {InstructionType::jmp, AddressingMode::indirect};
-    instructions[0x6D] = {InstructionType::adc, AddressingMode::absolute};
-    instructions[0x6E] = {InstructionType::ror, AddressingMode::absolute};
-    instructions[0x70] = {InstructionType::bvs, AddressingMode::relative};
-    instructions[0x71] = {InstructionType::adc, AddressingMode::indirect_y};
-    instructions[0x75] = {InstructionType::adc, AddressingMode::zero_page_x};
-    instructions[0x76] = {InstructionType::ror, AddressingMode::zero_page_x};
-    instructions[0x78] = {InstructionType::sei, AddressingMode::implied};
-    instructions[0x79] = {InstructionType::adc, AddressingMode::absolute_y};
-    instructions[0x7D] = {InstructionType::adc, AddressingMode::absolute_x};
-    instructions[0x7E] = {InstructionType::ror, AddressingMode::absolute_x};
+    table[0x60] = {InstructionType::rts, AddressingMode::implied};
+    table[0x61] = {InstructionType::adc, AddressingMode::indirect_x};
+    table[0x65] = {InstructionType::adc, AddressingMode::zero_page};
+    table[0x66] = {InstructionType::ror, AddressingMode::zero_page};
+    table[0x68] = {InstructionType::pla, AddressingMode::implied};
+    table[0x69] = {InstructionType::adc, AddressingMode::immediate};
+    table[0x6A] = {InstructionType::ror, AddressingMode::accum};
+    table[0x6C] = {InstructionType::jmp, AddressingMode::indirect};
+    table[0x6D] = {InstructionType::adc, AddressingMode::absolute};
+    table[0x6E] = {InstructionType::ror, AddressingMode::absolute};
+    table[0x70] = {InstructionType::bvs, AddressingMode::relative};
+    table[0x71] = {InstructionType::adc, AddressingMode::indirect_y};
+    table[0x75] = {InstructionType::adc, AddressingMode::zero_page_x};
+    table[0x76] = {InstructionType::ror, AddressingMode::zero_page_x};
+    table[0x78] = {InstructionType::sei, AddressingMode::implied};
+    table[0x79] = {InstructionType::adc, AddressingMode::absolute_y};
+    table[0x7D] = {InstructionType::adc, AddressingMode::absolute_x};
+    table[0x7E] = {InstructionType::ror, AddressingMode::absolute_x};
 
     /* $80-$9F -------------------------------------------------------- */
-    instructions[0x81] = {InstructionType::sta, AddressingMode::indirect_x};
-    instructions[0x84] = {InstructionType::sty, AddressingMode::zero_page};
-    instructions[0x85] = {InstructionType::sta, AddressingMode::zero_page};
-    instructions[0x86] = {InstructionType::stx, AddressingMode::zero_page};
-    instructions[0x88] = {InstructionType::dey, AddressingMode::implied};
-    instructions[0x8A] = {InstructionType::txa, AddressingMode::implied};
-    instructions[0x8C] = {InstructionType::sty, AddressingMode::absolute};
-    instructions[0x8D] = {InstructionType::sta, AddressingMode::absolute};
-    instructions[0x8E] = {InstructionType::stx, AddressingMode::absolute};
-    instructions[0x90] = {InstructionType::bcc, AddressingMode::relative};
-    instructions[0x91] = {InstructionType::sta, AddressingMode::indirect_y};
-    instructions[0x94] = {InstructionType::sty, AddressingMode::zero_page_x};
-    instructions[0x95] = {InstructionType::sta, AddressingMode::zero_page_x};
-    instructions[0x96] = {InstructionType::stx, AddressingMode::zero_page_y};
-    instructions[0x98] = {InstructionType::tya, AddressingMode::implied};
-    instructions[0x99] = {InstructionType::sta, AddressingMode::absolute_y};
-    instructions[0x9A] = {InstructionType::txs, AddressingMode::implied};
-    instructions[0x9D] = {InstructionType::sta, AddressingMode::absolute_x};
+    table[0x81] = {InstructionType::sta, AddressingMode::indirect_x};
+    table[0x84] = {InstructionType::sty, AddressingMode::zero_page};
+    table[0x85] = {InstructionType::sta, AddressingMode::zero_page};
+    table[0x86] = {InstructionType::stx, AddressingMode::zero_page};
+    table[0x88] = {InstructionType::dey, AddressingMode::implied};
+    table[0x8A] = {InstructionType::txa, AddressingMode::implied};
+    table[0x8C] = {InstructionType::sty, AddressingMode::absolute};
+    table[0x8D] = {InstructionType::sta, AddressingMode::absolute};
+    table[0x8E] = {InstructionType::stx, AddressingMode::absolute};
+    table[0x90] = {InstructionType::bcc, AddressingMode::relative};
+    table[0x91] = {InstructionType::sta, AddressingMode::indirect_y};
+    table[0x94] = {InstructionType::sty, AddressingMode::zero_page_x};
+    table[0x95] = {InstructionType::sta, AddressingMode::zero_page_x};
+    table[0x96] = {InstructionType::stx, AddressingMode::zero_page_y};
+    table[0x98] = {InstructionType::tya, AddressingMode::implied};
+    table[0x99] = {InstructionType::sta, AddressingMode::absolute_y};
+    table[0x9A] = {InstructionType::txs, AddressingMode::implied};
+    table[0x9D] = {InstructionType::sta, AddressingMode::absolute_x};
 
     /* $A0-$BF -------------------------------------------------------- */
-    instructions[0xA0] = {InstructionType::ldy, AddressingMode::immediate};
-    instructions[0xA1] = {InstructionType::lda, AddressingMode::indirect_x};
-    instructions[0xA2] = {InstructionType::ldx, AddressingMode::immediate};
-    instructions[0xA4] = {InstructionType::ldy, AddressingMode::zero_page};
-    instructions[0xA5] = {InstructionType::lda, AddressingMode::zero_page};
-    instructions[0xA6] = {InstructionType::ldx, AddressingMode::zero_page};
-    instructions[0xA8] = {InstructionType::tay, AddressingMode::implied};
-    instructions[0xA9] = {InstructionType::lda, AddressingMode::immediate};
-    instructions[0xAA] = {InstructionType::tax, AddressingMode::implied};
-    instructions[0xAC] = {InstructionType::ldy, AddressingMode::absolute};
-    instructions[0xAD] = {InstructionType::lda, AddressingMode::absolute};
-    instructions[0xAE] = {InstructionType::ldx, AddressingMode::absolute};
-
-    instructions[0xB0] = {InstructionType::bcs, AddressingMode::relative};
-    instructions[0xB1] = {InstructionType::lda, AddressingMode::indirect_y};
-    instructions[0xB4] = {InstructionType::ldy, AddressingMode::zero_page_x};
-    instructions[0xB5] = {InstructionType::lda, AddressingMode::zero_page_x};
-    instructions[0xB6] = {InstructionType::ldx, AddressingMode::zero_page_y};
-    instructions[0xB8] = {InstructionType::clv, AddressingMode::implied};
-    instructions[0xB9] = {InstructionType::lda, AddressingMode::absolute_y};
-    instructions[0xBA] = {InstructionType::tsx, AddressingMode::implied};
-    instructions[0xBC] = {InstructionType::ldy, AddressingMode::absolute_x};
-    instructions[0xBD] = {InstructionType::lda, AddressingMode::absolute_x};
-    instructions[0xBE] = {InstructionType::ldx, AddressingMode::absolute_y};
+    table[0xA0] = {InstructionType::ldy, AddressingMode::immediate};
+    table[0xA1] = {InstructionType::lda, AddressingMode::indirect_x};
+    table[0xA2] = {InstructionType::ldx, AddressingMode::immediate};
+    table[0xA4] = {InstructionType::ldy, AddressingMode::zero_page};
+    table[0xA5] = {InstructionType::lda, AddressingMode::zero_page};
+    table[0xA6] = {InstructionType::ldx, AddressingMode::zero_page};
+    table[0xA8] = {InstructionType::tay, AddressingMode::implied};
+    table[0xA9] = {InstructionType::lda, AddressingMode::immediate};
+    table[0xAA] = {InstructionType::tax, AddressingMode::implied};
+    table[0xAC] = {InstructionType::ldy, AddressingMode::absolute};
+    table[0xAD] = {InstructionType::lda, AddressingMode::absolute};
+    table[0xAE] = {InstructionType::ldx, AddressingMode::absolute};
+
+    table[0xB0] = {InstructionType::bcs, AddressingMode::relative};
+    table[0xB1] = {InstructionType::lda, AddressingMode::indirect_y};
+    table[0xB4] = {InstructionType::ldy, AddressingMode::zero_page_x};
+    table[0xB5] = {InstructionType::lda, AddressingMode::zero_page_x};
+    table[0xB6] = {InstructionType::ldx, AddressingMode::zero_page_y};
+    table[0xB8] = {InstructionType::clv, AddressingMode::implied};
+    table[0xB9] = {InstructionType::lda, AddressingMode::absolute_y};
+    table[0xBA] = {InstructionType::tsx, AddressingMode::implied};
+    table[0xBC] = {InstructionType::ldy, AddressingMode::absolute_x};
+    table[0xBD] = {InstructionType::lda, AddressingMode::absolute_x};
+    table[0xBE] = {InstructionType::ldx, AddressingMode::absolute_y};
 
     /* $C0-$DF -------------------------------------------------------- */
-    instructions[0xC0] = {InstructionType::cpy, AddressingMode::immediate};
-    instructions[0xC1] = {InstructionType::cmp, AddressingMode::indirect_x};
-    instructions[0xC4] = {InstructionType::cpy, AddressingMode::zero_page};
-    instructions[0xC5] = {InstructionType::cmp, AddressingMode::zero_page};
-    instructions[0xC6] = {InstructionType::dec, AddressingMode::zero_page};
-    instructions[0xC8] = {InstructionType::iny, AddressingMode::implied};
-    instructions[0xC9] = {InstructionType::cmp, AddressingMode::immediate};
-    instructions[0xCA] = {InstructionType::dex, AddressingMode::implied};
-    instructions[0xCC] = {InstructionType::cpy, AddressingMode::absolute};
-    instructions[0xCD] = {InstructionType::cmp, AddressingMode::absolute};
-    instructions[0xCE] = {InstructionType::dec, AddressingMode::absolute};
-    instructions[0xD0] = {InstructionType::bne, AddressingMode::relative};
-    instructions[0xD1] = {InstructionType::cmp, AddressingMode::indirect_y};
-    instructions[0xD5] = {InstructionType::cmp, AddressingMode::zero_page_x};
-    instructions[0xD6] = {InstructionType::dec, AddressingMode::zero_page_x};
-    instructions[0xD8] = {InstructionType::cld, AddressingMode::implied};
-    instructions[0xD9] = {InstructionType::cmp, AddressingMode::absolute_y};
-    instructions[0xDD] = {InstructionType::cmp, AddressingMode::absolute_x};
-    instructions[0xDE] = {InstructionType::dec, AddressingMode::absolute_x};
+    table[0xC0] = {InstructionType::cpy, AddressingMode::immediate};
+    table[0xC1] = {InstructionType::cmp, AddressingMode::indirect_x};
+    table[0xC4] = {InstructionType::cpy, AddressingMode::zero_page};
+    table[0xC5] = {InstructionType::cmp, AddressingMode::zero_page};
+    table[0xC6] = {InstructionType::dec, AddressingMode::zero_page};
+    table[0xC8] = {InstructionType::iny, AddressingMode::implied};
+    table[0xC9] = {InstructionType::cmp, AddressingMode::immediate};
+    table[0xCA] = {InstructionType::dex, AddressingMode::implied};
+    table[0xCC] = {InstructionType::cpy, AddressingMode::absolute};
+    table[0xCD] = {InstructionType::cmp, AddressingMode::absolute};
+    table[0xCE] = {InstructionType::dec, AddressingMode::absolute};
+    table[0xD0] = {InstructionType::bne, AddressingMode::relative};
+    table[0xD1] = {InstructionType::cmp, AddressingMode::indirect_y};
+    table[0xD5] = {InstructionType::cmp, AddressingMode::zero_page_x};
+    table[0xD6] = {InstructionType::dec, AddressingMode::zero_page_x};
+    table[0xD8] = {InstructionType::cld, AddressingMode::implied};
+    table[0xD9] = {InstructionType::cmp, AddressingMode::absolute_y};
+    table[0xDD] = {InstructionType::cmp, AddressingMode::absolute_x};
+    table[0xDE] = {InstructionType::dec, AddressingMode::absolute_x};
 
     /* $E0-$FF -------------------------------------------------------- */
-    instructions[0xE0] = {InstructionType::cpx, AddressingMode::immediate};
-    instructions[0xE1] = {InstructionType::sbc, AddressingMode::indirect_x};
-    instructions[0xE4] = {InstructionType::cpx, AddressingMode::zero_page};
-    instructions[0xE5] = {InstructionType::sbc, AddressingMode::zero_page};
-    instructions[0xE6] = {InstructionType::inc, AddressingMode::zero_page};
-    instructions[0xE8] = {InstructionType::inx, AddressingMode::implied};
-    instructions[0xE9] = {InstructionType::sbc, AddressingMode::immediate};
-    instructions[0xEA] = {InstructionType::nop, AddressingMode::implied};
-    instructions[0xEC] = {InstructionType::cpx, AddressingMode::absolute};
-    instructions[0xED] = {InstructionType::sbc, AddressingMode::absolute};
-    instructions[0xEE] = {InstructionType::inc, AddressingMode::absolute};
-    instructions[0xF0] = {InstructionType::beq, AddressingMode::relative};
-    instructions[0xF1] = {InstructionType::sbc, AddressingMode::indirect_y};
-    instructions[0xF5] = {InstructionType::sbc, AddressingMode::zero_page_x};
-    instructions[0xF6] = {InstructionType::inc, AddressingMode::zero_page_x};
-    instructions[0xF8] = {InstructionType::sed, AddressingMode::implied};
-    instructions[0xF9] = {InstructionType::sbc, AddressingMode::absolute_y};
-    instructions[0xFD] = {InstructionType::sbc, AddressingMode::absolute_x};
-    instructions[0xFE] = {InstructionType::inc, AddressingMode::absolute_x};
+    table[0xE0] = {InstructionType::cpx, AddressingMode::immediate};
+    table[0xE1] = {InstructionType::sbc, AddressingMode::indirect_x};
+    table[0xE4] = {InstructionType::cpx, AddressingMode::zero_page};
+    table[0xE5] = {InstructionType::sbc, AddressingMode::zero_page};
+    table[0xE6] = {InstructionType::inc, AddressingMode::zero_page};
+    table[0xE8] = {InstructionType::inx, AddressingMode::implied};
+    table[0xE9] = {InstructionType::sbc, AddressingMode::immediate};
+    table[0xEA] = {InstructionType::nop, AddressingMode::implied};
+    table[0xEC] = {InstructionType::cpx, AddressingMode::absolute};
+    table[0xED] = {InstructionType::sbc, AddressingMode::absolute};
+    table[0xEE] = {InstructionType::inc, AddressingMode::absolute};
+    table[0xF0] = {InstructionType::beq, AddressingMode::relative};
+    table[0xF1] = {InstructionType::sbc, AddressingMode::indirect_y};
+    table[0xF5] = {InstructionType::sbc, AddressingMode::zero_page_x};
+    table[0xF6] = {InstructionType::inc, AddressingMode::zero_page_x};
+    table[0xF8] = {InstructionType::sed, AddressingMode::implied};
+    table[0xF9] = {InstructionType::sbc, AddressingMode::absolute_y};
+    table[0xFD] = {InstructionType::sbc, AddressingMode::absolute_x};
+    table[0xFE] = {InstructionType::inc, AddressingMode::absolute_x};
+
+    /* 3.  Stable undocumented NMOS opcodes (unstable ones and JAMs stay NONE) */
+    if constexpr (V == Variant::nmos_undocumented) {
+        // Read-modify-write + ALU combinations, every row repeats the same seven modes
+        constexpr std::array<std::pair<size_t, InstructionType>, 6> rmw_rows = {{
+            {0x00, InstructionType::slo},
+            {0x20, InstructionType::rla},
+            {0x40, InstructionType::sre},
+            {0x60, InstructionType::rra},
+            {0xC0, InstructionType::dcp},
+            {0xE0, InstructionType::isc},
+        }};
+        for (const auto &[row, type] : rmw_rows) {
+            table[row + 0x03] = {type, AddressingMode::indirect_x};
+            table[row + 0x07] = {type, AddressingMode::zero_page};
+            table[row + 0x0F] = {type, AddressingMode::absolute};
+            table[row + 0x13] = {type, AddressingMode::indirect_y};
+            table[row + 0x17] = {type, AddressingMode::zero_page_x};
+            table[row + 0x1B] = {type, AddressingMode::absolute_y};
+            table[row + 0x1F] = {type, AddressingMode::absolute_x};
+        }
+        table[0x83] = {InstructionType::sax, AddressingMode::indirect_x};
+        table[0x87] = {InstructionType::sax, AddressingMode::zero_page};
+        table[0x8F] = {InstructionType::sax, AddressingMode::absolute};
+        table[0x97] = {InstructionType::sax, AddressingMode::zero_page_y};
+        table[0xA3] = {InstructionType::lax, AddressingMode::indirect_x};
+        table[0xA7] = {InstructionType::lax, AddressingMode::zero_page};
+        table[0xAF] = {InstructionType::lax, AddressingMode::absolute};
+        table[0xB3] = {InstructionType::lax, AddressingMode::indirect_y};
+        table[0xB7] = {InstructionType::lax, AddressingMode::zero_page_y};
+        table[0xBF] = {InstructionType::lax, AddressingMode::absolute_y};
+        table[0x0B] = {InstructionType::anc, AddressingMode::immediate};
+        table[0x2B] = {InstructionType::anc, AddressingMode::immediate};
+        table[0x4B] = {InstructionType::alr, AddressingMode::immediate};
+        table[0x6B] = {InstructionType::arr, AddressingMode::immediate};
+        table[0xCB] = {InstructionType::sbx, AddressingMode::immediate};
+        table[0xEB] = {InstructionType::sbc, AddressingMode::immediate};
+        // NOPs that still fetch their operands
+        table[0x1A] = {InstructionType::nop, AddressingMode::implied};
+        table[0x3A] = {InstructionType::nop, AddressingMode::implied};
+        table[0x5A] = {InstructionType::nop, AddressingMode::implied};
+        table[0x7A] = {InstructionType::nop, AddressingMode::implied};
+        table[0xDA] = {InstructionType::nop, AddressingMode::implied};
+        table[0xFA] = {InstructionType::nop, AddressingMode::implied};
+        table[0x80] = {InstructionType::nop, AddressingMode::immediate};
+        table[0x82] = {InstructionType::nop, AddressingMode::immediate};
+        table[0x89] = {InstructionType::nop, AddressingMode::immediate};
+        table[0xC2] = {InstructionType::nop, AddressingMode::immediate};
+        table[0xE2] = {InstructionType::nop, AddressingMode::immediate};
+        table[0x04] = {InstructionType::nop, AddressingMode::zero_page};
+        table[0x44] = {InstructionType::nop, AddressingMode::zero_page};
+        table[0x64] = {InstructionType::nop, AddressingMode::zero_page};
+        table[0x14] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0x34] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0x54] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0x74] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0xD4] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0xF4] = {InstructionType::nop, AddressingMode::zero_page_x};
+        table[0x0C] = {InstructionType::nop, AddressingMode::absolute};
+        table[0x1C] = {InstructionType::nop, AddressingMode::absolute_x};
+        table[0x3C] = {InstructionType::nop, AddressingMode::absolute_x};
+        table[0x5C] = {InstructionType::nop, AddressingMode::absolute_x};
+        table[0x7C] = {InstructionType::nop, AddressingMode::absolute_x};
+        table[0xDC] = {InstructionType::nop, AddressingMode::absolute_x};
+        table[0xFC] = {InstructionType::nop, AddressingMode::absolute_x};
+    }
+
+    /* 4.  65C02 additions -------------------------------------------- */
+    if constexpr (V == Variant::cmos) {
+        table[0x80] = {InstructionType::bra, AddressingMode::relative};
+        table[0x64] = {InstructionType::stz, AddressingMode::zero_page};
+        table[0x74] = {InstructionType::stz, AddressingMode::zero_page_x};
+        table[0x9C] = {InstructionType::stz, AddressingMode::absolute};
+        table[0x9E] = {InstructionType::stz, AddressingMode::absolute_x};
+        table[0x5A] = {InstructionType::phy, AddressingMode::implied};
+        table[0x7A] = {InstructionType::ply, AddressingMode::implied};
+        table[0xDA] = {InstructionType::phx, AddressingMode::implied};
+        table[0xFA] = {InstructionType::plx, AddressingMode::implied};
+        table[0x1A] = {InstructionType::inc, AddressingMode::accum};
+        table[0x3A] = {InstructionType::dec, AddressingMode::accum};
+        table[0x04] = {InstructionType::tsb, AddressingMode::zero_page};
+        table[0x0C] = {InstructionType::tsb, AddressingMode::absolute};
+        table[0x14] = {InstructionType::trb, AddressingMode::zero_page};
+        table[0x1C] = {InstructionType::trb, AddressingMode::absolute};
+        table[0x34] = {InstructionType::bit, AddressingMode::zero_page_x};
+        table[0x3C] = {InstructionType::bit, AddressingMode::absolute_x};
+        table[0x89] = {InstructionType::bit, AddressingMode::immediate};
+        table[0x7C] = {InstructionType::jmp, AddressingMode::absolute_indirect_x};
+        table[0x12] = {InstructionType::ora, AddressingMode::zero_page_indirect};
+        table[0x32] = {InstructionType::and_, AddressingMode::zero_page_indirect};
+        table[0x52] = {InstructionType::eor, AddressingMode::zero_page_indirect};
+        table[0x72] = {InstructionType::adc, AddressingMode::zero_page_indirect};
+        table[0x92] = {InstructionType::sta, AddressingMode::zero_page_indirect};
+        table[0xB2] = {InstructionType::lda, AddressingMode::zero_page_indirect};
+        table[0xD2] = {InstructionType::cmp, AddressingMode::zero_page_indirect};
+        table[0xF2] = {InstructionType::sbc, AddressingMode::zero_page_indirect};
+
+        // Every other opcode is a NOP of fixed size (no Rockwell / WDC bit instructions, WAI or STP).
+        // Columns 3, 7, B and F finish within their opcode fetch, tick() knows them by mode NONE.
+        // $5C spends eight cycles on the chip, here it reads its address like $DC and $FC.
+        for (size_t op = 0; op < table.size(); ++op) {
+            if (table[op].type != InstructionType::NONE) continue;
+            AddressingMode mode = (op & 0x03) == 0x03 ? AddressingMode::NONE : AddressingMode::implied;
+            if ((op & 0x0F) == 0x02) mode = AddressingMode::immediate;
+            if (op == 0x44) mode = AddressingMode::zero_page;
+            if (op == 0x54 || op == 0xD4 || op == 0xF4) mode = AddressingMode::zero_page_x;
+            if (op == 0x5C || op == 0xDC || op == 0xFC) mode = AddressingMode::absolute;
+            table[op] = {InstructionType::nop, mode};
+        }
+    }
+    return table;
+}
+template <Variant V>
+inline constexpr std::array<Instruction, 256> instruction_table_for = make_instruction_table<V>();
+
+// Documented NMOS opcodes, what the assembler emits
+inline constexpr const std::array<Instruction, 256> &instruction_table = instruction_table_for<Variant::nmos>;
+
+[[nodiscard]] constexpr auto decode(Variant variant, Byte opcode) -> Instruction {
+    return with_variant(variant, [opcode](auto v) { return instruction_table_for<decltype(v)::value>[opcode]; });
+}
+
+// Data cycle of a read or store, the cycle after the effective address is known. Stores hand the
+// address on and exec_func writes it within this cycle, everything else reads its operand here.
+inline auto access_operand(CPU &cpu, Address addr) -> AddrResult {
+    if (is_store_instruction(cpu.instr.type)) return {AddrResultType::complete_address, .addr = addr};
+    return {AddrResultType::complete_value, .value = read(cpu, addr)};
+}
+
+// X for the modes indexed by X, Y for the ones indexed by Y
+[[nodiscard]] inline auto index_register(const CPU &cpu) -> Byte {
+    switch (cpu.instr.mode) {
+    case AddressingMode::zero_page_y:
+    case AddressingMode::absolute_y:
+    case AddressingMode::indirect_y:
+        return cpu.Y;
+    default:
+        return cpu.X;
+    }
+}
+
+// Whether adding index to the low byte of TAR carried into its high byte
+[[nodiscard]] inline auto page_crossed(const CPU &cpu, Byte index) -> bool {
+    return (cpu.temporary_address_register & 0xFF) < index;
 }
 
+// Pointer in cpu.tmp (zero page), low byte of the address it points at into TAR
+inline auto read_pointer_low(CPU &cpu) -> void { cpu.temporary_address_register = read(cpu, cpu.tmp); }
+// High byte of the pointer, wrapping within the zero page like the hardware does
+inline auto read_pointer_high(CPU &cpu) -> void {
+    cpu.temporary_address_register |= static_cast<Address>(read(cpu, static_cast<Byte>(cpu.tmp + 1)) << 8);
+}
+
+// Indexing cycle of zero page,X / zero page,Y: the base address is read while the index is added,
+// the sum stays in the zero page
+inline auto index_zero_page(CPU &cpu) -> void {
+    cpu.data_bus = bus_read(cpu, cpu.temporary_address_register); // Dummy read
+    cpu.temporary_address_register = static_cast<Byte>(cpu.temporary_address_register + index_register(cpu));
+}
+
+// Fix-up cycle of an indexed absolute or (zp),Y address, TAR already holds the sum. The NMOS part
+// reads with the high byte not yet carried into, the 65C02 reads the last operand byte again.
+template <Variant V>
+inline auto dummy_read_unfixed(CPU &cpu) -> void {
+    if constexpr (is_nmos(V)) {
+        const Address unfixed = page_crossed(cpu, index_register(cpu))
+                                    ? static_cast<Address>(cpu.temporary_address_register - 0x100)
+                                    : cpu.temporary_address_register;
+        cpu.data_bus = bus_read(cpu, unfixed);
+    } else {
+        cpu.data_bus = bus_read(cpu, static_cast<Address>(cpu.PC - 1));
+    }
+}
+
+// Reads skip the fix-up cycle unless the index carried into the high byte, stores and
+// read-modify-writes always take it
+template <Variant V>
+inline auto fix_up_or_access(CPU &cpu) -> AddrResult {
+    if (!is_store_instruction(cpu.instr.type) && !page_crossed(cpu, index_register(cpu))) {
+        return access_operand(cpu, cpu.temporary_address_register);
+    }
+    dummy_read_unfixed<V>(cpu);
+    return {AddrResultType::in_progress};
+}
+
+template <Variant V>
 inline auto addr_mode(CPU &cpu) -> AddrResult {
     if (cpu.instr_counter < 1) assert(false);
     switch (cpu.instr.mode) {
     case AddressingMode::implied:
         assert(cpu.instr_counter == 1);
+        cpu.data_bus = bus_read(cpu, cpu.PC); // Dummy read of the next byte
         return {AddrResultType::complete};
     case AddressingMode::zero_page: // operand is zeropage address (hi-byte is zero, address = $00LL)
-        assert(cpu.instr_counter == 1);
-        return {AddrResultType::complete_value, .value = fetch(cpu)};
-    case AddressingMode::immediate:
-        if (cpu.instr_counter != 1) assert(false);
-        return {AddrResultType::complete_value, .value = fetch(cpu)};
+        switch (cpu.instr_counter) {
+        case 1:
+            cpu.temporary_address_register = fetch(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::immediate:
+        if (cpu.instr_counter != 1) assert(false);
+        return {AddrResultType::complete_value, .value = fetch(cpu)};
         break;
     case AddressingMode::absolute:
-        if (cpu.instr_counter == 1) {
+        switch (cpu.instr_counter) {
+        case 1:
             fetch_to_tmp(cpu);
             return {AddrResultType::in_progress};
-        } else if (cpu.instr_counter == 2) {
-            Address addr = static_cast<Address>(fetch(cpu) << 8) | static_cast<Address>(cpu.tmp);
-            return {AddrResultType::complete_address, .addr = addr};
-        } else {
+        case 2:
+            fetch_to_tar(cpu);
+            if (cpu.instr.type == InstructionType::jmp) {
+                return {AddrResultType::complete_address, .addr = cpu.temporary_address_register};
+            }
+            return {AddrResultType::in_progress};
+        case 3:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::zero_page_x:
+    case AddressingMode::zero_page_y:
+        switch (cpu.instr_counter) {
+        case 1:
+            cpu.temporary_address_register = fetch(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            index_zero_page(cpu);
+            return {AddrResultType::in_progress};
+        case 3:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::absolute_x:
+    case AddressingMode::absolute_y:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            fetch_to_tar(cpu);
+            cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + index_register(cpu));
+            return {AddrResultType::in_progress};
+        case 3:
+            return fix_up_or_access<V>(cpu);
+        case 4:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::indirect_x:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            cpu.data_bus = bus_read(cpu, cpu.tmp); // Dummy read of the pointer while X is added
+            cpu.tmp = static_cast<Byte>(cpu.tmp + cpu.X);
+            return {AddrResultType::in_progress};
+        case 3:
+            read_pointer_low(cpu);
+            return {AddrResultType::in_progress};
+        case 4:
+            read_pointer_high(cpu);
+            return {AddrResultType::in_progress};
+        case 5:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::indirect_y:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            read_pointer_low(cpu);
+            return {AddrResultType::in_progress};
+        case 3:
+            read_pointer_high(cpu);
+            cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + cpu.Y);
+            return {AddrResultType::in_progress};
+        case 4:
+            return fix_up_or_access<V>(cpu);
+        case 5:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::zero_page_indirect:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            read_pointer_low(cpu);
+            return {AddrResultType::in_progress};
+        case 3:
+            read_pointer_high(cpu);
+            return {AddrResultType::in_progress};
+        case 4:
+            return access_operand(cpu, cpu.temporary_address_register);
+        default:
+            assert(false);
+        }
+        break;
+    case AddressingMode::absolute_indirect_x: // JMP (abs,X), 65C02
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            fetch_to_tar(cpu);
+            return {AddrResultType::in_progress};
+        case 3:
+            cpu.data_bus = bus_read(cpu, static_cast<Address>(cpu.PC - 1)); // Dummy read while X is added
+            cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + cpu.X);
+            return {AddrResultType::in_progress};
+        case 4:
+            read_tar(cpu);
+            return {AddrResultType::in_progress};
+        case 5: {
+            const auto high = static_cast<Address>(read(cpu, static_cast<Address>(cpu.temporary_address_register + 1)) << 8);
+            return {AddrResultType::complete_address, .addr = static_cast<Address>(high | cpu.tmp)};
+        }
+        default:
             assert(false);
         }
         break;
@@ -639,19 +1668,29 @@ inline auto addr_mode(CPU &cpu) -> AddrResult {
             read_tar(cpu);
             return {AddrResultType::in_progress};
             break;
-        case 4: {
-            Address high_addr;
-            bool page_crossed = (cpu.temporary_address_register & 0x00FF) == 0x00FF;
-            if (page_crossed && cpu.config.preserve_indirect_jump_page_cross_bug) {
-                high_addr = cpu.temporary_address_register & 0xFF00;
+        case 4:
+            if constexpr (is_nmos(V)) {
+                // NMOS hardware bug: the pointer's high byte is read without carrying into the
+                // high address byte, JMP ($xxFF) takes it from $xx00 of the same page
+                const auto high_addr = static_cast<Address>((cpu.temporary_address_register & 0xFF00) |
+                                                            ((cpu.temporary_address_register + 1) & 0x00FF));
+                Address high_ = static_cast<Address>(read(cpu, high_addr) << 8);
+                Address addr = high_ | static_cast<Address>(cpu.tmp);
+                return {AddrResultType::complete_address, .addr = addr};
             } else {
-                high_addr = cpu.temporary_address_register + 1;
+                // The 65C02 fixed it with an extra cycle re-reading the pointer's high operand byte
+                cpu.data_bus = bus_read(cpu, static_cast<Address>(cpu.PC - 1));
+                return {AddrResultType::in_progress};
             }
-            Address high_ = static_cast<Address>(read(cpu, high_addr) << 8);
-            Address addr = high_ | static_cast<Address>(cpu.tmp);
-            return {AddrResultType::complete_address, .addr = addr};
             break;
-        }
+        case 5:
+            if constexpr (!is_nmos(V)) {
+                Address high_ = static_cast<Address>(read(cpu, static_cast<Address>(cpu.temporary_address_register + 1)) << 8);
+                Address addr = high_ | static_cast<Address>(cpu.tmp);
+                return {AddrResultType::complete_address, .addr = addr};
+            }
+            assert(false);
+            break;
         default:
             assert(false);
         }
@@ -660,12 +1699,37 @@ inline auto addr_mode(CPU &cpu) -> AddrResult {
         assert(false);
     }
 }
+// Read, modify and write back: the operand is read into cpu.tmp, the next cycle writes it back
+// unchanged on NMOS parts (the 65C02 reads it again instead) while the ALU works, and the last
+// cycle hands the address to exec_func, which computes from cpu.tmp and writes the result.
+// step counts the cycles since TAR got the effective address.
+template <Variant V>
+inline auto rmw_cycle(CPU &cpu, int step) -> AddrResult {
+    switch (step) {
+    case 0:
+        read_tar(cpu);
+        return {AddrResultType::in_progress};
+    case 1:
+        if constexpr (is_nmos(V)) {
+            write(cpu, cpu.temporary_address_register, cpu.tmp); // Dummy Write
+        } else {
+            cpu.data_bus = bus_read(cpu, cpu.temporary_address_register); // Dummy Read
+        }
+        return {AddrResultType::in_progress};
+    case 2:
+        return {AddrResultType::complete_address, .addr = cpu.temporary_address_register};
+    default:
+        assert(false);
+    }
+    return {AddrResultType::in_progress};
+}
+
+template <Variant V>
 inline auto addr_mode_rmw(CPU &cpu) -> AddrResult {
     switch (cpu.instr.mode) {
     case AddressingMode::absolute:
         switch (cpu.instr_counter) {
         case 1:
-            cpu.addr = cpu.PC;
             fetch_to_tmp(cpu);
             return {AddrResultType::in_progress};
             break;
@@ -673,36 +1737,99 @@ inline auto addr_mode_rmw(CPU &cpu) -> AddrResult {
             fetch_to_tar(cpu);
             return {AddrResultType::in_progress};
             break;
-        case 3:
-            read_tar(cpu);
-            return {AddrResultType::in_progress};
-            break;
-        case 4:
-            write(cpu, cpu.addr, cpu.tmp); // Dummy Write
-            return {AddrResultType::in_progress};
-            break;
-        case 5:
-            return {AddrResultType::complete_address, .addr = cpu.addr};
-            break;
         default:
-            assert(false);
+            return rmw_cycle<V>(cpu, cpu.instr_counter - 3);
         }
         break;
     case AddressingMode::zero_page:
-        assert(false);
-        break;
+        if (cpu.instr_counter == 1) {
+            cpu.temporary_address_register = fetch(cpu);
+            return {AddrResultType::in_progress};
+        }
+        return rmw_cycle<V>(cpu, cpu.instr_counter - 2);
     case AddressingMode::zero_page_x:
-        assert(false);
+        switch (cpu.instr_counter) {
+        case 1:
+            cpu.temporary_address_register = fetch(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            index_zero_page(cpu);
+            return {AddrResultType::in_progress};
+        default:
+            return rmw_cycle<V>(cpu, cpu.instr_counter - 3);
+        }
         break;
     case AddressingMode::absolute_x:
-        assert(false);
+    case AddressingMode::absolute_y:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            fetch_to_tar(cpu);
+            cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + index_register(cpu));
+            return {AddrResultType::in_progress};
+        case 3:
+            if constexpr (!is_nmos(V)) {
+                // 65C02 shifts and rotates only take the fix-up cycle when a page is crossed
+                const bool shift = cpu.instr.type != InstructionType::inc && cpu.instr.type != InstructionType::dec;
+                if (shift && !page_crossed(cpu, index_register(cpu))) {
+                    ++cpu.instr_counter;
+                    return rmw_cycle<V>(cpu, 0);
+                }
+            }
+            dummy_read_unfixed<V>(cpu);
+            return {AddrResultType::in_progress};
+        default:
+            return rmw_cycle<V>(cpu, cpu.instr_counter - 4);
+        }
         break;
-    case AddressingMode::accum:
-        assert(false);
+    case AddressingMode::indirect_x:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            cpu.data_bus = bus_read(cpu, cpu.tmp); // Dummy read of the pointer while X is added
+            cpu.tmp = static_cast<Byte>(cpu.tmp + cpu.X);
+            return {AddrResultType::in_progress};
+        case 3:
+            read_pointer_low(cpu);
+            return {AddrResultType::in_progress};
+        case 4:
+            read_pointer_high(cpu);
+            return {AddrResultType::in_progress};
+        default:
+            return rmw_cycle<V>(cpu, cpu.instr_counter - 5);
+        }
         break;
+    case AddressingMode::indirect_y:
+        switch (cpu.instr_counter) {
+        case 1:
+            fetch_to_tmp(cpu);
+            return {AddrResultType::in_progress};
+        case 2:
+            read_pointer_low(cpu);
+            return {AddrResultType::in_progress};
+        case 3:
+            read_pointer_high(cpu);
+            cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + cpu.Y);
+            return {AddrResultType::in_progress};
+        case 4:
+            dummy_read_unfixed<V>(cpu);
+            return {AddrResultType::in_progress};
+        default:
+            return rmw_cycle<V>(cpu, cpu.instr_counter - 5);
+        }
+        break;
+    case AddressingMode::accum:
+        assert(cpu.instr_counter == 1);
+        cpu.data_bus = bus_read(cpu, cpu.PC); // Dummy read of the next byte
+        return {AddrResultType::complete};
     default:
         assert(false);
     }
+    return {AddrResultType::in_progress};
 }
 
 inline auto finished_instruction(CPU &cpu) -> void {
@@ -722,6 +1849,7 @@ inline auto handle_branching_instruction(CPU &cpu) -> void {
         ++cpu.instr_counter;
         break;
     case 2: {
+        cpu.data_bus = bus_read(cpu, cpu.PC); // Dummy read of the next opcode while adding the offset
         cpu.temporary_address_register = static_cast<Address>(cpu.PC + static_cast<int8_t>(cpu.tmp));
         bool same_page = (cpu.temporary_address_register & 0xFF00) == (cpu.PC & 0xFF00);
         if (same_page) {
@@ -733,7 +1861,8 @@ inline auto handle_branching_instruction(CPU &cpu) -> void {
         }
         break;
     }
-    case 3:
+    case 3: // Dummy read with the low byte already moved but the carry not yet in the high byte
+        cpu.data_bus = bus_read(cpu, static_cast<Address>((cpu.PC & 0xFF00) | (cpu.temporary_address_register & 0x00FF)));
         cpu.PC = cpu.temporary_address_register;
         finished_instruction(cpu);
         break;
@@ -743,16 +1872,269 @@ inline auto handle_branching_instruction(CPU &cpu) -> void {
     }
 }
 
+inline auto push(CPU &cpu, Byte value) -> void {
+    write(cpu, static_cast<Address>(stack_base | cpu.SP), value);
+    --cpu.SP;
+}
+
+[[nodiscard]] inline auto pull(CPU &cpu) -> Byte {
+    ++cpu.SP;
+    return read(cpu, static_cast<Address>(stack_base | cpu.SP));
+}
+
+// Shared 7 cycle sequence of BRK, IRQ and NMI, cycle 1 was the (possibly discarded) opcode fetch
+template <Variant V>
+inline auto handle_interrupt_sequence(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        if (cpu.interrupt == InterruptKind::brk) {
+            fetch_to_tmp(cpu); // Padding byte, skipped over by the return address
+        } else {
+            cpu.tmp = read(cpu, cpu.PC); // Dummy read, PC stays on the interrupted instruction
+        }
+        break;
+    case 2:
+        push(cpu, static_cast<Byte>(cpu.PC >> 8));
+        break;
+    case 3:
+        push(cpu, static_cast<Byte>(cpu.PC & 0xFF));
+        break;
+    case 4: {
+        const Byte b_flag = (cpu.interrupt == InterruptKind::brk) ? B_FLAG : 0x00;
+        push(cpu, static_cast<Byte>(cpu.P | U_FLAG | b_flag));
+        set_flag_I(cpu, true);
+        if constexpr (!is_nmos(V)) set_flag_D(cpu, false); // The NMOS part leaves decimal mode on in handlers
+        cpu.temporary_address_register = (cpu.interrupt == InterruptKind::nmi) ? nmi_vector : irq_vector;
+        break;
+    }
+    case 5:
+        read_tar(cpu);
+        break;
+    case 6:
+        cpu.PC = static_cast<Address>(read(cpu, static_cast<Address>(cpu.temporary_address_register + 1)) << 8) | cpu.tmp;
+        if (cpu.call_observer != nullptr) {
+            const CallKind kind = cpu.interrupt == InterruptKind::nmi   ? CallKind::nmi
+                                  : cpu.interrupt == InterruptKind::irq ? CallKind::irq
+                                                                        : CallKind::brk;
+            cpu.call_observer->on_call(cpu, kind, cpu.PC, static_cast<Byte>(cpu.SP + 3));
+        }
+        cpu.interrupt = InterruptKind::none;
+        finished_instruction(cpu);
+        return;
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+inline auto handle_rti(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        cpu.tmp = read(cpu, cpu.PC); // Dummy read of the next byte
+        break;
+    case 2:
+        cpu.tmp = read(cpu, static_cast<Address>(stack_base | cpu.SP)); // Dummy stack read
+        break;
+    case 3:
+        cpu.P = static_cast<Byte>((pull(cpu) & ~B_FLAG) | U_FLAG);
+        break;
+    case 4:
+        cpu.tmp = pull(cpu);
+        break;
+    case 5:
+        cpu.PC = static_cast<Address>(pull(cpu) << 8) | cpu.tmp;
+        if (cpu.call_observer != nullptr) cpu.call_observer->on_return(cpu);
+        finished_instruction(cpu);
+        return;
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+// 3 cycles: dummy read of the next byte, push
+inline auto handle_push(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        cpu.data_bus = bus_read(cpu, cpu.PC);
+        break;
+    case 2:
+        switch (cpu.instr.type) {
+        case InstructionType::pha:
+            push(cpu, cpu.A);
+            break;
+        case InstructionType::php:
+            push(cpu, static_cast<Byte>(cpu.P | U_FLAG | B_FLAG));
+            break;
+        case InstructionType::phx:
+            push(cpu, cpu.X);
+            break;
+        case InstructionType::phy:
+            push(cpu, cpu.Y);
+            break;
+        default:
+            assert(false);
+        }
+        finished_instruction(cpu);
+        return;
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+// 4 cycles: dummy read of the next byte, dummy stack read while incrementing SP, pull
+inline auto handle_pull(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        cpu.data_bus = bus_read(cpu, cpu.PC);
+        break;
+    case 2:
+        cpu.data_bus = bus_read(cpu, static_cast<Address>(stack_base | cpu.SP));
+        break;
+    case 3: {
+        const Byte value = pull(cpu);
+        switch (cpu.instr.type) {
+        case InstructionType::pla:
+            cpu.A = value;
+            set_flags_ZN(cpu, value);
+            break;
+        case InstructionType::plp:
+            cpu.P = static_cast<Byte>((value & ~B_FLAG) | U_FLAG);
+            break;
+        case InstructionType::plx:
+            cpu.X = value;
+            set_flags_ZN(cpu, value);
+            break;
+        case InstructionType::ply:
+            cpu.Y = value;
+            set_flags_ZN(cpu, value);
+            break;
+        default:
+            assert(false);
+        }
+        finished_instruction(cpu);
+        return;
+    }
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+// 6 cycles, the pushed return address points at the last byte of the jsr (the high operand byte)
+inline auto handle_jsr(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        fetch_to_tmp(cpu); // Low byte of the target
+        break;
+    case 2:
+        cpu.data_bus = bus_read(cpu, static_cast<Address>(stack_base | cpu.SP)); // Internal operation, dummy stack read
+        break;
+    case 3:
+        push(cpu, static_cast<Byte>(cpu.PC >> 8));
+        break;
+    case 4:
+        push(cpu, static_cast<Byte>(cpu.PC & 0xFF));
+        break;
+    case 5:
+        cpu.PC = static_cast<Address>(fetch(cpu) << 8) | cpu.tmp;
+        if (cpu.call_observer != nullptr) cpu.call_observer->on_call(cpu, CallKind::jsr, cpu.PC, static_cast<Byte>(cpu.SP + 2));
+        finished_instruction(cpu);
+        return;
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+// 6 cycles, the pulled address is incremented past the jsr's last byte on the final cycle
+inline auto handle_rts(CPU &cpu) -> void {
+    switch (cpu.instr_counter) {
+    case 1:
+        cpu.data_bus = bus_read(cpu, cpu.PC); // Dummy reads stay out of the coverage map
+        break;
+    case 2:
+        cpu.data_bus = bus_read(cpu, static_cast<Address>(stack_base | cpu.SP));
+        break;
+    case 3:
+        cpu.tmp = pull(cpu);
+        break;
+    case 4:
+        cpu.PC = static_cast<Address>(pull(cpu) << 8) | cpu.tmp;
+        break;
+    case 5:
+        cpu.data_bus = bus_read(cpu, cpu.PC++); // Dummy read while incrementing PC
+        if (cpu.call_observer != nullptr) cpu.call_observer->on_return(cpu);
+        finished_instruction(cpu);
+        return;
+    default:
+        assert(false);
+    }
+    cpu.addr_result = {AddrResultType::in_progress};
+    ++cpu.instr_counter;
+}
+
+template <Variant V>
 inline auto tick(CPU &cpu) -> void {
     ++cpu.cycles;
+    if (cpu.nmi && !cpu.nmi_previous) cpu.nmi_pending = true;
+    cpu.nmi_previous = cpu.nmi;
+
     cpu.addr_result.validate();
     if (cpu.addr_result.type == AddrResultType::load_instruction) {
         assert(cpu.instr_counter == 0);
-        // Fetch instruction
-        Byte opcode = fetch(cpu);
-        cpu.instr = instructions[opcode];
+        cpu.instr_addr = cpu.PC;
         cpu.instr_counter = 1;
         cpu.addr_result = {AddrResultType::in_progress};
+
+        // Pending interrupts replace the opcode with a forced BRK, the fetched byte is discarded
+        if (interrupt_pending(cpu)) {
+            cpu.tmp = bus_read(cpu, cpu.PC, true); // Not counted as coverage, the opcode runs after the handler
+            cpu.instr = {InstructionType::brk, AddressingMode::implied};
+            cpu.interrupt = cpu.nmi_pending ? InterruptKind::nmi : InterruptKind::irq;
+            cpu.nmi_pending = false;
+            return;
+        }
+
+        // Fetch instruction
+        mark_coverage(cpu, cpu.PC, COVERAGE_OPCODE);
+        Byte opcode = bus_read(cpu, cpu.PC++, true);
+        cpu.instr = instruction_table_for<V>[opcode];
+        if (cpu.instr.type == InstructionType::brk) cpu.interrupt = InterruptKind::brk;
+        if constexpr (!is_nmos(V)) {
+            if (cpu.instr.mode == AddressingMode::NONE) finished_instruction(cpu); // One cycle NOP
+        }
+        return;
+    }
+
+    if (cpu.instr.type == InstructionType::brk) {
+        handle_interrupt_sequence<V>(cpu);
+        return;
+    }
+    if (cpu.instr.type == InstructionType::rti) {
+        handle_rti(cpu);
+        return;
+    }
+    if (cpu.instr.type == InstructionType::jsr) {
+        handle_jsr(cpu);
+        return;
+    }
+    if (cpu.instr.type == InstructionType::rts) {
+        handle_rts(cpu);
+        return;
+    }
+    if (is_push_instruction(cpu.instr.type)) {
+        handle_push(cpu);
+        return;
+    }
+    if (is_pull_instruction(cpu.instr.type)) {
+        handle_pull(cpu);
         return;
     }
 
@@ -762,17 +2144,23 @@ inline auto tick(CPU &cpu) -> void {
     }
 
     if (is_rmw_instruction(cpu.instr.type)) {
-        cpu.addr_result = addr_mode_rmw(cpu);
+        cpu.addr_result = addr_mode_rmw<V>(cpu);
     } else {
-        cpu.addr_result = addr_mode(cpu);
+        cpu.addr_result = addr_mode<V>(cpu);
     }
     cpu.addr_result.validate();
     ++cpu.instr_counter;
 
     if (cpu.addr_result.is_complete()) {
-        exec_func(cpu, cpu.addr_result.value, cpu.addr_result.addr);
+        exec_func<V>(cpu, cpu.addr_result.value, cpu.addr_result.addr);
         finished_instruction(cpu);
         return;
     }
 }
+
+// Steps the variant the CPU was configured as, callers stepping many cycles at once should
+// hoist the dispatch with with_variant and call tick<V> directly
+inline auto tick(CPU &cpu) -> void {
+    with_variant(cpu.variant, [&cpu](auto v) { tick<decltype(v)::value>(cpu); });
+}
 } // namespace mos6502
@@ -0,0 +1,575 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iostream>
+#include <print>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "6502.hpp"
+
+/*
+ * Two pass 6502 assembler that runs entirely under constant evaluation:
+ *
+ *     constexpr auto rom = mos6502::assemble<R"(
+ *             .org $0200
+ *     start:  ldx #count
+ *     loop:   dex
+ *             bne loop
+ *             jmp start
+ *     count = 8
+ *     )">();
+ *     mos6502::load_image(cpu, rom);
+ *
+ * Syntax
+ *   label:            defines label as the current address
+ *   name = expr       defines a constant
+ *   .org expr         moves the current address (forwards only), gaps are zero filled
+ *   .byte a, "txt"    emits bytes / string characters
+ *   .word a, b        emits little endian words
+ *   ; comment
+ *
+ * Operands: implied / A, #imm, zp, zp,X, zp,Y, abs, abs,X, abs,Y, (abs), (zp,X), (zp),Y, branch target.
+ * Expressions: $hex, %bin, decimal, 'c', labels, * (current address), unary - < >,
+ * binary * / + - & | with the usual precedence and [ ] for grouping since ( ) means indirection.
+ *
+ * Zero page forms are picked when the operand fits into a byte and only depends on
+ * symbols defined on earlier lines, that keeps instruction sizes identical across both passes.
+ * Errors call assembly_error which is not constexpr, so under consteval they become compile errors
+ * pointing at the offending message and source line.
+ */
+
+namespace mos6502 {
+inline auto assembly_error(const char *message, int line) -> void {
+    std::println(std::cerr, "6502 assembler error on line {}: {}", line, message);
+    assert(false);
+}
+
+template <size_t N>
+struct AsmSource {
+    std::array<char, N> data{};
+
+    consteval AsmSource(const char (&source)[N]) {
+        std::copy_n(source, N, data.begin());
+    }
+
+    [[nodiscard]] constexpr auto view() const -> std::string_view {
+        return {data.data(), N - 1};
+    }
+};
+
+template <size_t N>
+struct RomImage {
+    Address origin = 0x0000;
+    std::array<Byte, N> bytes = {};
+};
+
+template <size_t N>
+inline auto load_image(CPU &cpu, const RomImage<N> &image) -> void {
+    load_bytes(cpu, image.origin, std::span<const Byte>(image.bytes));
+}
+
+namespace assembler_detail {
+struct Symbol {
+    std::string_view name;
+    int value = 0;
+    bool early = false; // Value is already final when the defining line is reached in pass one
+    int line = 0;
+};
+
+struct Value {
+    int value = 0;
+    bool known = true;
+    bool early = true;
+};
+
+struct Output {
+    Address origin = 0x0000;
+    std::vector<Byte> bytes;
+};
+
+[[nodiscard]] constexpr auto to_lower(char c) -> char {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+[[nodiscard]] constexpr auto iequals(std::string_view a, std::string_view b) -> bool {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (to_lower(a[i]) != to_lower(b[i])) return false;
+    }
+    return true;
+}
+
+[[nodiscard]] constexpr auto is_space(char c) -> bool { return c == ' ' || c == '\t' || c == '\r'; }
+[[nodiscard]] constexpr auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+[[nodiscard]] constexpr auto is_ident_start(char c) -> bool {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+}
+[[nodiscard]] constexpr auto is_ident(char c) -> bool { return is_ident_start(c) || is_digit(c); }
+
+[[nodiscard]] constexpr auto trim(std::string_view s) -> std::string_view {
+    while (!s.empty() && is_space(s.front())) s.remove_prefix(1);
+    while (!s.empty() && is_space(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+[[nodiscard]] constexpr auto ends_with_register(std::string_view s, std::string_view suffix) -> bool {
+    return s.size() >= suffix.size() && iequals(s.substr(s.size() - suffix.size()), suffix);
+}
+
+// Cuts a line at its comment, ignoring semicolons inside quotes
+[[nodiscard]] constexpr auto strip_comment(std::string_view line) -> std::string_view {
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (quote != 0) {
+            if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == ';') {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+// Splits on commas outside of quotes and brackets
+[[nodiscard]] constexpr auto split_list(std::string_view s) -> std::vector<std::string_view> {
+    std::vector<std::string_view> items;
+    char quote = 0;
+    int depth = 0;
+    size_t begin = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        const char c = s[i];
+        if (quote != 0) {
+            if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '[') {
+            ++depth;
+        } else if (c == ']') {
+            --depth;
+        } else if (c == ',' && depth == 0) {
+            items.push_back(trim(s.substr(begin, i - begin)));
+            begin = i + 1;
+        }
+    }
+    items.push_back(trim(s.substr(begin)));
+    return items;
+}
+
+[[nodiscard]] constexpr auto mnemonic_matches(InstructionType type, std::string_view name) -> bool {
+    std::string_view full = to_string(type);
+    if (full.ends_with('_')) full.remove_suffix(1); // and_
+    return iequals(full, name);
+}
+
+[[nodiscard]] constexpr auto find_opcode(std::string_view name, AddressingMode mode) -> int {
+    for (size_t opcode = 0; opcode < instruction_table.size(); ++opcode) {
+        const Instruction &instr = instruction_table[opcode];
+        if (instr.type != InstructionType::NONE && instr.mode == mode && mnemonic_matches(instr.type, name)) {
+            return static_cast<int>(opcode);
+        }
+    }
+    return -1;
+}
+
+[[nodiscard]] constexpr auto is_mnemonic(std::string_view name) -> bool {
+    for (const Instruction &instr : instruction_table) {
+        if (instr.type != InstructionType::NONE && mnemonic_matches(instr.type, name)) return true;
+    }
+    return false;
+}
+
+class Assembler {
+public:
+    constexpr explicit Assembler(std::string_view source_)
+        : source(source_) {}
+
+    [[nodiscard]] constexpr auto run() -> Output {
+        pass = 1;
+        run_pass();
+
+        // Constants may be defined in terms of later labels, repeat the second pass
+        // silently until every symbol value settled, the final repetition reports errors
+        pass = 2;
+        resolving = true;
+        for (int i = 0; i < 16 && changed; ++i) {
+            changed = false;
+            run_pass();
+        }
+        resolving = false;
+        run_pass();
+        return out;
+    }
+
+private:
+    std::string_view source;
+    std::vector<Symbol> symbols;
+    Output out;
+    int pass = 1;
+    bool resolving = false;
+    bool changed = true;
+    int line_no = 0;
+    int pc = 0;
+    bool emitted_any = false;
+
+    constexpr auto run_pass() -> void {
+        out = {};
+        pc = 0;
+        emitted_any = false;
+        line_no = 0;
+        std::string_view rest = source;
+        while (!rest.empty()) {
+            const size_t eol = rest.find('\n');
+            const std::string_view line = rest.substr(0, eol);
+            rest = (eol == std::string_view::npos) ? std::string_view{} : rest.substr(eol + 1);
+            ++line_no;
+            assemble_line(line);
+        }
+    }
+
+    // Range checks and undefined symbols are only reported once values are final
+    [[nodiscard]] constexpr auto checking() const -> bool { return pass == 2 && !resolving; }
+
+    // Guarded so the function stays usable in constant expressions until an error is actually hit
+    constexpr auto error(const char *message) const -> void {
+        if (message != nullptr) assembly_error(message, line_no);
+    }
+
+    constexpr auto emit(int value) -> void {
+        if (pc > 0xFFFF) error("program runs past $FFFF");
+        if (pass == 2) {
+            if (!emitted_any) out.origin = static_cast<Address>(pc);
+            const auto offset = static_cast<size_t>(pc - out.origin);
+            if (out.bytes.size() <= offset) out.bytes.resize(offset + 1, 0x00);
+            out.bytes[offset] = static_cast<Byte>(value & 0xFF);
+        }
+        emitted_any = true;
+        ++pc;
+    }
+
+    constexpr auto emit_word(int value) -> void {
+        emit(value & 0xFF);
+        emit((value >> 8) & 0xFF);
+    }
+
+    constexpr auto find_symbol(std::string_view name) -> Symbol * {
+        for (auto &symbol : symbols) {
+            if (iequals(symbol.name, name)) return &symbol;
+        }
+        return nullptr;
+    }
+
+    constexpr auto define(std::string_view name, Value value) -> void {
+        if (iequals(name, "a") || iequals(name, "x") || iequals(name, "y") || is_mnemonic(name)) {
+            error("reserved symbol name");
+        }
+        Symbol *symbol = find_symbol(name);
+        if (pass == 1) {
+            if (symbol != nullptr) error("duplicate symbol");
+            symbols.push_back({.name = name, .value = value.value, .early = value.known && value.early, .line = line_no});
+        } else {
+            assert(symbol != nullptr);
+            if (symbol->value != value.value) changed = true;
+            symbol->value = value.value;
+        }
+    }
+
+    /* ------------------------------------------------------------ expressions */
+    struct Cursor {
+        std::string_view s;
+        size_t i = 0;
+
+        constexpr auto skip_space() -> void {
+            while (i < s.size() && is_space(s[i])) ++i;
+        }
+        [[nodiscard]] constexpr auto peek() -> char {
+            skip_space();
+            return i < s.size() ? s[i] : '\0';
+        }
+        [[nodiscard]] constexpr auto at_end() -> bool { return peek() == '\0'; }
+    };
+
+    [[nodiscard]] static constexpr auto combine(Value a, Value b, int result) -> Value {
+        return {.value = result, .known = a.known && b.known, .early = a.early && b.early};
+    }
+
+    [[nodiscard]] constexpr auto parse_number(Cursor &c, int base) -> int {
+        int value = 0;
+        int digits = 0;
+        while (c.i < c.s.size()) {
+            const char ch = to_lower(c.s[c.i]);
+            int digit;
+            if (is_digit(ch)) {
+                digit = ch - '0';
+            } else if (ch >= 'a' && ch <= 'f') {
+                digit = ch - 'a' + 10;
+            } else {
+                break;
+            }
+            if (digit >= base) break;
+            value = value * base + digit;
+            if (value > 0xFFFFFF) error("numeric literal too large");
+            ++digits;
+            ++c.i;
+        }
+        if (digits == 0) error("malformed numeric literal");
+        return value;
+    }
+
+    [[nodiscard]] constexpr auto parse_primary(Cursor &c) -> Value {
+        const char ch = c.peek();
+        if (ch == '\0') error("expected expression");
+        if (ch == '[') {
+            ++c.i;
+            Value v = parse_or(c);
+            if (c.peek() != ']') error("missing ]");
+            ++c.i;
+            return v;
+        }
+        if (ch == '-' || ch == '<' || ch == '>') {
+            ++c.i;
+            Value v = parse_primary(c);
+            if (ch == '-') v.value = -v.value;
+            if (ch == '<') v.value &= 0xFF;
+            if (ch == '>') v.value = (v.value >> 8) & 0xFF;
+            return v;
+        }
+        if (ch == '*') {
+            ++c.i;
+            return {.value = pc};
+        }
+        if (ch == '$') {
+            ++c.i;
+            return {.value = parse_number(c, 16)};
+        }
+        if (ch == '%') {
+            ++c.i;
+            return {.value = parse_number(c, 2)};
+        }
+        if (is_digit(ch)) return {.value = parse_number(c, 10)};
+        if (ch == '\'') {
+            if (c.i + 2 >= c.s.size() || c.s[c.i + 2] != '\'') error("malformed character literal");
+            const int value = static_cast<unsigned char>(c.s[c.i + 1]);
+            c.i += 3;
+            return {.value = value};
+        }
+        if (is_ident_start(ch)) {
+            const size_t begin = c.i;
+            while (c.i < c.s.size() && is_ident(c.s[c.i])) ++c.i;
+            const std::string_view name = c.s.substr(begin, c.i - begin);
+            const Symbol *symbol = find_symbol(name);
+            if (symbol == nullptr) {
+                if (checking()) error("undefined symbol");
+                return {.value = 0, .known = false, .early = false};
+            }
+            return {.value = symbol->value, .known = true, .early = symbol->early && symbol->line < line_no};
+        }
+        error("unexpected character in expression");
+        return {};
+    }
+
+    [[nodiscard]] constexpr auto parse_mul(Cursor &c) -> Value {
+        Value lhs = parse_primary(c);
+        while (c.peek() == '*' || c.peek() == '/') {
+            const char op = c.s[c.i++];
+            const Value rhs = parse_primary(c);
+            if (op == '/' && rhs.known && rhs.value == 0) error("division by zero");
+            const int result = (op == '*') ? lhs.value * rhs.value : (rhs.value == 0 ? 0 : lhs.value / rhs.value);
+            lhs = combine(lhs, rhs, result);
+        }
+        return lhs;
+    }
+
+    [[nodiscard]] constexpr auto parse_add(Cursor &c) -> Value {
+        Value lhs = parse_mul(c);
+        while (c.peek() == '+' || c.peek() == '-') {
+            const char op = c.s[c.i++];
+            const Value rhs = parse_mul(c);
+            lhs = combine(lhs, rhs, op == '+' ? lhs.value + rhs.value : lhs.value - rhs.value);
+        }
+        return lhs;
+    }
+
+    [[nodiscard]] constexpr auto parse_or(Cursor &c) -> Value {
+        Value lhs = parse_add(c);
+        while (c.peek() == '&' || c.peek() == '|') {
+            const char op = c.s[c.i++];
+            const Value rhs = parse_add(c);
+            lhs = combine(lhs, rhs, op == '&' ? (lhs.value & rhs.value) : (lhs.value | rhs.value));
+        }
+        return lhs;
+    }
+
+    [[nodiscard]] constexpr auto expression(std::string_view s) -> Value {
+        Cursor c{.s = s};
+        Value v = parse_or(c);
+        if (!c.at_end()) error("trailing characters after expression");
+        return v;
+    }
+
+    /* ------------------------------------------------------------ statements */
+    constexpr auto assemble_line(std::string_view line) -> void {
+        line = trim(strip_comment(line));
+        if (line.empty()) return;
+
+        // Leading label, possibly followed by a statement on the same line
+        size_t ident_end = 0;
+        while (ident_end < line.size() && is_ident(line[ident_end])) ++ident_end;
+        if (ident_end > 0 && is_ident_start(line[0]) && line[0] != '.') {
+            const std::string_view name = line.substr(0, ident_end);
+            const std::string_view after = trim(line.substr(ident_end));
+            if (after.starts_with(':')) {
+                define(name, {.value = pc});
+                line = trim(after.substr(1));
+                if (line.empty()) return;
+            } else if (after.starts_with('=')) {
+                define(name, expression(after.substr(1)));
+                return;
+            }
+        }
+
+        size_t word_end = 0;
+        while (word_end < line.size() && !is_space(line[word_end])) ++word_end;
+        const std::string_view word = line.substr(0, word_end);
+        const std::string_view operand = trim(line.substr(word_end));
+
+        if (word.starts_with('.')) {
+            directive(word, operand);
+        } else {
+            instruction(word, operand);
+        }
+    }
+
+    constexpr auto directive(std::string_view name, std::string_view operand) -> void {
+        if (iequals(name, ".org")) {
+            const Value v = expression(operand);
+            if (!v.known || !v.early) error(".org needs a value known at that point");
+            if (v.value < pc && emitted_any) error(".org can not move backwards");
+            if (v.value < 0 || v.value > 0xFFFF) error(".org out of range");
+            if (emitted_any) {
+                while (pc < v.value) emit(0x00);
+            } else {
+                pc = v.value;
+            }
+        } else if (iequals(name, ".byte")) {
+            for (std::string_view item : split_list(operand)) {
+                if (item.size() >= 2 && item.front() == '"' && item.back() == '"') {
+                    for (char ch : item.substr(1, item.size() - 2)) {
+                        emit(static_cast<unsigned char>(ch));
+                    }
+                    continue;
+                }
+                const Value v = expression(item);
+                if (checking() && (v.value < -128 || v.value > 0xFF)) error(".byte value out of range");
+                emit(v.value);
+            }
+        } else if (iequals(name, ".word")) {
+            for (std::string_view item : split_list(operand)) {
+                const Value v = expression(item);
+                if (checking() && (v.value < 0 || v.value > 0xFFFF)) error(".word value out of range");
+                emit_word(v.value);
+            }
+        } else {
+            error("unknown directive");
+        }
+    }
+
+    constexpr auto instruction(std::string_view name, std::string_view operand) -> void {
+        if (!is_mnemonic(name)) error("unknown mnemonic");
+
+        auto emit_mode = [&](AddressingMode mode, Value v) {
+            const int opcode = find_opcode(name, mode);
+            if (opcode < 0) error("addressing mode not supported by this instruction");
+            emit(opcode);
+            switch (instruction_length(mode)) {
+            case 2:
+                if (checking() && (v.value < -128 || v.value > 0xFF)) error("operand does not fit into a byte");
+                emit(v.value);
+                break;
+            case 3:
+                if (checking() && (v.value < 0 || v.value > 0xFFFF)) error("operand does not fit into a word");
+                emit_word(v.value);
+                break;
+            default:
+                break;
+            }
+        };
+        // Picks the zero page variant when it exists and the operand provably fits
+        auto emit_sized = [&](AddressingMode zp_mode, AddressingMode abs_mode, Value v) {
+            const bool fits = v.known && v.early && v.value >= 0 && v.value <= 0xFF;
+            if (fits && find_opcode(name, zp_mode) >= 0) {
+                emit_mode(zp_mode, v);
+            } else {
+                emit_mode(abs_mode, v);
+            }
+        };
+
+        if (operand.empty() || iequals(operand, "a")) {
+            const bool has_accum = find_opcode(name, AddressingMode::accum) >= 0;
+            if (!operand.empty() && !has_accum) error("instruction has no accumulator form");
+            emit_mode(has_accum ? AddressingMode::accum : AddressingMode::implied, {});
+            return;
+        }
+        if (operand.starts_with('#')) {
+            emit_mode(AddressingMode::immediate, expression(operand.substr(1)));
+            return;
+        }
+        if (operand.starts_with('(')) {
+            if (ends_with_register(operand, ",x)")) {
+                emit_mode(AddressingMode::indirect_x, expression(operand.substr(1, operand.size() - 4)));
+            } else if (ends_with_register(operand, "),y")) {
+                emit_mode(AddressingMode::indirect_y, expression(operand.substr(1, operand.size() - 4)));
+            } else if (operand.ends_with(')')) {
+                emit_mode(AddressingMode::indirect, expression(operand.substr(1, operand.size() - 2)));
+            } else {
+                error("malformed indirect operand");
+            }
+            return;
+        }
+        if (ends_with_register(operand, ",x")) {
+            emit_sized(AddressingMode::zero_page_x, AddressingMode::absolute_x,
+                expression(operand.substr(0, operand.size() - 2)));
+            return;
+        }
+        if (ends_with_register(operand, ",y")) {
+            emit_sized(AddressingMode::zero_page_y, AddressingMode::absolute_y,
+                expression(operand.substr(0, operand.size() - 2)));
+            return;
+        }
+
+        const Value target = expression(operand);
+        const int opcode = find_opcode(name, AddressingMode::relative);
+        if (opcode >= 0) {
+            emit(opcode);
+            const int offset = target.value - (pc + 1);
+            if (checking() && (offset < -128 || offset > 127)) error("branch target out of range");
+            emit(offset & 0xFF);
+            return;
+        }
+        emit_sized(AddressingMode::zero_page, AddressingMode::absolute, target);
+    }
+};
+
+[[nodiscard]] constexpr auto assemble(std::string_view source) -> Output {
+    return Assembler(source).run();
+}
+} // namespace assembler_detail
+
+// Assembles Source at compile time into a ROM image starting at the first emitted address
+template <AsmSource Source>
+[[nodiscard]] consteval auto assemble() {
+    constexpr size_t size = assembler_detail::assemble(Source.view()).bytes.size();
+    const assembler_detail::Output output = assembler_detail::assemble(Source.view());
+
+    RomImage<size> image;
+    image.origin = output.origin;
+    std::copy(output.bytes.begin(), output.bytes.end(), image.bytes.begin());
+    return image;
+}
+} // namespace mos6502
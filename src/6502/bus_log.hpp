@@ -0,0 +1,25 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+// One cycle per line, "cycle address data R|W [SYNC]", oldest first, the same columns a logic
+// analyser capture of the pins gives. Only the newest entries.size() cycles survive in the ring,
+// a leading comment says how many were dropped.
+inline auto write_bus_log(const std::string &path, const BusLog &log) -> bool {
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) return false;
+    const uint64_t kept = std::min<uint64_t>(log.total, log.entries.size());
+    if (log.total > kept) std::fprintf(file, "# %" PRIu64 " earlier cycles dropped\n", log.total - kept);
+    for (uint64_t i = log.total - kept; i < log.total; ++i) {
+        const BusCycle &c = log.entries[i % log.entries.size()];
+        std::fprintf(file, "%" PRIu64 " %04X %02X %c%s\n", c.cycle, c.addr, c.data, c.read ? 'R' : 'W', c.sync ? " SYNC" : "");
+    }
+    return std::fclose(file) == 0;
+}
+} // namespace mos6502
@@ -0,0 +1,86 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+// One flag nibble per address widened to a byte, 64 KiB in address order. Fixed layout without
+// header so two runs compare with cmp and several runs merge by OR'ing the files.
+inline auto write_coverage_binary(const std::string &path, const CoverageMap &coverage) -> bool {
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    std::array<Byte, 64 * 1024> flags;
+    for (size_t addr = 0; addr < flags.size(); ++addr) flags[addr] = coverage.get(static_cast<Address>(addr));
+    const bool ok = std::fwrite(flags.data(), 1, flags.size(), file) == flags.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Merges into coverage so the union of several test runs can be inspected
+inline auto read_coverage_binary(const std::string &path, CoverageMap &coverage) -> bool {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) return false;
+    std::array<Byte, 64 * 1024> flags;
+    const bool ok = std::fread(flags.data(), 1, flags.size(), file) == flags.size();
+    std::fclose(file);
+    if (!ok) return false;
+    for (size_t addr = 0; addr < flags.size(); ++addr) coverage.mark(static_cast<Address>(addr), flags[addr] & 0x0F);
+    return true;
+}
+
+// Ranges of addresses whose flags satisfy pred as "$XXXX-$XXXX" strings
+template <typename Pred>
+[[nodiscard]] auto coverage_ranges(const CoverageMap &coverage, Pred &&pred) -> json {
+    json ranges = json::array();
+    std::optional<size_t> first;
+    for (size_t addr = 0; addr <= 0x10000; ++addr) {
+        const bool in = addr < 0x10000 && pred(coverage.get(static_cast<Address>(addr)));
+        if (in && !first) first = addr;
+        if (!in && first) {
+            char range[16];
+            std::snprintf(range, sizeof(range), "$%04zX-$%04zX", *first, addr - 1);
+            ranges.push_back(range);
+            first.reset();
+        }
+    }
+    return ranges;
+}
+
+// Address ranges per kind of use, one range per line, so the JSON diffs well between runs.
+// "code" is anything executed, "data" anything only read or written, "unused" never touched:
+// code or data inside a ROM's unused ranges is dead for the exercised inputs.
+inline auto write_coverage_json(const std::string &path, const CoverageMap &coverage) -> bool {
+    constexpr Byte code = COVERAGE_OPCODE | COVERAGE_OPERAND;
+    size_t opcodes = 0, operands = 0, data = 0;
+    for (size_t addr = 0; addr < 0x10000; ++addr) {
+        const Byte flags = coverage.get(static_cast<Address>(addr));
+        opcodes += (flags & COVERAGE_OPCODE) != 0;
+        operands += (flags & COVERAGE_OPERAND) != 0;
+        data += flags != 0 && (flags & code) == 0;
+    }
+    const json out = {
+        {"summary", {{"opcode_bytes", opcodes}, {"operand_bytes", operands}, {"data_bytes", data}}},
+        {"opcode", coverage_ranges(coverage, [](Byte f) { return (f & COVERAGE_OPCODE) != 0; })},
+        {"operand", coverage_ranges(coverage, [](Byte f) { return (f & COVERAGE_OPERAND) != 0; })},
+        {"read", coverage_ranges(coverage, [](Byte f) { return (f & COVERAGE_READ) != 0; })},
+        {"write", coverage_ranges(coverage, [](Byte f) { return (f & COVERAGE_WRITE) != 0; })},
+        {"code", coverage_ranges(coverage, [](Byte f) { return (f & code) != 0; })},
+        {"data", coverage_ranges(coverage, [](Byte f) { return f != 0 && (f & code) == 0; })},
+        {"unused", coverage_ranges(coverage, [](Byte f) { return f == 0; })},
+    };
+    std::ofstream file(path);
+    if (!file) return false;
+    file << out.dump(2) << '\n';
+    return static_cast<bool>(file);
+}
+
+// .json gets the range report, anything else the raw flag dump
+inline auto write_coverage(const std::string &path, const CoverageMap &coverage) -> bool {
+    return std::string_view(path).ends_with(".json") ? write_coverage_json(path, coverage) : write_coverage_binary(path, coverage);
+}
+} // namespace mos6502
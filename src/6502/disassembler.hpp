@@ -0,0 +1,233 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+struct DisassembledLine {
+    Address addr = 0x0000;
+    Byte length = 1;
+    std::array<Byte, 3> bytes = {};
+    std::string text;
+};
+
+[[nodiscard]] inline auto mnemonic(InstructionType type) -> std::string {
+    std::string name = to_string(type);
+    if (!name.empty() && name.back() == '_') name.pop_back(); // and_
+    for (auto &c : name) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return name;
+}
+
+// Decodes the instruction starting at addr, operand bytes wrap around at $FFFF like the PC does
+[[nodiscard]] inline auto disassemble(const CPU &cpu, Address addr) -> DisassembledLine {
+    DisassembledLine line;
+    line.addr = addr;
+
+    const Byte opcode = peek(cpu, addr);
+    const Instruction instr = decode(cpu.variant, opcode);
+    line.length = instruction_length(instr.mode);
+    for (Byte i = 0; i < line.length; ++i) {
+        line.bytes[i] = peek(cpu, static_cast<Address>(addr + i));
+    }
+
+    char buffer[32];
+    if (instr.type == InstructionType::NONE) {
+        std::snprintf(buffer, sizeof(buffer), ".byte $%02X", opcode);
+        line.text = buffer;
+        return line;
+    }
+
+    const std::string name = mnemonic(instr.type);
+    const unsigned lo = line.bytes[1];
+    const unsigned word = static_cast<unsigned>(line.bytes[2] << 8) | lo;
+    switch (instr.mode) {
+    case AddressingMode::NONE:
+    case AddressingMode::implied:
+        std::snprintf(buffer, sizeof(buffer), "%s", name.c_str());
+        break;
+    case AddressingMode::accum:
+        std::snprintf(buffer, sizeof(buffer), "%s A", name.c_str());
+        break;
+    case AddressingMode::immediate:
+        std::snprintf(buffer, sizeof(buffer), "%s #$%02X", name.c_str(), lo);
+        break;
+    case AddressingMode::zero_page:
+        std::snprintf(buffer, sizeof(buffer), "%s $%02X", name.c_str(), lo);
+        break;
+    case AddressingMode::zero_page_x:
+        std::snprintf(buffer, sizeof(buffer), "%s $%02X,X", name.c_str(), lo);
+        break;
+    case AddressingMode::zero_page_y:
+        std::snprintf(buffer, sizeof(buffer), "%s $%02X,Y", name.c_str(), lo);
+        break;
+    case AddressingMode::indirect_x:
+        std::snprintf(buffer, sizeof(buffer), "%s ($%02X,X)", name.c_str(), lo);
+        break;
+    case AddressingMode::indirect_y:
+        std::snprintf(buffer, sizeof(buffer), "%s ($%02X),Y", name.c_str(), lo);
+        break;
+    case AddressingMode::absolute:
+        std::snprintf(buffer, sizeof(buffer), "%s $%04X", name.c_str(), word);
+        break;
+    case AddressingMode::absolute_x:
+        std::snprintf(buffer, sizeof(buffer), "%s $%04X,X", name.c_str(), word);
+        break;
+    case AddressingMode::absolute_y:
+        std::snprintf(buffer, sizeof(buffer), "%s $%04X,Y", name.c_str(), word);
+        break;
+    case AddressingMode::indirect:
+        std::snprintf(buffer, sizeof(buffer), "%s ($%04X)", name.c_str(), word);
+        break;
+    case AddressingMode::zero_page_indirect:
+        std::snprintf(buffer, sizeof(buffer), "%s ($%02X)", name.c_str(), lo);
+        break;
+    case AddressingMode::absolute_indirect_x:
+        std::snprintf(buffer, sizeof(buffer), "%s ($%04X,X)", name.c_str(), word);
+        break;
+    case AddressingMode::relative: {
+        const auto target = static_cast<Address>(addr + 2 + static_cast<int8_t>(lo));
+        std::snprintf(buffer, sizeof(buffer), "%s $%04X", name.c_str(), target);
+        break;
+    }
+    }
+    line.text = buffer;
+    return line;
+}
+
+// Caches decoded lines per 256 byte page, a page is thrown away as soon as
+// cpu.page_generation says it (or the page holding its trailing operand bytes)
+// was written to. Known instruction boundaries ("anchors") are remembered per
+// page so that walking backwards through variable length code stays stable
+// between frames instead of being re-guessed every redraw.
+class DisassemblyCache {
+public:
+    [[nodiscard]] auto line_at(const CPU &cpu, Address addr) -> const DisassembledLine & {
+        Page &page = get_page(cpu, addr);
+        const auto offset = static_cast<Byte>(addr & 0xFF);
+        const auto next_page = static_cast<Byte>((addr >> 8) + 1);
+
+        auto it = page.lines.find(offset);
+        if (it != page.lines.end()) {
+            const Entry &entry = it->second;
+            const bool spans_page = offset + entry.line.length > 0x100;
+            if (!spans_page || entry.next_page_generation == cpu.page_generation[next_page]) {
+                return entry.line;
+            }
+        }
+
+        Entry entry{.line = disassemble(cpu, addr), .next_page_generation = cpu.page_generation[next_page]};
+        return page.lines.insert_or_assign(offset, std::move(entry)).first->second.line;
+    }
+
+    // Marks addr as a definite instruction boundary, typically the address of an executed opcode
+    auto add_anchor(const CPU &cpu, Address addr) -> void {
+        get_page(cpu, addr).anchors.set(addr & 0xFF);
+    }
+
+    // Returns the start address of the instruction preceding addr.
+    // Preferably walks forward from the closest cached anchor, otherwise picks the
+    // candidate start that decodes into addr through the longest chain of valid
+    // opcodes and caches that chain as anchors so the choice stays stable.
+    [[nodiscard]] auto previous_boundary(const CPU &cpu, Address addr) -> Address {
+        constexpr int max_anchor_distance = 96;
+        for (int distance = 1; distance <= max_anchor_distance; ++distance) {
+            const auto start = static_cast<Address>(addr - distance);
+            if (!get_page(cpu, start).anchors.test(start & 0xFF)) continue;
+
+            Address prev = start;
+            Address cur = start;
+            while (cur != addr && static_cast<Address>(cur - start) < distance) {
+                add_anchor(cpu, cur);
+                prev = cur;
+                cur = static_cast<Address>(cur + line_at(cpu, cur).length);
+            }
+            if (cur == addr) return prev;
+            break; // The anchor's chain steps over addr, fall back to guessing
+        }
+
+        constexpr int max_guess_distance = 24;
+        int best_score = -1;
+        Address best_prev = static_cast<Address>(addr - 1);
+        Address best_start = best_prev;
+        for (int distance = max_guess_distance; distance >= 1; --distance) {
+            const auto start = static_cast<Address>(addr - distance);
+            int score = 0;
+            Address prev = start;
+            Address cur = start;
+            while (static_cast<Address>(cur - start) < distance) {
+                const Instruction instr = decode(cpu.variant, peek(cpu, cur));
+                if (instr.type != InstructionType::NONE) ++score;
+                prev = cur;
+                cur = static_cast<Address>(cur + instruction_length(instr.mode));
+            }
+            if (cur == addr && score > best_score) {
+                best_score = score;
+                best_prev = prev;
+                best_start = start;
+            }
+        }
+        if (best_score < 0) return best_prev; // No candidate decodes into addr, treat the byte as data
+
+        for (Address cur = best_start; cur != addr;
+            cur = static_cast<Address>(cur + line_at(cpu, cur).length)) {
+            add_anchor(cpu, cur);
+        }
+        return best_prev;
+    }
+
+    // Collects `before` lines preceding center, center itself and `after` lines following it
+    [[nodiscard]] auto lines_around(const CPU &cpu, Address center, size_t before, size_t after)
+        -> std::vector<const DisassembledLine *> {
+        std::vector<Address> starts(before + 1 + after);
+        starts[before] = center;
+        for (size_t i = before; i > 0; --i) {
+            starts[i - 1] = previous_boundary(cpu, starts[i]);
+        }
+        for (size_t i = before + 1; i < starts.size(); ++i) {
+            starts[i] = static_cast<Address>(starts[i - 1] + line_at(cpu, starts[i - 1]).length);
+        }
+
+        std::vector<const DisassembledLine *> lines;
+        lines.reserve(starts.size());
+        for (Address start : starts) {
+            lines.push_back(&line_at(cpu, start));
+        }
+        return lines;
+    }
+
+private:
+    struct Entry {
+        DisassembledLine line;
+        uint32_t next_page_generation = 0;
+    };
+    struct Page {
+        bool valid = false;
+        uint32_t generation = 0;
+        std::unordered_map<Byte, Entry> lines;
+        std::bitset<256> anchors;
+    };
+    std::array<Page, 256> pages;
+
+    auto get_page(const CPU &cpu, Address addr) -> Page & {
+        const auto index = static_cast<size_t>(addr >> 8);
+        Page &page = pages[index];
+        if (!page.valid || page.generation != cpu.page_generation[index]) {
+            page.lines.clear();
+            page.anchors.reset();
+            page.generation = cpu.page_generation[index];
+            page.valid = true;
+        }
+        return page;
+    }
+};
+} // namespace mos6502
@@ -0,0 +1,299 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+// Instruction level engine for hybrid execution. tick() walks every instruction through the
+// addressing mode state machine one cycle at a time; here whole instructions, and common
+// pairs fused into one handler, run straight through instead, doing the same bus accesses with
+// cpu.cycles at the same values and leaving the CPU exactly as ticking would have.
+// run_until uses it wherever that is safe and ticks everything else, stepping with tick()
+// directly still works cycle by cycle.
+
+// How an instruction moves through the core, every shape is run straight through by one handler
+enum class FusionShape : Byte {
+    none,
+    implied,          // 2 cycles: transfers, flag changes, register increments, accumulator shifts, nop
+    immediate,        // 2 cycles: loads, ALU ops and compares with #imm
+    zero_page,        // 3 cycles: loads, ALU ops, compares and stores on a zero page address
+    absolute,         // 4 cycles: the same on an absolute address
+    modify_zero_page, // 5 cycles: read-modify-write of a zero page address (inc, dec, shifts)
+    modify_absolute,  // 6 cycles: read-modify-write of an absolute address
+    indirect_y,       // 5-6 cycles: loads, ALU ops, compares and stores through (zp),Y
+    jump,             // 3 cycles: jmp absolute, only as the second instruction
+    branch,           // 2-4 cycles, only as the second instruction
+    count,
+};
+
+inline constexpr size_t fusion_shape_count = static_cast<size_t>(FusionShape::count);
+inline constexpr uint64_t fused_max_cycles = 6 + 6;
+
+[[nodiscard]] constexpr auto fusion_shape(Instruction instr) -> FusionShape {
+    using enum InstructionType;
+    const bool rmw = is_rmw_instruction(instr.type);
+    switch (instr.mode) {
+    case AddressingMode::implied:
+        // The stack and interrupt instructions have sequences of their own
+        if (instr.type == brk || instr.type == rti || instr.type == rts) return FusionShape::none;
+        if (is_push_instruction(instr.type) || is_pull_instruction(instr.type)) return FusionShape::none;
+        return FusionShape::implied;
+    case AddressingMode::accum:
+        return FusionShape::implied;
+    case AddressingMode::immediate:
+        return FusionShape::immediate;
+    case AddressingMode::zero_page:
+        return rmw ? FusionShape::modify_zero_page : FusionShape::zero_page;
+    case AddressingMode::absolute:
+        if (instr.type == jsr) return FusionShape::none;
+        if (instr.type == jmp) return FusionShape::jump;
+        return rmw ? FusionShape::modify_absolute : FusionShape::absolute;
+    case AddressingMode::indirect_y:
+        return rmw ? FusionShape::none : FusionShape::indirect_y;
+    case AddressingMode::relative:
+        return is_branching_instruction(instr.type) ? FusionShape::branch : FusionShape::none;
+    default:
+        return FusionShape::none;
+    }
+}
+
+// Predecoded once per variant from its opcode table
+template <Variant V>
+inline constexpr std::array<FusionShape, 256> fusion_shapes = [] {
+    std::array<FusionShape, 256> shapes{};
+    for (size_t op = 0; op < shapes.size(); ++op) shapes[op] = fusion_shape(instruction_table_for<V>[op]);
+    return shapes;
+}();
+
+namespace fused {
+// The opcode fetch cycle of tick(), minus the interrupt check the caller already did
+template <Variant V>
+inline auto fetch_opcode(CPU &cpu) -> void {
+    ++cpu.cycles;
+    cpu.instr_addr = cpu.PC;
+    mark_coverage(cpu, cpu.PC, COVERAGE_OPCODE);
+    cpu.instr = instruction_table_for<V>[bus_read(cpu, cpu.PC++, true)];
+}
+
+// Read-modify-write cycles once TAR holds the effective address
+template <Variant V>
+inline auto modify(CPU &cpu) -> void {
+    AddrResult result;
+    for (int step = 0; step < 3; ++step) {
+        ++cpu.cycles;
+        result = rmw_cycle<V>(cpu, step);
+    }
+    exec_func<V>(cpu, std::nullopt, result.addr);
+}
+
+// The data cycle of a read or store once TAR holds the effective address
+template <Variant V>
+inline auto access(CPU &cpu) -> void {
+    ++cpu.cycles;
+    const AddrResult result = access_operand(cpu, cpu.temporary_address_register);
+    exec_func<V>(cpu, result.value, result.addr);
+}
+
+template <Variant V, FusionShape Shape>
+inline auto execute(CPU &cpu, Byte /*opcode*/ = 0x00) -> void {
+    using enum FusionShape;
+    fetch_opcode<V>(cpu);
+    ++cpu.cycles;
+    if constexpr (Shape == implied) {
+        cpu.data_bus = bus_read(cpu, cpu.PC);
+        exec_func<V>(cpu, std::nullopt, std::nullopt);
+    } else if constexpr (Shape == immediate) {
+        const Byte value = fetch(cpu);
+        exec_func<V>(cpu, value, std::nullopt);
+    } else if constexpr (Shape == zero_page || Shape == modify_zero_page) {
+        cpu.temporary_address_register = fetch(cpu);
+        if constexpr (Shape == zero_page) access<V>(cpu);
+        else modify<V>(cpu);
+    } else if constexpr (Shape == absolute || Shape == modify_absolute || Shape == jump) {
+        fetch_to_tmp(cpu);
+        ++cpu.cycles;
+        fetch_to_tar(cpu);
+        if constexpr (Shape == absolute) access<V>(cpu);
+        else if constexpr (Shape == modify_absolute) modify<V>(cpu);
+        else exec_func<V>(cpu, std::nullopt, cpu.temporary_address_register);
+    } else if constexpr (Shape == indirect_y) {
+        fetch_to_tmp(cpu);
+        ++cpu.cycles;
+        read_pointer_low(cpu);
+        ++cpu.cycles;
+        read_pointer_high(cpu);
+        cpu.temporary_address_register = static_cast<Address>(cpu.temporary_address_register + cpu.Y);
+        ++cpu.cycles;
+        const AddrResult result = fix_up_or_access<V>(cpu);
+        if (result.type == AddrResultType::in_progress) access<V>(cpu);
+        else exec_func<V>(cpu, result.value, result.addr);
+    } else if constexpr (Shape == branch) {
+        fetch_to_tmp(cpu);
+        if (check_branching_condition(cpu)) {
+            ++cpu.cycles;
+            cpu.data_bus = bus_read(cpu, cpu.PC);
+            cpu.temporary_address_register = static_cast<Address>(cpu.PC + static_cast<int8_t>(cpu.tmp));
+            if ((cpu.temporary_address_register & 0xFF00) != (cpu.PC & 0xFF00)) {
+                ++cpu.cycles;
+                cpu.data_bus = bus_read(cpu, static_cast<Address>((cpu.PC & 0xFF00) | (cpu.temporary_address_register & 0x00FF)));
+            }
+            cpu.PC = cpu.temporary_address_register;
+        }
+    }
+    finished_instruction(cpu);
+}
+
+[[nodiscard]] constexpr auto length(FusionShape shape) -> Address {
+    switch (shape) {
+    case FusionShape::implied:
+        return 1;
+    case FusionShape::absolute:
+    case FusionShape::modify_absolute:
+    case FusionShape::jump:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+// Bytes as bus_read would see them, ROM first (a bank switching cartridge is a device on pages
+// whose reads come from ROM), other devices through their side effect free peek. Timing
+// sensitive devices are left to tick().
+[[nodiscard]] inline auto code_byte(const CPU &cpu, Address addr) -> optional<Byte> {
+    const auto page = static_cast<size_t>(addr >> 8);
+    if (const Byte *rom = cpu.rom_pages[page]) return rom[addr & 0xFF];
+    if (const Device *device = cpu.devices[page]) {
+        if (device->timing_sensitive()) return std::nullopt;
+        return device->peek(cpu, addr);
+    }
+    return cpu.mem[addr];
+}
+
+[[nodiscard]] inline auto timing_sensitive_page(const CPU &cpu, size_t page) -> bool {
+    const Device *device = cpu.devices[page];
+    return device != nullptr && device->timing_sensitive();
+}
+
+// Shape of the instruction at addr, none when it can not run here: it touches a timing sensitive
+// device page, with its own bytes, the dummy read of the byte after it or its data access.
+// Depends on the registers and the zero page for (zp),Y, so it only holds right before the
+// instruction runs.
+template <Variant V>
+[[nodiscard]] inline auto shape_at(const CPU &cpu, Address addr, Byte &opcode) -> FusionShape {
+    const auto op = code_byte(cpu, addr);
+    if (!op || fusion_shapes<V>[*op] == FusionShape::none) return FusionShape::none;
+    const FusionShape shape = fusion_shapes<V>[*op];
+    const auto last = code_byte(cpu, static_cast<Address>(addr + length(shape) - 1)); // Operands may cross a page
+    if (!last) return FusionShape::none;
+    switch (shape) {
+    case FusionShape::implied:
+    case FusionShape::branch:
+        if (!code_byte(cpu, static_cast<Address>(addr + length(shape)))) return FusionShape::none;
+        break;
+    case FusionShape::zero_page:
+    case FusionShape::modify_zero_page:
+        if (timing_sensitive_page(cpu, 0x00)) return FusionShape::none;
+        break;
+    case FusionShape::absolute:
+    case FusionShape::modify_absolute:
+        if (timing_sensitive_page(cpu, *last)) return FusionShape::none; // The high operand byte is the target page
+        break;
+    case FusionShape::indirect_y: {
+        if (timing_sensitive_page(cpu, 0x00)) return FusionShape::none;
+        const auto low = code_byte(cpu, *last);
+        const auto high = code_byte(cpu, static_cast<Byte>(*last + 1));
+        if (!low || !high) return FusionShape::none;
+        const auto base = static_cast<Address>(*high << 8 | *low);
+        const auto target = static_cast<Address>(base + cpu.Y);
+        if (timing_sensitive_page(cpu, static_cast<size_t>(base >> 8)) || timing_sensitive_page(cpu, static_cast<size_t>(target >> 8))) return FusionShape::none;
+        break;
+    }
+    default:
+        break;
+    }
+    opcode = *op;
+    return shape;
+}
+
+template <Variant V, FusionShape First, FusionShape Second>
+inline auto execute_pair(CPU &cpu, Byte second_opcode) -> void {
+    execute<V, First>(cpu);
+    // Same boundary conditions tick() would see: a device touched by the first instruction may
+    // have raised an interrupt. The first may also have rewritten the second or changed the
+    // registers and pointers its address comes from, so the second is looked at again.
+    if (interrupt_pending(cpu) || cpu.nmi != cpu.nmi_previous) return;
+    Byte opcode = 0x00;
+    if (shape_at<V>(cpu, cpu.PC, opcode) != Second || opcode != second_opcode) return;
+    execute<V, Second>(cpu);
+}
+
+using HandlerFunc = void (*)(CPU &cpu, Byte opcode); // Pairs get the expected second opcode
+
+template <Variant V, FusionShape First>
+inline constexpr std::array<HandlerFunc, fusion_shape_count> pairs_after = {
+    nullptr,
+    execute_pair<V, First, FusionShape::implied>,
+    execute_pair<V, First, FusionShape::immediate>,
+    execute_pair<V, First, FusionShape::zero_page>,
+    execute_pair<V, First, FusionShape::absolute>,
+    execute_pair<V, First, FusionShape::modify_zero_page>,
+    execute_pair<V, First, FusionShape::modify_absolute>,
+    execute_pair<V, First, FusionShape::indirect_y>,
+    execute_pair<V, First, FusionShape::jump>,
+    execute_pair<V, First, FusionShape::branch>,
+};
+
+// Indexed by [first shape][second shape], control flow only ends a pair. Covers loop idioms like
+// dex / bne, inc zp / bne, cmp # / beq and lda (zp),Y / sta (zp),Y; longer runs (a whole copy
+// loop body) are not fused, the pair after them starts at the next boundary.
+template <Variant V>
+inline constexpr std::array<std::array<HandlerFunc, fusion_shape_count>, fusion_shape_count> pair_table = {{
+    {},
+    pairs_after<V, FusionShape::implied>,
+    pairs_after<V, FusionShape::immediate>,
+    pairs_after<V, FusionShape::zero_page>,
+    pairs_after<V, FusionShape::absolute>,
+    pairs_after<V, FusionShape::modify_zero_page>,
+    pairs_after<V, FusionShape::modify_absolute>,
+    pairs_after<V, FusionShape::indirect_y>,
+    {},
+    {},
+}};
+
+template <Variant V>
+inline constexpr std::array<HandlerFunc, fusion_shape_count> single_table = {
+    nullptr,
+    execute<V, FusionShape::implied>,
+    execute<V, FusionShape::immediate>,
+    execute<V, FusionShape::zero_page>,
+    execute<V, FusionShape::absolute>,
+    execute<V, FusionShape::modify_zero_page>,
+    execute<V, FusionShape::modify_absolute>,
+    execute<V, FusionShape::indirect_y>,
+    execute<V, FusionShape::jump>,
+    execute<V, FusionShape::branch>,
+};
+} // namespace fused
+
+// At an instruction boundary with at least fused_max_cycles left before the next event: runs
+// the instruction at PC, fused with the next one where possible, and returns true. Returns
+// false without executing anything when an interrupt is due or the instruction needs tick().
+template <Variant V>
+inline auto run_instruction_level(CPU &cpu) -> bool {
+    if (interrupt_pending(cpu) || cpu.nmi != cpu.nmi_previous) return false;
+    Byte first = 0x00;
+    Byte second = 0x00;
+    const FusionShape first_shape = fused::shape_at<V>(cpu, cpu.PC, first);
+    if (first_shape == FusionShape::none) return false;
+    const FusionShape second_shape = fused::shape_at<V>(cpu, static_cast<Address>(cpu.PC + fused::length(first_shape)), second);
+    if (const auto pair = fused::pair_table<V>[static_cast<size_t>(first_shape)][static_cast<size_t>(second_shape)]) {
+        pair(cpu, second);
+    } else {
+        fused::single_table<V>[static_cast<size_t>(first_shape)](cpu, first);
+    }
+    return true;
+}
+} // namespace mos6502
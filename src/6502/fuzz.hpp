@@ -0,0 +1,154 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "6502.hpp"
+
+namespace mos6502::fuzz {
+inline constexpr size_t map_size = 1 << 16;
+using TraceMap = std::array<Byte, map_size>;
+
+struct Config {
+    Address input_addr = 0x0000;
+    size_t input_size = 0;
+    uint64_t cycle_budget = 1'000'000;  // Per execution, counted from the snapshot
+    optional<Address> done_addr;        // Fetching an opcode here ends the execution normally
+};
+
+enum class Outcome {
+    done,    // Reached done_addr
+    timeout, // Budget exhausted, a hang when done_addr is configured
+};
+
+// AFL style edge coverage: every executed (previous instruction, instruction) pair bumps
+// one counter. Locations are mixed so neighbouring addresses spread over the map, prev is
+// shifted so A->B and B->A land in different cells.
+struct EdgeTracer {
+    TraceMap &trace;
+    uint64_t prev = 0;
+
+    auto visit(Address pc) -> void {
+        const uint64_t cur = mix64(pc) & (map_size - 1);
+        Byte &hits = trace[(cur ^ prev) & (map_size - 1)];
+        hits = static_cast<Byte>(hits + (hits != 0xFF)); // Saturate instead of wrapping to "never hit"
+        prev = cur >> 1;
+    }
+};
+
+// Restores the post boot snapshot, writes the input and runs until done, timeout or a crash
+// (opcodes the variant does not decode assert, which takes the process down with them).
+// last_pc, when given, is updated every instruction so a supervisor can tell where a crash happened.
+inline auto execute(CPU &cpu, const CPU &snapshot, const Config &config, std::span<const Byte> input,
+    TraceMap &trace, std::atomic<Address> *last_pc = nullptr) -> Outcome {
+    cpu = snapshot;
+    load_bytes(cpu, config.input_addr, input.first(std::min(input.size(), config.input_size)));
+    trace.fill(0);
+
+    return with_variant(cpu.variant, [&](auto v) {
+        EdgeTracer tracer{.trace = trace};
+        const uint64_t end = cpu.cycles + config.cycle_budget;
+        while (cpu.cycles < end) {
+            tick<decltype(v)::value>(cpu);
+            if (cpu.instr_counter != 1) continue; // Exactly one tick per instruction sees its opcode just fetched
+            if (config.done_addr && cpu.instr_addr == *config.done_addr) return Outcome::done;
+            tracer.visit(cpu.instr_addr);
+            if (last_pc != nullptr) last_pc->store(cpu.instr_addr, std::memory_order_relaxed);
+        }
+        return Outcome::timeout;
+    });
+}
+
+// Hit counts only matter by order of magnitude: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+[[nodiscard]] constexpr auto bucket(Byte hits) -> Byte {
+    if (hits == 0) return 0;
+    if (hits <= 3) return static_cast<Byte>(1 << (hits - 1));
+    if (hits <= 7) return 0x08;
+    if (hits <= 15) return 0x10;
+    if (hits <= 31) return 0x20;
+    if (hits <= 127) return 0x40;
+    return 0x80;
+}
+
+// virgin starts all ones, each bit is cleared the first time any execution (in any process,
+// the map lives in shared memory) hits that bucket of that edge. Returns whether trace added one.
+inline auto merge_new_bits(const TraceMap &trace, std::span<Byte, map_size> virgin) -> bool {
+    bool found = false;
+    for (size_t i = 0; i < map_size; ++i) {
+        if (trace[i] == 0) continue;
+        const Byte bits = bucket(trace[i]);
+        if ((virgin[i] & bits) == 0) continue;
+        const Byte before = std::atomic_ref<Byte>(virgin[i]).fetch_and(static_cast<Byte>(~bits), std::memory_order_relaxed);
+        found = found || (before & bits) != 0;
+    }
+    return found;
+}
+
+[[nodiscard]] inline auto covered_edges(std::span<const Byte, map_size> virgin) -> size_t {
+    return static_cast<size_t>(std::count_if(virgin.begin(), virgin.end(), [](Byte b) { return b != 0xFF; }));
+}
+
+// Havoc style mutator: stacks 1-16 random edits, occasionally splices in part of another corpus entry
+class Mutator {
+public:
+    explicit Mutator(uint64_t seed)
+        : m_rng(seed) {}
+
+    auto mutate(std::vector<Byte> &input, const std::vector<std::vector<Byte>> &corpus) -> void {
+        if (input.empty()) return;
+        const auto edits = 1u << uniform(0, 4);
+        for (unsigned i = 0; i < edits; ++i) mutate_once(input, corpus);
+    }
+
+    auto uniform(size_t lo, size_t hi) -> size_t { return std::uniform_int_distribution<size_t>(lo, hi)(m_rng); }
+
+private:
+    std::mt19937_64 m_rng;
+
+    static constexpr std::array<Byte, 9> interesting = {0x00, 0x01, 0x02, 0x0F, 0x10, 0x7F, 0x80, 0xFE, 0xFF};
+
+    auto mutate_once(std::vector<Byte> &input, const std::vector<std::vector<Byte>> &corpus) -> void {
+        const size_t pos = uniform(0, input.size() - 1);
+        switch (uniform(0, 6)) {
+        case 0:
+            input[pos] ^= static_cast<Byte>(1u << uniform(0, 7));
+            break;
+        case 1:
+            input[pos] = interesting[uniform(0, interesting.size() - 1)];
+            break;
+        case 2:
+            input[pos] = static_cast<Byte>(input[pos] + uniform(1, 35));
+            break;
+        case 3:
+            input[pos] = static_cast<Byte>(input[pos] - uniform(1, 35));
+            break;
+        case 4:
+            input[pos] = static_cast<Byte>(uniform(0, 255));
+            break;
+        case 5: { // Copy a block within the input, source and destination may overlap
+            const size_t len = uniform(1, std::min<size_t>(32, input.size()));
+            const size_t from = uniform(0, input.size() - len);
+            const size_t to = uniform(0, input.size() - len);
+            std::memmove(input.data() + to, input.data() + from, len);
+            break;
+        }
+        case 6: { // Splice the tail of another corpus entry
+            const auto &other = corpus[uniform(0, corpus.size() - 1)];
+            const size_t len = std::min(other.size(), input.size());
+            if (len == 0) break;
+            const size_t from = uniform(0, len - 1);
+            std::copy(other.begin() + static_cast<std::ptrdiff_t>(from), other.begin() + static_cast<std::ptrdiff_t>(len),
+                input.begin() + static_cast<std::ptrdiff_t>(from));
+            break;
+        }
+        }
+    }
+};
+} // namespace mos6502::fuzz
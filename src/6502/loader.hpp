@@ -0,0 +1,452 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "6502.hpp"
+
+using std::println;
+
+namespace mos6502 {
+// Read-only, private mapping of a whole file, move-only
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+    MappedFile(MappedFile &&other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+    auto operator=(MappedFile &&other) noexcept -> MappedFile & {
+        if (this != &other) {
+            unmap();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+    ~MappedFile() { unmap(); }
+
+    [[nodiscard]] static auto open(const std::string &path) -> std::optional<MappedFile> {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            println(std::cerr, "Failed to open '{}'", path);
+            return std::nullopt;
+        }
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            println(std::cerr, "Failed to stat '{}' or file is empty", path);
+            close(fd);
+            return std::nullopt;
+        }
+
+        const auto size = static_cast<size_t>(st.st_size);
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // The mapping keeps its own reference to the file
+        if (data == MAP_FAILED) {
+            println(std::cerr, "Failed to mmap '{}'", path);
+            return std::nullopt;
+        }
+
+        MappedFile file;
+        file.m_data = static_cast<const Byte *>(data);
+        file.m_size = size;
+        return file;
+    }
+
+    [[nodiscard]] auto bytes() const -> std::span<const Byte> { return {m_data, m_size}; }
+    [[nodiscard]] auto data() const -> const Byte * { return m_data; }
+    [[nodiscard]] auto size() const -> size_t { return m_size; }
+
+private:
+    const Byte *m_data = nullptr;
+    size_t m_size = 0;
+
+    auto unmap() -> void {
+        if (m_data != nullptr) munmap(const_cast<Byte *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+};
+
+enum class ImageFormat {
+    raw,
+    prg,       // Two byte little endian load address followed by the data
+    intel_hex, // :LLAAAATT<data>CC records
+    srecord,   // Motorola S1/S2/S3 records
+};
+
+inline const char *to_string(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::raw:
+        return "raw";
+    case ImageFormat::prg:
+        return "prg";
+    case ImageFormat::intel_hex:
+        return "intel_hex";
+    case ImageFormat::srecord:
+        return "srecord";
+    default:
+        assert(false);
+    }
+}
+
+struct LoadResult {
+    Address first = 0x0000;
+    Address last = 0x0000;
+    optional<Address> entry = std::nullopt; // Start address from the image itself, if it carries one
+};
+
+// Guesses the format from the extension first and from the first byte second
+[[nodiscard]] inline auto detect_format(std::string_view path, std::span<const Byte> bytes) -> ImageFormat {
+    auto has_extension = [&](std::string_view ext) {
+        if (path.size() < ext.size()) return false;
+        const std::string_view tail = path.substr(path.size() - ext.size());
+        for (size_t i = 0; i < ext.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(tail[i])) != ext[i]) return false;
+        }
+        return true;
+    };
+    if (has_extension(".prg")) return ImageFormat::prg;
+    if (has_extension(".hex") || has_extension(".ihx")) return ImageFormat::intel_hex;
+    if (has_extension(".s19") || has_extension(".s28") || has_extension(".s37") ||
+        has_extension(".srec") || has_extension(".mot")) {
+        return ImageFormat::srecord;
+    }
+    if (!bytes.empty() && bytes[0] == ':') return ImageFormat::intel_hex;
+    if (bytes.size() > 1 && bytes[0] == 'S' && bytes[1] >= '0' && bytes[1] <= '9') return ImageFormat::srecord;
+    return ImageFormat::raw;
+}
+
+[[nodiscard]] inline auto load_raw(CPU &cpu, std::span<const Byte> bytes, Address addr) -> optional<LoadResult> {
+    if (addr + bytes.size() > cpu.mem.size()) {
+        println(std::cerr, "Raw image of {} bytes does not fit at 0x{:04X}", bytes.size(), addr);
+        return std::nullopt;
+    }
+    load_bytes(cpu, addr, bytes);
+    return LoadResult{.first = addr, .last = static_cast<Address>(addr + bytes.size() - 1)};
+}
+
+[[nodiscard]] inline auto load_prg(CPU &cpu, std::span<const Byte> bytes) -> optional<LoadResult> {
+    if (bytes.size() < 3) {
+        println(std::cerr, "PRG image is too short");
+        return std::nullopt;
+    }
+    const auto addr = static_cast<Address>(bytes[0] | (bytes[1] << 8));
+    auto result = load_raw(cpu, bytes.subspan(2), addr);
+    if (result) result->entry = addr;
+    return result;
+}
+
+namespace loader_detail {
+[[nodiscard]] inline auto hex_digit(Byte c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decodes the hex digit pairs of one record line, nullopt on malformed input
+[[nodiscard]] inline auto decode_hex_pairs(std::span<const Byte> text) -> optional<std::vector<Byte>> {
+    if (text.size() % 2 != 0) return std::nullopt;
+    std::vector<Byte> out(text.size() / 2);
+    for (size_t i = 0; i < out.size(); ++i) {
+        const int hi = hex_digit(text[2 * i]);
+        const int lo = hex_digit(text[2 * i + 1]);
+        if (hi < 0 || lo < 0) return std::nullopt;
+        out[i] = static_cast<Byte>((hi << 4) | lo);
+    }
+    return out;
+}
+
+// Calls f(line_number, line) for each non-empty line with trailing CR/whitespace removed
+template <typename F>
+inline auto for_each_line(std::span<const Byte> text, F &&f) -> bool {
+    size_t line_no = 0;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = begin;
+        while (end < text.size() && text[end] != '\n') ++end;
+        size_t trimmed = end;
+        while (trimmed > begin && (text[trimmed - 1] == '\r' || text[trimmed - 1] == ' ' || text[trimmed - 1] == '\t')) {
+            --trimmed;
+        }
+        ++line_no;
+        if (trimmed > begin && !f(line_no, text.subspan(begin, trimmed - begin))) return false;
+        begin = end + 1;
+    }
+    return true;
+}
+
+struct RangeTracker {
+    size_t first = SIZE_MAX;
+    size_t last = 0;
+    auto add(size_t addr, size_t count) -> void {
+        if (count == 0) return;
+        first = std::min(first, addr);
+        last = std::max(last, addr + count - 1);
+    }
+};
+} // namespace loader_detail
+
+[[nodiscard]] inline auto load_intel_hex(CPU &cpu, std::span<const Byte> text) -> optional<LoadResult> {
+    using namespace loader_detail;
+    size_t base = 0;
+    bool done = false;
+    RangeTracker range;
+    optional<Address> entry = std::nullopt;
+
+    const bool ok = for_each_line(text, [&](size_t line_no, std::span<const Byte> line) {
+        if (done) return true;
+        auto record = (line[0] == ':') ? decode_hex_pairs(line.subspan(1)) : std::nullopt;
+        if (!record || record->size() < 5 || record->size() != static_cast<size_t>((*record)[0]) + 5) {
+            println(std::cerr, "Malformed Intel HEX record on line {}", line_no);
+            return false;
+        }
+        Byte checksum = 0;
+        for (Byte b : *record) checksum = static_cast<Byte>(checksum + b);
+        if (checksum != 0) {
+            println(std::cerr, "Intel HEX checksum mismatch on line {}", line_no);
+            return false;
+        }
+
+        const Byte count = (*record)[0];
+        const auto offset = static_cast<size_t>(((*record)[1] << 8) | (*record)[2]);
+        const Byte type = (*record)[3];
+        const auto data = std::span<const Byte>(*record).subspan(4, count);
+        const bool bad_length = ((type == 0x02 || type == 0x04) && count != 2) || ((type == 0x03 || type == 0x05) && count != 4);
+        if (bad_length) {
+            println(std::cerr, "Intel HEX record of type {} has wrong length on line {}", type, line_no);
+            return false;
+        }
+        switch (type) {
+        case 0x00: { // Data
+            const size_t addr = base + offset;
+            if (addr + count > cpu.mem.size()) {
+                println(std::cerr, "Intel HEX data beyond 64 KiB on line {}", line_no);
+                return false;
+            }
+            load_bytes(cpu, static_cast<Address>(addr), data);
+            range.add(addr, count);
+            return true;
+        }
+        case 0x01: // End of file
+            done = true;
+            return true;
+        case 0x02: // Extended segment address
+            base = static_cast<size_t>((data[0] << 8) | data[1]) << 4;
+            return true;
+        case 0x04: // Extended linear address
+            base = static_cast<size_t>((data[0] << 8) | data[1]) << 16;
+            return true;
+        case 0x03: // Start segment address CS:IP, only IP is meaningful here
+            entry = static_cast<Address>((data[2] << 8) | data[3]);
+            return true;
+        case 0x05: // Start linear address
+            entry = static_cast<Address>((data[2] << 8) | data[3]);
+            return true;
+        default:
+            println(std::cerr, "Unknown Intel HEX record type {} on line {}", type, line_no);
+            return false;
+        }
+    });
+    if (!ok || range.first == SIZE_MAX) return std::nullopt;
+    return LoadResult{.first = static_cast<Address>(range.first), .last = static_cast<Address>(range.last), .entry = entry};
+}
+
+[[nodiscard]] inline auto load_srecord(CPU &cpu, std::span<const Byte> text) -> optional<LoadResult> {
+    using namespace loader_detail;
+    RangeTracker range;
+    optional<Address> entry = std::nullopt;
+
+    const bool ok = for_each_line(text, [&](size_t line_no, std::span<const Byte> line) {
+        auto record = (line.size() >= 4 && line[0] == 'S') ? decode_hex_pairs(line.subspan(2)) : std::nullopt;
+        if (!record || record->empty() || record->size() != static_cast<size_t>((*record)[0]) + 1) {
+            println(std::cerr, "Malformed S-record on line {}", line_no);
+            return false;
+        }
+        Byte checksum = 0;
+        for (Byte b : *record) checksum = static_cast<Byte>(checksum + b);
+        if (checksum != 0xFF) {
+            println(std::cerr, "S-record checksum mismatch on line {}", line_no);
+            return false;
+        }
+
+        const char type = static_cast<char>(line[1]);
+        size_t addr_len;
+        switch (type) {
+        case '1':
+        case '9':
+            addr_len = 2;
+            break;
+        case '2':
+        case '8':
+            addr_len = 3;
+            break;
+        case '3':
+        case '7':
+            addr_len = 4;
+            break;
+        case '0': // Header
+        case '5': // Record counts
+        case '6':
+            return true;
+        default:
+            println(std::cerr, "Unknown S-record type S{} on line {}", type, line_no);
+            return false;
+        }
+        if (record->size() < 2 + addr_len) {
+            println(std::cerr, "Truncated S-record on line {}", line_no);
+            return false;
+        }
+
+        size_t addr = 0;
+        for (size_t i = 0; i < addr_len; ++i) addr = (addr << 8) | (*record)[1 + i];
+        if (type >= '7') {
+            entry = static_cast<Address>(addr);
+            return true;
+        }
+
+        const auto data = std::span<const Byte>(*record).subspan(1 + addr_len, record->size() - 2 - addr_len);
+        if (addr + data.size() > cpu.mem.size()) {
+            println(std::cerr, "S-record data beyond 64 KiB on line {}", line_no);
+            return false;
+        }
+        load_bytes(cpu, static_cast<Address>(addr), data);
+        range.add(addr, data.size());
+        return true;
+    });
+    if (!ok || range.first == SIZE_MAX) return std::nullopt;
+    return LoadResult{.first = static_cast<Address>(range.first), .last = static_cast<Address>(range.last), .entry = entry};
+}
+
+[[nodiscard]] inline auto load_image(CPU &cpu, std::span<const Byte> bytes, ImageFormat format, Address raw_addr = 0x0000)
+    -> optional<LoadResult> {
+    switch (format) {
+    case ImageFormat::raw:
+        return load_raw(cpu, bytes, raw_addr);
+    case ImageFormat::prg:
+        return load_prg(cpu, bytes);
+    case ImageFormat::intel_hex:
+        return load_intel_hex(cpu, bytes);
+    case ImageFormat::srecord:
+        return load_srecord(cpu, bytes);
+    default:
+        assert(false);
+    }
+}
+
+// Points rom_pages at the mapped image instead of copying it, the image must outlive the mapping.
+// A trailing partial page reads as zeros, mmap pads the last host page.
+inline auto map_rom(CPU &cpu, const MappedFile &image, Address base) -> LoadResult {
+    assert((base & 0xFF) == 0);
+    const size_t pages = std::min((image.size() + 0xFF) / 0x100, size_t{256} - (base >> 8));
+    for (size_t i = 0; i < pages; ++i) {
+        map_rom_page(cpu, static_cast<Byte>((base >> 8) + i), image.data() + i * 0x100);
+    }
+    return LoadResult{.first = base, .last = static_cast<Address>(base + pages * 0x100 - 1)};
+}
+
+// Cartridge style image larger than the CPU window. The window is split into equally sized
+// slots, each pointing at one bank of the mapped file. A write anywhere inside a slot selects
+// bank (value % bank_count) for it, unless the slot is fixed (UxROM keeps its last slot
+// on the last bank). Switching only rewrites 256 byte page pointers, no data is copied.
+class BankedRom : public Device {
+public:
+    BankedRom(MappedFile image, Address window_base, size_t bank_size, size_t slot_count, bool fix_last_slot)
+        : m_image(std::move(image)), m_window_base(window_base), m_bank_size(bank_size),
+          m_slot_count(slot_count), m_fix_last_slot(fix_last_slot), m_slot_bank(slot_count, 0) {
+        assert((window_base & 0xFF) == 0 && bank_size % 0x100 == 0 && bank_size > 0);
+        assert(window_base + bank_size * slot_count <= 0x10000);
+        m_bank_count = std::max<size_t>(1, (m_image.size() + bank_size - 1) / bank_size);
+    }
+
+    [[nodiscard]] auto bank_count() const -> size_t { return m_bank_count; }
+    [[nodiscard]] auto slot_bank(size_t slot) const -> size_t { return m_slot_bank[slot]; }
+    [[nodiscard]] auto window_base() const -> Address { return m_window_base; }
+    [[nodiscard]] auto window_last() const -> Address {
+        return static_cast<Address>(m_window_base + m_bank_size * m_slot_count - 1);
+    }
+
+    // Maps the initial banks (slot i -> bank i, fixed slot -> last bank) and routes window writes here
+    auto attach(CPU &cpu) -> void {
+        attach_device(cpu, *this, window_base(), window_last());
+        for (size_t slot = 0; slot < m_slot_count; ++slot) {
+            const bool fixed = m_fix_last_slot && slot + 1 == m_slot_count;
+            select(cpu, slot, fixed ? m_bank_count - 1 : slot % m_bank_count);
+        }
+    }
+
+    auto select(CPU &cpu, size_t slot, size_t bank) -> void {
+        assert(slot < m_slot_count);
+        bank %= m_bank_count;
+        m_slot_bank[slot] = bank;
+        const size_t first_page = (m_window_base + slot * m_bank_size) >> 8;
+        for (size_t i = 0; i < m_bank_size / 0x100; ++i) {
+            const size_t offset = bank * m_bank_size + i * 0x100;
+            // Pages past the end of a short last bank fall back to the open bus (mem)
+            map_rom_page(cpu, static_cast<Byte>(first_page + i), offset < m_image.size() ? m_image.data() + offset : nullptr);
+        }
+    }
+
+    auto read(CPU &cpu, Address addr) -> Byte override { return peek(cpu, addr); }
+
+    // Bank switches only take effect for later accesses, the exact cycle does not matter
+    [[nodiscard]] auto timing_sensitive() const -> bool override { return false; }
+
+    auto write(CPU &cpu, Address addr, Byte value) -> void override {
+        const size_t slot = (addr - m_window_base) / m_bank_size;
+        if (m_fix_last_slot && slot + 1 == m_slot_count) return;
+        select(cpu, slot, value);
+    }
+
+    [[nodiscard]] auto peek(const CPU &cpu, Address addr) const -> Byte override {
+        const Byte *page = cpu.rom_pages[addr >> 8];
+        return page != nullptr ? page[addr & 0xFF] : cpu.mem[addr];
+    }
+
+    // One byte bank number per slot
+    auto save_state(std::vector<Byte> &out) const -> void override {
+        for (size_t bank : m_slot_bank) out.push_back(static_cast<Byte>(bank));
+    }
+
+    auto load_state(CPU &cpu, std::span<const Byte> state) -> bool override {
+        if (state.size() != m_slot_count) return false;
+        for (size_t slot = 0; slot < m_slot_count; ++slot) select(cpu, slot, state[slot]);
+        return true;
+    }
+
+private:
+    MappedFile m_image;
+    Address m_window_base;
+    size_t m_bank_size;
+    size_t m_slot_count;
+    bool m_fix_last_slot;
+    size_t m_bank_count = 1;
+    std::vector<size_t> m_slot_bank;
+};
+
+// Uses the reset vector if the image covers $FFFC/$FFFD and carries no own entry point
+[[nodiscard]] inline auto entry_point(const CPU &cpu, const LoadResult &result) -> Address {
+    if (result.entry) return *result.entry;
+    if (result.last >= 0xFFFD) {
+        return static_cast<Address>(peek(cpu, 0xFFFC) | (peek(cpu, 0xFFFD) << 8));
+    }
+    return result.first;
+}
+} // namespace mos6502
@@ -0,0 +1,134 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+struct ProfileNode {
+    static constexpr uint32_t none = UINT32_MAX;
+
+    Address entry = 0x0000; // First instruction of the subroutine or handler
+    CallKind kind = CallKind::jsr;
+    uint32_t parent = none;
+    uint32_t first_child = none;
+    uint32_t next_sibling = none;
+    uint64_t calls = 0;
+    uint64_t self_cycles = 0; // Exclusive, inclusive cycles are summed up on demand
+};
+
+// Shadow call stack building a calling context tree: one node per distinct call path, so the
+// same subroutine reached from two callers is profiled twice. Cycles are charged to the path
+// on top of the shadow stack whenever a call or return is observed.
+//
+// Frames are matched by stack pointer instead of by return address, which keeps the tree
+// intact under the usual stack tricks: a return pops every frame at or below the SP it leaves
+// behind (jumps through pushed addresses and discarded return addresses unwind correctly), a
+// return that unwinds nothing is a computed jump and only charges cycles, and a call at or
+// above a stale frame (SP reset with txs) drops that frame first.
+class CallProfiler : public CallObserver {
+public:
+    explicit CallProfiler(const CPU &cpu) { reset(cpu); }
+
+    auto reset(const CPU &cpu) -> void {
+        m_nodes.assign(1, ProfileNode{.entry = cpu.PC, .calls = 1});
+        m_stack.clear();
+        m_last_cycle = cpu.cycles;
+    }
+
+    auto on_call(const CPU &cpu, CallKind kind, Address target, Byte frame_sp) -> void override {
+        charge(cpu);
+        unwind(frame_sp);
+        const uint32_t node = child(current(), target, kind);
+        ++m_nodes[node].calls;
+        m_stack.push_back({.node = node, .frame_sp = frame_sp});
+    }
+
+    auto on_return(const CPU &cpu) -> void override {
+        charge(cpu);
+        unwind(cpu.SP);
+    }
+
+    // Charges the cycles since the last call or return, for views that read a running profile
+    auto charge(const CPU &cpu) -> void {
+        m_nodes[current()].self_cycles += cpu.cycles - m_last_cycle;
+        m_last_cycle = cpu.cycles;
+    }
+
+    [[nodiscard]] auto nodes() const -> const std::vector<ProfileNode> & { return m_nodes; }
+    [[nodiscard]] auto depth() const -> size_t { return m_stack.size(); }
+
+    // Children are always created after their parent, one backwards pass sums every subtree
+    [[nodiscard]] auto inclusive_cycles() const -> std::vector<uint64_t> {
+        std::vector<uint64_t> inclusive(m_nodes.size());
+        for (size_t i = m_nodes.size(); i-- > 0;) {
+            inclusive[i] += m_nodes[i].self_cycles;
+            if (m_nodes[i].parent != ProfileNode::none) inclusive[m_nodes[i].parent] += inclusive[i];
+        }
+        return inclusive;
+    }
+
+    [[nodiscard]] static auto frame_name(const ProfileNode &node, bool is_root) -> std::string {
+        static constexpr const char *prefixes[] = {"", "irq:", "nmi:", "brk:"};
+        char name[24];
+        std::snprintf(name, sizeof(name), "%s%s$%04X", is_root ? "start:" : "", prefixes[static_cast<int>(node.kind)], node.entry);
+        return name;
+    }
+
+    // Folded stacks, "start:$0400;$0520;irq:$E000 1234" per path with exclusive cycles,
+    // the input format of flamegraph.pl, inferno and speedscope
+    auto write_folded(const std::string &path) const -> bool {
+        std::FILE *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+        std::vector<uint32_t> chain;
+        for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].self_cycles == 0) continue;
+            chain.clear();
+            for (uint32_t n = i; n != ProfileNode::none; n = m_nodes[n].parent) chain.push_back(n);
+            std::string line;
+            for (size_t j = chain.size(); j-- > 0;) {
+                line += frame_name(m_nodes[chain[j]], chain[j] == 0);
+                line += j > 0 ? ';' : ' ';
+            }
+            std::fprintf(file, "%s%llu\n", line.c_str(), static_cast<unsigned long long>(m_nodes[i].self_cycles));
+        }
+        return std::fclose(file) == 0;
+    }
+
+private:
+    struct Frame {
+        uint32_t node;
+        Byte frame_sp;
+    };
+
+    std::vector<ProfileNode> m_nodes;
+    std::vector<Frame> m_stack;
+    uint64_t m_last_cycle = 0;
+
+    [[nodiscard]] auto current() const -> uint32_t { return m_stack.empty() ? 0 : m_stack.back().node; }
+
+    // The stack grows down, frames whose saved SP is at or below sp have been returned from
+    auto unwind(Byte sp) -> void {
+        while (!m_stack.empty() && m_stack.back().frame_sp <= sp) m_stack.pop_back();
+    }
+
+    // Linear scan of the sibling list, call sites rarely have more than a handful of callees
+    auto child(uint32_t parent, Address entry, CallKind kind) -> uint32_t {
+        uint32_t *link = &m_nodes[parent].first_child;
+        while (*link != ProfileNode::none) {
+            const ProfileNode &node = m_nodes[*link];
+            if (node.entry == entry && node.kind == kind) return *link;
+            link = &m_nodes[*link].next_sibling;
+        }
+        const auto index = static_cast<uint32_t>(m_nodes.size());
+        *link = index; // Taken before the push_back may reallocate, hence assigned first
+        m_nodes.push_back({.entry = entry, .kind = kind, .parent = parent});
+        return index;
+    }
+};
+} // namespace mos6502
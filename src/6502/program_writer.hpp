@@ -11,7 +11,7 @@ public:
     explicit ProgramWriter(CPU &cpu, Address addr = 0x0000)
         : addr(addr), cpu(cpu) {}
 
-    void operator()(Byte value) { cpu.mem[addr++] = value; }
+    void operator()(Byte value) { write(cpu, addr++, value); }
 
     /* † BRK / interrupts & status */
     void brk() { (*this)(0x00); }
@@ -0,0 +1,498 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "6502.hpp"
+#include "loader.hpp"
+
+using std::println;
+
+/*
+ * Binary save state, little endian:
+ *
+ *   header   "65SV" | u16 version | u16 flags
+ *   cpu      registers, pins, chip variant, interrupt latches, micro-op state (instr, instr_counter,
+ *            tmp, TAR, addr_result), cycles
+ *   memory   256 page records: u8 encoding followed by its payload
+ *              fill    1 byte, the whole page holds that value
+ *              raw     256 bytes
+ *              rle     u16 payload size, then (run length - 1, value) pairs
+ *              same    nothing, page equals the base state (delta saves only)
+ *              xor_rle like rle but of the page XORed with the base page
+ *   devices  u16 count, then per device: u8 first page | u32 size | opaque bytes
+ *
+ * Delta saves encode memory against a base CPU state (e.g. the previous checkpoint of a batch run),
+ * loading them requires the very same base. The page maps (rom_pages, devices) are wiring, not
+ * state: a state is loaded into an already configured CPU and only the device contents are restored.
+ */
+
+namespace mos6502 {
+inline constexpr std::array<Byte, 4> save_state_magic = {'6', '5', 'S', 'V'};
+inline constexpr uint16_t save_state_version = 3;
+
+enum class PageEncoding : Byte {
+    fill,
+    raw,
+    rle,
+    same,
+    xor_rle,
+};
+
+namespace save_state_detail {
+inline constexpr uint16_t flag_delta = 0x0001;
+
+struct Writer {
+    std::vector<Byte> &out;
+
+    auto u8(Byte v) -> void { out.push_back(v); }
+    auto u16(uint16_t v) -> void {
+        out.push_back(static_cast<Byte>(v));
+        out.push_back(static_cast<Byte>(v >> 8));
+    }
+    auto u32(uint32_t v) -> void {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<Byte>(v >> (8 * i)));
+    }
+    auto u64(uint64_t v) -> void {
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<Byte>(v >> (8 * i)));
+    }
+    auto bytes(std::span<const Byte> b) -> void { out.insert(out.end(), b.begin(), b.end()); }
+};
+
+struct Reader {
+    std::span<const Byte> in;
+    size_t pos = 0;
+    bool ok = true;
+
+    [[nodiscard]] auto take(size_t n) -> std::span<const Byte> {
+        if (!ok || pos + n > in.size()) {
+            ok = false;
+            return {};
+        }
+        auto s = in.subspan(pos, n);
+        pos += n;
+        return s;
+    }
+    [[nodiscard]] auto u8() -> Byte {
+        auto s = take(1);
+        return ok ? s[0] : 0;
+    }
+    [[nodiscard]] auto u16() -> uint16_t {
+        auto s = take(2);
+        return ok ? static_cast<uint16_t>(s[0] | (s[1] << 8)) : 0;
+    }
+    [[nodiscard]] auto u32() -> uint32_t {
+        auto s = take(4);
+        uint32_t v = 0;
+        for (size_t i = 0; ok && i < 4; ++i) v |= static_cast<uint32_t>(s[i]) << (8 * i);
+        return v;
+    }
+    [[nodiscard]] auto u64() -> uint64_t {
+        auto s = take(8);
+        uint64_t v = 0;
+        for (size_t i = 0; ok && i < 8; ++i) v |= static_cast<uint64_t>(s[i]) << (8 * i);
+        return v;
+    }
+    // One byte holding an enumerator up to last, anything past it marks the state corrupt
+    template <typename E>
+    [[nodiscard]] auto enumeration(E last) -> E {
+        const Byte v = u8();
+        if (v > static_cast<Byte>(last)) ok = false;
+        return ok ? static_cast<E>(v) : E{};
+    }
+};
+
+// One InstructionType per entry of INSTRUCTION_TYPE_LIST
+inline constexpr size_t instruction_type_count = 0
+#define X(name) +1
+    INSTRUCTION_TYPE_LIST
+#undef X
+    ;
+
+inline auto write_cpu(Writer &w, const CPU &cpu) -> void {
+    w.u16(cpu.PC);
+    w.u8(cpu.A);
+    w.u8(cpu.X);
+    w.u8(cpu.Y);
+    w.u8(cpu.SP);
+    w.u8(cpu.P);
+    w.u8(static_cast<Byte>(cpu.nmi | (cpu.irq << 1) | (cpu.sync << 2) | (cpu.rdy << 3) | (cpu.rw << 4) |
+                           (cpu.nmi_previous << 6) | (cpu.nmi_pending << 7)));
+    w.u8(static_cast<Byte>(cpu.variant));
+    w.u8(cpu.irq_sources);
+    w.u8(static_cast<Byte>(cpu.interrupt));
+    w.u16(cpu.addr);
+    w.u16(cpu.temporary_address_register);
+    w.u8(cpu.data_bus);
+    w.u8(static_cast<Byte>(cpu.instr.type));
+    w.u8(static_cast<Byte>(cpu.instr.mode));
+    w.u32(static_cast<uint32_t>(cpu.instr_counter));
+    w.u16(cpu.instr_addr);
+    w.u8(cpu.tmp);
+    w.u64(cpu.cycles);
+    w.u8(static_cast<Byte>(cpu.addr_result.type));
+    w.u8(static_cast<Byte>(cpu.addr_result.value.has_value() | (cpu.addr_result.addr.has_value() << 1)));
+    w.u8(cpu.addr_result.value.value_or(0));
+    w.u16(cpu.addr_result.addr.value_or(0));
+}
+
+// Out of range enumerators or an addr_result whose operands do not fit its type fail the reader,
+// tick() would trip over them later
+inline auto read_cpu(Reader &r, CPU &cpu) -> void {
+    cpu.PC = r.u16();
+    cpu.A = r.u8();
+    cpu.X = r.u8();
+    cpu.Y = r.u8();
+    cpu.SP = r.u8();
+    cpu.P = r.u8();
+    const Byte pins = r.u8();
+    cpu.nmi = pins & 0x01;
+    cpu.irq = pins & 0x02;
+    cpu.sync = pins & 0x04;
+    cpu.rdy = pins & 0x08;
+    cpu.rw = pins & 0x10;
+    cpu.nmi_previous = pins & 0x40;
+    cpu.nmi_pending = pins & 0x80;
+    cpu.variant = r.enumeration(Variant::cmos); // instr below is only meaningful for this variant
+    cpu.irq_sources = r.u8();
+    cpu.interrupt = r.enumeration(InterruptKind::brk);
+    cpu.addr = r.u16();
+    cpu.temporary_address_register = r.u16();
+    cpu.data_bus = r.u8();
+    cpu.instr.type = r.enumeration(static_cast<InstructionType>(instruction_type_count - 1));
+    cpu.instr.mode = r.enumeration(AddressingMode::absolute_indirect_x);
+    cpu.instr_counter = static_cast<int>(r.u32());
+    cpu.instr_addr = r.u16();
+    cpu.tmp = r.u8();
+    cpu.cycles = r.u64();
+    cpu.addr_result.type = r.enumeration(AddrResultType::complete_address);
+    const Byte present = r.u8();
+    const Byte value = r.u8();
+    const Address addr = r.u16();
+    const bool has_value = cpu.addr_result.type == AddrResultType::complete_value;
+    const bool has_addr = cpu.addr_result.type == AddrResultType::complete_address;
+    if (present != (has_value | (has_addr << 1))) r.ok = false;
+    cpu.addr_result.value = has_value ? optional<Byte>(value) : std::nullopt;
+    cpu.addr_result.addr = has_addr ? optional<Address>(addr) : std::nullopt;
+}
+
+// (run length - 1, value) pairs, returns false as soon as it would not beat a raw page
+inline auto rle_encode(std::span<const Byte, 256> page, std::vector<Byte> &out) -> bool {
+    const size_t start = out.size();
+    for (size_t i = 0; i < page.size();) {
+        size_t run = 1;
+        while (i + run < page.size() && run < 256 && page[i + run] == page[i]) ++run;
+        out.push_back(static_cast<Byte>(run - 1));
+        out.push_back(page[i]);
+        if (out.size() - start >= 254) { // rle payload + u16 size must stay below 256
+            out.resize(start);
+            return false;
+        }
+        i += run;
+    }
+    return true;
+}
+
+inline auto rle_decode(Reader &r, std::span<Byte, 256> page) -> bool {
+    const uint16_t size = r.u16();
+    auto payload = r.take(size);
+    if (!r.ok || size % 2 != 0) return false;
+    size_t pos = 0;
+    for (size_t i = 0; i < payload.size(); i += 2) {
+        const size_t run = static_cast<size_t>(payload[i]) + 1;
+        if (pos + run > page.size()) return false;
+        std::fill_n(page.begin() + static_cast<std::ptrdiff_t>(pos), run, payload[i + 1]);
+        pos += run;
+    }
+    return pos == page.size();
+}
+
+// Appends the record for one page; raw pages are left out of `out` and reported
+// through the return value so callers can reference cpu.mem directly (writev)
+inline auto encode_page(std::span<const Byte, 256> page, const Byte *base_page, std::vector<Byte> &out) -> bool {
+    if (base_page != nullptr && std::memcmp(page.data(), base_page, 256) == 0) {
+        out.push_back(static_cast<Byte>(PageEncoding::same));
+        return false;
+    }
+    if (std::all_of(page.begin(), page.end(), [&](Byte b) { return b == page[0]; })) {
+        out.push_back(static_cast<Byte>(PageEncoding::fill));
+        out.push_back(page[0]);
+        return false;
+    }
+
+    auto try_rle = [&](PageEncoding encoding, std::span<const Byte, 256> data) {
+        const size_t header = out.size();
+        out.push_back(static_cast<Byte>(encoding));
+        out.push_back(0);
+        out.push_back(0);
+        if (!rle_encode(data, out)) {
+            out.resize(header);
+            return false;
+        }
+        const size_t size = out.size() - header - 3;
+        out[header + 1] = static_cast<Byte>(size);
+        out[header + 2] = static_cast<Byte>(size >> 8);
+        return true;
+    };
+    if (base_page != nullptr) {
+        std::array<Byte, 256> delta;
+        for (size_t i = 0; i < delta.size(); ++i) delta[i] = page[i] ^ base_page[i];
+        if (try_rle(PageEncoding::xor_rle, delta)) return false;
+    }
+    if (try_rle(PageEncoding::rle, page)) return false;
+
+    out.push_back(static_cast<Byte>(PageEncoding::raw));
+    return true;
+}
+
+// Calls f(first_page, device) once per distinct attached device
+template <typename F>
+inline auto for_each_device(const CPU &cpu, F &&f) -> void {
+    for (size_t page = 0; page < cpu.devices.size(); ++page) {
+        const Device *device = cpu.devices[page];
+        if (device == nullptr) continue;
+        if (std::find(cpu.devices.begin(), cpu.devices.begin() + static_cast<std::ptrdiff_t>(page), device) !=
+            cpu.devices.begin() + static_cast<std::ptrdiff_t>(page)) {
+            continue;
+        }
+        f(static_cast<Byte>(page), *device);
+    }
+}
+
+inline auto write_header_and_cpu(std::vector<Byte> &out, const CPU &cpu, bool delta) -> void {
+    Writer w{out};
+    w.bytes(save_state_magic);
+    w.u16(save_state_version);
+    w.u16(delta ? flag_delta : 0);
+    write_cpu(w, cpu);
+}
+
+inline auto write_devices(std::vector<Byte> &out, const CPU &cpu) -> void {
+    Writer w{out};
+    uint16_t count = 0;
+    for_each_device(cpu, [&](Byte, const Device &) { ++count; });
+    w.u16(count);
+    std::vector<Byte> blob;
+    for_each_device(cpu, [&](Byte page, const Device &device) {
+        blob.clear();
+        device.save_state(blob);
+        w.u8(page);
+        w.u32(static_cast<uint32_t>(blob.size()));
+        w.bytes(blob);
+    });
+}
+
+// Device section into the devices wired to cpu. Every record has to name a distinct attached
+// device, checked before anything is applied. loaded is the CPU the devices will run against,
+// cpu itself when only the devices are restored.
+inline auto read_devices(Reader &r, CPU &cpu, CPU &loaded) -> bool {
+    struct DeviceRecord {
+        Byte page = 0x00;
+        Device *device = nullptr;
+        std::span<const Byte> state;
+    };
+    const uint16_t device_count = r.u16();
+    size_t attached = 0;
+    for_each_device(cpu, [&](Byte, const Device &) { ++attached; });
+    if (!r.ok || device_count > attached) {
+        println(std::cerr, "Corrupt device section in save state");
+        return false;
+    }
+    std::vector<DeviceRecord> devices(device_count);
+    for (size_t i = 0; i < devices.size(); ++i) {
+        DeviceRecord &record = devices[i];
+        record.page = r.u8();
+        record.state = r.take(r.u32());
+        record.device = cpu.devices[record.page];
+        if (!r.ok) break;
+        const auto earlier = devices.begin() + static_cast<std::ptrdiff_t>(i);
+        const bool repeated = std::any_of(devices.begin(), earlier, [&](const DeviceRecord &other) { return other.device == record.device; });
+        if (record.device == nullptr || repeated) {
+            println(std::cerr, "Save state device at page 0x{:02X} does not match the attached devices", record.page);
+            return false;
+        }
+    }
+    if (!r.ok) {
+        println(std::cerr, "Corrupt device section in save state");
+        return false;
+    }
+
+    // Devices load against the decoded CPU, they may drive its interrupt lines. One rejecting its
+    // state gets the ones loaded before it their previous state back against cpu.
+    std::vector<std::vector<Byte>> previous(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        devices[i].device->save_state(previous[i]);
+        if (!devices[i].device->load_state(loaded, devices[i].state)) {
+            for (size_t j = 0; j < i; ++j) (void)devices[j].device->load_state(cpu, previous[j]);
+            println(std::cerr, "Save state device at page 0x{:02X} does not match the attached devices", devices[i].page);
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace save_state_detail
+
+// Serializes cpu into out (replacing its contents). With a base, memory is stored as a delta
+// against base->mem. Keeping `out` alive between calls avoids reallocations in batch runs.
+inline auto encode_state(const CPU &cpu, std::vector<Byte> &out, const CPU *base = nullptr) -> void {
+    using namespace save_state_detail;
+    out.clear();
+    write_header_and_cpu(out, cpu, base != nullptr);
+    for (size_t page = 0; page < 256; ++page) {
+        const std::span<const Byte, 256> data(cpu.mem.data() + page * 256, 256);
+        const Byte *base_page = base != nullptr ? base->mem.data() + page * 256 : nullptr;
+        if (encode_page(data, base_page, out)) out.insert(out.end(), data.begin(), data.end());
+    }
+    write_devices(out, cpu);
+}
+
+// Restores a state produced by encode_state into an already wired CPU
+[[nodiscard]] inline auto decode_state(CPU &cpu, std::span<const Byte> in, const CPU *base = nullptr) -> bool {
+    using namespace save_state_detail;
+    Reader r{in};
+    auto magic = r.take(save_state_magic.size());
+    if (!r.ok || !std::equal(magic.begin(), magic.end(), save_state_magic.begin())) {
+        println(std::cerr, "Not a 6502 save state");
+        return false;
+    }
+    const uint16_t version = r.u16();
+    const uint16_t flags = r.u16();
+    if (version != save_state_version) {
+        println(std::cerr, "Unsupported save state version {}", version);
+        return false;
+    }
+    const bool delta = flags & flag_delta;
+    if (delta && base == nullptr) {
+        println(std::cerr, "Delta save state needs its base state to load");
+        return false;
+    }
+
+    CPU loaded = cpu; // Decode into a copy so a truncated file leaves cpu untouched
+    read_cpu(r, loaded);
+    for (size_t page = 0; page < 256 && r.ok; ++page) {
+        const std::span<Byte, 256> data(loaded.mem.data() + page * 256, 256);
+        const Byte *base_page = delta ? base->mem.data() + page * 256 : nullptr;
+        switch (static_cast<PageEncoding>(r.u8())) {
+        case PageEncoding::fill:
+            std::fill(data.begin(), data.end(), r.u8());
+            break;
+        case PageEncoding::raw: {
+            auto raw = r.take(256);
+            if (r.ok) std::copy(raw.begin(), raw.end(), data.begin());
+            break;
+        }
+        case PageEncoding::rle:
+            r.ok = r.ok && rle_decode(r, data);
+            break;
+        case PageEncoding::same:
+            r.ok = r.ok && base_page != nullptr;
+            if (r.ok) std::copy_n(base_page, 256, data.begin());
+            break;
+        case PageEncoding::xor_rle:
+            r.ok = r.ok && base_page != nullptr && rle_decode(r, data);
+            if (r.ok) {
+                for (size_t i = 0; i < data.size(); ++i) data[i] ^= base_page[i];
+            }
+            break;
+        default:
+            r.ok = false;
+        }
+    }
+    if (!r.ok) {
+        println(std::cerr, "Corrupt or truncated save state");
+        return false;
+    }
+
+    if (!read_devices(r, cpu, loaded)) return false;
+
+    cpu = loaded;
+    for (auto &generation : cpu.page_generation) ++generation; // Everything may have changed
+    rehash_memory(cpu);
+    return true;
+}
+
+// Device contents alone, for callers that copy the CPU itself around (debugger snapshots)
+inline auto encode_devices(const CPU &cpu, std::vector<Byte> &out) -> void {
+    out.clear();
+    save_state_detail::write_devices(out, cpu);
+}
+
+// Restores what encode_devices wrote into the devices wired to cpu, all of them or none
+[[nodiscard]] inline auto decode_devices(CPU &cpu, std::span<const Byte> in) -> bool {
+    save_state_detail::Reader r{in};
+    return save_state_detail::read_devices(r, cpu, cpu);
+}
+
+// Writes the state with a single writev, raw pages are referenced straight from cpu.mem
+[[nodiscard]] inline auto save_state_file(const std::string &path, const CPU &cpu, const CPU *base = nullptr) -> bool {
+    using namespace save_state_detail;
+
+    // Every record goes into one buffer reserved up front so iovec pointers stay valid
+    std::vector<Byte> scratch;
+    scratch.reserve(64 + 256 * 260);
+    std::vector<iovec> iov;
+    iov.reserve(2 * 256 + 4);
+    size_t pending_from = 0;
+    auto flush_scratch = [&]() {
+        if (scratch.size() > pending_from) {
+            iov.push_back({scratch.data() + pending_from, scratch.size() - pending_from});
+            pending_from = scratch.size();
+        }
+    };
+
+    write_header_and_cpu(scratch, cpu, base != nullptr);
+    for (size_t page = 0; page < 256; ++page) {
+        const std::span<const Byte, 256> data(cpu.mem.data() + page * 256, 256);
+        const Byte *base_page = base != nullptr ? base->mem.data() + page * 256 : nullptr;
+        if (encode_page(data, base_page, scratch)) {
+            flush_scratch();
+            iov.push_back({const_cast<Byte *>(data.data()), data.size()});
+        }
+    }
+    std::vector<Byte> devices;
+    write_devices(devices, cpu);
+    flush_scratch();
+    iov.push_back({devices.data(), devices.size()});
+
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        println(std::cerr, "Failed to open '{}' for writing", path);
+        return false;
+    }
+    size_t expected = 0;
+    for (const auto &v : iov) expected += v.iov_len;
+    size_t written = 0;
+    for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+        const auto count = static_cast<int>(std::min<size_t>(IOV_MAX, iov.size() - i));
+        const ssize_t n = writev(fd, iov.data() + i, count);
+        if (n < 0) break;
+        written += static_cast<size_t>(n);
+    }
+    close(fd);
+    if (written != expected) {
+        println(std::cerr, "Short write to '{}'", path);
+        return false;
+    }
+    return true;
+}
+
+[[nodiscard]] inline auto load_state_file(const std::string &path, CPU &cpu, const CPU *base = nullptr) -> bool {
+    const auto file = MappedFile::open(path);
+    if (!file) return false;
+    return decode_state(cpu, file->bytes(), base);
+}
+} // namespace mos6502
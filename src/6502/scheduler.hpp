@@ -0,0 +1,207 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "6502.hpp"
+#include "fusion.hpp"
+
+namespace mos6502 {
+using EventFunc = void (*)(void *ctx, CPU &cpu);
+using EventId = uint64_t;
+
+inline constexpr uint64_t no_event = std::numeric_limits<uint64_t>::max();
+
+enum class EventKind {
+    callback,
+    irq_assert,
+    irq_release,
+    nmi_assert,
+    nmi_release,
+};
+
+struct ScheduledEvent {
+    uint64_t cycle = 0;
+    EventId id = 0; // Also the tie breaker, events due on the same cycle run in scheduling order
+    EventKind kind = EventKind::callback;
+    EventFunc func = nullptr;
+    void *ctx = nullptr;
+    Byte irq_mask = 0x00;
+};
+
+// Min-heap of cycle timestamped events. Devices schedule their next interesting moment
+// (timer underflow, sample boundary, ...) instead of being polled every tick, and the CPU
+// runs uninterrupted in between. Cancelling is lazy, cancelled ids are skipped when popped.
+class Scheduler {
+public:
+    auto schedule(uint64_t cycle, EventFunc func, void *ctx) -> EventId {
+        return push({.cycle = cycle, .kind = EventKind::callback, .func = func, .ctx = ctx});
+    }
+
+    auto schedule_irq(uint64_t cycle, Byte source_mask, bool asserted) -> EventId {
+        return push({.cycle = cycle, .kind = asserted ? EventKind::irq_assert : EventKind::irq_release, .irq_mask = source_mask});
+    }
+
+    auto schedule_nmi(uint64_t cycle, bool asserted) -> EventId {
+        return push({.cycle = cycle, .kind = asserted ? EventKind::nmi_assert : EventKind::nmi_release});
+    }
+
+    // Ignores ids that already fired or were never handed out
+    auto cancel(EventId id) -> void {
+        const bool pending = std::any_of(m_heap.begin(), m_heap.end(), [&](const ScheduledEvent &e) { return e.id == id; });
+        if (pending && std::find(m_cancelled.begin(), m_cancelled.end(), id) == m_cancelled.end()) {
+            m_cancelled.push_back(id);
+        }
+    }
+
+    [[nodiscard]] auto next_cycle() -> uint64_t {
+        drop_cancelled_front();
+        return m_heap.empty() ? no_event : m_heap.front().cycle;
+    }
+
+    [[nodiscard]] auto empty() -> bool { return next_cycle() == no_event; }
+    [[nodiscard]] auto size() const -> size_t { return m_heap.size(); }
+
+    // Runs every event due at or before cpu.cycles, events scheduled by callbacks for
+    // the current cycle still run in this call
+    auto dispatch_due(CPU &cpu) -> void {
+        while (next_cycle() <= cpu.cycles) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), later);
+            const ScheduledEvent event = m_heap.back();
+            m_heap.pop_back();
+            fire(event, cpu);
+        }
+    }
+
+    auto clear() -> void {
+        m_heap.clear();
+        m_cancelled.clear();
+    }
+
+private:
+    std::vector<ScheduledEvent> m_heap;
+    std::vector<EventId> m_cancelled; // Small, only holds ids that are still inside the heap
+    EventId m_next_id = 1;
+
+    [[nodiscard]] static auto later(const ScheduledEvent &a, const ScheduledEvent &b) -> bool {
+        return a.cycle != b.cycle ? a.cycle > b.cycle : a.id > b.id;
+    }
+
+    auto push(ScheduledEvent event) -> EventId {
+        event.id = m_next_id++;
+        m_heap.push_back(event);
+        std::push_heap(m_heap.begin(), m_heap.end(), later);
+        return event.id;
+    }
+
+    auto drop_cancelled_front() -> void {
+        while (!m_heap.empty() && !m_cancelled.empty()) {
+            auto it = std::find(m_cancelled.begin(), m_cancelled.end(), m_heap.front().id);
+            if (it == m_cancelled.end()) return;
+            *it = m_cancelled.back();
+            m_cancelled.pop_back();
+            std::pop_heap(m_heap.begin(), m_heap.end(), later);
+            m_heap.pop_back();
+        }
+    }
+
+    static auto fire(const ScheduledEvent &event, CPU &cpu) -> void {
+        switch (event.kind) {
+        case EventKind::callback:
+            event.func(event.ctx, cpu);
+            break;
+        case EventKind::irq_assert:
+            set_irq(cpu, event.irq_mask, true);
+            break;
+        case EventKind::irq_release:
+            set_irq(cpu, event.irq_mask, false);
+            break;
+        case EventKind::nmi_assert:
+            set_nmi(cpu, true);
+            break;
+        case EventKind::nmi_release:
+            set_nmi(cpu, false);
+            break;
+        default:
+            assert(false);
+        }
+    }
+};
+
+inline constexpr uint64_t idle_loop_max_cycles = 256; // Longest loop iteration considered
+
+// Recognises loops like `wait: lda flag / beq wait` or `jmp *`. Whenever control jumps
+// backwards the loop head and state are recorded. If the head is reached again within
+// idle_loop_max_cycles with the same registers, no write or device read in between and no
+// interrupt pending, the iteration only read RAM that nothing changed. Every further iteration
+// is then identical until something outside the CPU acts, which can only happen at a scheduled
+// event, so whole iterations up to the next event can be skipped by advancing cpu.cycles.
+class IdleLoopDetector {
+public:
+    // Call at instruction boundaries after a backward jump, returns the cycles skipped
+    auto check(CPU &cpu, uint64_t stop) -> uint64_t {
+        if (m_armed && cpu.PC == m_head && same_state(cpu)) {
+            const uint64_t period = cpu.cycles - m_start;
+            if (period > 0 && period <= idle_loop_max_cycles && !interrupt_pending(cpu)) {
+                const uint64_t skipped = (stop - cpu.cycles) / period * period;
+                cpu.cycles += skipped;
+                m_start = cpu.cycles;
+                return skipped;
+            }
+        }
+        m_armed = true;
+        m_head = cpu.PC;
+        m_start = cpu.cycles;
+        m_registers = registers(cpu);
+        m_side_effects = cpu.side_effects;
+        return 0;
+    }
+
+private:
+    bool m_armed = false;
+    Address m_head = 0x0000;
+    uint64_t m_start = 0;
+    uint64_t m_registers = 0;
+    uint64_t m_side_effects = 0;
+
+    [[nodiscard]] static auto registers(const CPU &cpu) -> uint64_t {
+        return static_cast<uint64_t>(cpu.A) | (static_cast<uint64_t>(cpu.X) << 8) | (static_cast<uint64_t>(cpu.Y) << 16) |
+               (static_cast<uint64_t>(cpu.SP) << 24) | (static_cast<uint64_t>(cpu.P) << 32);
+    }
+
+    [[nodiscard]] auto same_state(const CPU &cpu) const -> bool {
+        return registers(cpu) == m_registers && cpu.side_effects == m_side_effects;
+    }
+};
+
+// Ticks the CPU up to `target` cycles, stopping only to dispatch events as they become due.
+// Returns how many of those cycles were fast-forwarded through idle loops.
+template <Variant V>
+inline auto run_until(CPU &cpu, Scheduler &scheduler, uint64_t target) -> uint64_t {
+    uint64_t skipped = 0;
+    scheduler.dispatch_due(cpu);
+    while (cpu.cycles < target) {
+        const uint64_t stop = std::min(target, scheduler.next_cycle());
+        IdleLoopDetector idle; // Fresh per stretch, events may change state behind the CPU's back
+        while (cpu.cycles < stop) {
+            const bool whole = cpu.instr_counter == 0 && cpu.config.hybrid_execution &&
+                               cpu.cycles + fused_max_cycles <= stop && run_instruction_level<V>(cpu);
+            if (!whole) tick<V>(cpu);
+            // A finished instruction that left PC at or before itself jumped backwards
+            if (cpu.instr_counter == 0 && cpu.PC <= cpu.instr_addr && cpu.config.fast_forward_idle_loops) {
+                skipped += idle.check(cpu, stop);
+            }
+        }
+        scheduler.dispatch_due(cpu);
+    }
+    return skipped;
+}
+
+inline auto run_until(CPU &cpu, Scheduler &scheduler, uint64_t target) -> uint64_t {
+    return with_variant(cpu.variant, [&](auto v) { return run_until<decltype(v)::value>(cpu, scheduler, target); });
+}
+} // namespace mos6502
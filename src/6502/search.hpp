@@ -0,0 +1,203 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "6502.hpp"
+#include "save_state.hpp"
+
+namespace mos6502 {
+// "Run until condition" over the past. While running, the history keeps a save state every
+// `interval` cycles. A search replays the stretches between consecutive checkpoints on worker
+// threads, each one checking the condition before every instruction and stopping at the first
+// hit. The earliest stretch with a hit wins, so the answer is the exact first instruction
+// boundary where the condition holds, not just the checkpoint after it.
+//
+// Replays tick one instruction at a time (no fused pairs, no idle fast-forward) on private
+// copies of the CPU. That needs a CPU without devices: their state lives outside the CPU, and
+// the copies would share it.
+
+struct Condition {
+    enum class Kind : Byte {
+        pc_equals, // addr is the target
+        mem_equals,
+        mem_not_equals,
+        a_equals,
+        x_equals,
+        y_equals,
+        count,
+    };
+
+    Kind kind = Kind::mem_equals;
+    Address addr = 0x0000;
+    Byte value = 0x00;
+
+    [[nodiscard]] auto holds(const CPU &cpu) const -> bool {
+        switch (kind) {
+        case Kind::pc_equals: return cpu.PC == addr;
+        case Kind::mem_equals: return peek(cpu, addr) == value;
+        case Kind::mem_not_equals: return peek(cpu, addr) != value;
+        case Kind::a_equals: return cpu.A == value;
+        case Kind::x_equals: return cpu.X == value;
+        case Kind::y_equals: return cpu.Y == value;
+        case Kind::count: break;
+        }
+        return false;
+    }
+};
+
+inline constexpr std::array<const char *, static_cast<size_t>(Condition::Kind::count)> condition_names = {
+    "PC == addr",
+    "mem[addr] == value",
+    "mem[addr] != value",
+    "A == value",
+    "X == value",
+    "Y == value",
+};
+
+[[nodiscard]] inline auto searchable(const CPU &cpu) -> bool {
+    return std::ranges::all_of(cpu.devices, [](const Device *device) { return device == nullptr; });
+}
+
+struct Checkpoint {
+    uint64_t cycle = 0;
+    std::shared_ptr<const std::vector<Byte>> state; // encode_state, shared with running searches
+};
+
+class History {
+public:
+    static constexpr size_t max_checkpoints = 512;
+
+    explicit History(uint64_t interval) : m_interval(std::max<uint64_t>(interval, 1)) {}
+
+    // Called after every batch, takes a checkpoint once interval cycles passed since the last
+    auto record(const CPU &cpu) -> void {
+        if (!m_checkpoints.empty() && cpu.cycles < m_checkpoints.back().cycle + m_interval) return;
+        auto state = std::make_shared<std::vector<Byte>>();
+        encode_state(cpu, *state);
+        m_bytes += state->size();
+        m_checkpoints.push_back({.cycle = cpu.cycles, .state = std::move(state)});
+        if (m_checkpoints.size() >= max_checkpoints) thin();
+    }
+
+    // Drops the checkpoints after cycle, once the CPU went back to it
+    auto truncate(uint64_t cycle) -> void {
+        while (!m_checkpoints.empty() && m_checkpoints.back().cycle > cycle) {
+            m_bytes -= m_checkpoints.back().state->size();
+            m_checkpoints.pop_back();
+        }
+    }
+
+    auto clear() -> void {
+        m_checkpoints.clear();
+        m_bytes = 0;
+    }
+
+    [[nodiscard]] auto checkpoints() const -> const std::vector<Checkpoint> & { return m_checkpoints; }
+    [[nodiscard]] auto interval() const -> uint64_t { return m_interval; }
+    [[nodiscard]] auto bytes() const -> size_t { return m_bytes; }
+
+private:
+    uint64_t m_interval;
+    std::vector<Checkpoint> m_checkpoints;
+    size_t m_bytes = 0;
+
+    // Keeps every other checkpoint and doubles the interval, so the history still reaches back
+    // to the start of the run with bounded memory, only with coarser stretches
+    auto thin() -> void {
+        size_t kept = 0;
+        m_bytes = 0;
+        for (size_t i = 0; i < m_checkpoints.size(); i += 2) {
+            m_bytes += m_checkpoints[i].state->size();
+            m_checkpoints[kept++] = std::move(m_checkpoints[i]);
+        }
+        m_checkpoints.resize(kept);
+        m_interval *= 2;
+    }
+};
+
+struct SearchResult {
+    std::unique_ptr<CPU> cpu; // At the first boundary where the condition held, nullptr if it never did
+    uint64_t replayed_cycles = 0;
+    double seconds = 0.0;
+};
+
+namespace search_detail {
+inline constexpr size_t none = SIZE_MAX;
+inline constexpr uint64_t cancel_check_mask = 0xFFFF; // Instructions between looks at the other workers
+
+// Replays from the restored checkpoint until stop, checking before every instruction that
+// starts before stop. Gives up once an earlier stretch has a hit, nothing here can win then.
+template <Variant V, typename Predicate>
+inline auto replay(CPU &cpu, uint64_t stop, const Predicate &holds, const std::atomic<size_t> &first_hit, size_t stretch) -> bool {
+    while (cpu.instr_counter != 0 && cpu.cycles < stop) tick<V>(cpu); // Checkpoints may sit mid instruction
+    for (uint64_t executed = 0; cpu.cycles < stop; ++executed) {
+        if (holds(cpu)) return true;
+        do {
+            tick<V>(cpu);
+        } while (cpu.instr_counter != 0);
+        if ((executed & cancel_check_mask) == 0 && first_hit.load(std::memory_order_relaxed) < stretch) return false;
+    }
+    return false;
+}
+} // namespace search_detail
+
+// Finds the first instruction boundary from checkpoints.front() up to end_cycle (inclusive)
+// where holds(cpu) is true. wiring supplies everything a save state does not carry (ROM pages,
+// config) and must be searchable(). Stretch i runs from checkpoint i to checkpoint i + 1 and
+// workers take them in order, so once a hit is known every stretch after it is skipped.
+template <typename Predicate>
+[[nodiscard]] inline auto search_first(const CPU &wiring, std::span<const Checkpoint> checkpoints, uint64_t end_cycle,
+    const Predicate &holds, unsigned threads) -> SearchResult {
+    using namespace search_detail;
+    assert(searchable(wiring));
+    const auto start = std::chrono::steady_clock::now();
+    const size_t stretches = checkpoints.size();
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> first_hit = none;
+    std::atomic<uint64_t> replayed = 0;
+    std::vector<std::unique_ptr<CPU>> hits(stretches);
+
+    const auto worker = [&] {
+        auto cpu = std::make_unique<CPU>(wiring);
+        cpu->call_observer = nullptr; // Observers and logs belong to the live CPU
+        cpu->instrumentation = {};
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < stretches;) {
+            if (first_hit.load(std::memory_order_relaxed) < i) break;
+            if (!decode_state(*cpu, *checkpoints[i].state)) continue;
+            const uint64_t begin = cpu->cycles;
+            const uint64_t stop = i + 1 < stretches ? checkpoints[i + 1].cycle : end_cycle + 1;
+            const bool hit = with_variant(cpu->variant,
+                [&](auto v) { return replay<decltype(v)::value>(*cpu, stop, holds, first_hit, i); });
+            replayed.fetch_add(cpu->cycles - begin, std::memory_order_relaxed);
+            if (!hit) continue;
+            hits[i] = std::make_unique<CPU>(*cpu);
+            size_t seen = first_hit.load(std::memory_order_relaxed);
+            while (i < seen && !first_hit.compare_exchange_weak(seen, i, std::memory_order_relaxed)) {}
+        }
+    };
+
+    threads = std::clamp<unsigned>(threads, 1, static_cast<unsigned>(std::max<size_t>(stretches, 1)));
+    if (threads == 1) {
+        worker();
+    } else {
+        std::vector<std::jthread> pool;
+        pool.reserve(threads);
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+    }
+
+    SearchResult result;
+    if (const size_t i = first_hit.load(); i != none) result.cpu = std::move(hits[i]);
+    result.replayed_cycles = replayed.load();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+} // namespace mos6502
@@ -0,0 +1,113 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "6502.hpp"
+#include "scheduler.hpp"
+
+namespace mos6502 {
+struct HashLogEntry {
+    uint64_t cycle = 0;
+    Address pc = 0x0000;
+    uint64_t hash = 0;
+
+    auto operator==(const HashLogEntry &) const -> bool = default;
+};
+
+// Records state_hash at the first instruction boundary at or after every multiple of
+// `interval` cycles within [from, until]. Two runs logged with the same settings diverge
+// between the last matching entry and the first differing one; logging that window again
+// with interval 1 (every instruction) pins down the first divergent instruction.
+class HashLog {
+public:
+    explicit HashLog(uint64_t interval, uint64_t from = 0, uint64_t until = no_event)
+        : m_interval(interval > 0 ? interval : 1), m_from(from), m_until(until) {}
+
+    auto start(CPU &cpu, Scheduler &scheduler) -> void {
+        m_scheduler = &scheduler;
+        schedule_after(cpu.cycles > 0 ? cpu.cycles - 1 : 0);
+    }
+
+    // The CPU went back in time (step back, loaded state): entries from its cycle on are dropped
+    // and logging continues from there
+    auto rewind(const CPU &cpu) -> void {
+        std::erase_if(m_entries, [&](const HashLogEntry &e) { return e.cycle >= cpu.cycles; });
+        m_scheduler->cancel(m_event);
+        schedule_after(cpu.cycles > 0 ? cpu.cycles - 1 : 0);
+    }
+
+    [[nodiscard]] auto entries() const -> const std::vector<HashLogEntry> & { return m_entries; }
+
+private:
+    uint64_t m_interval;
+    uint64_t m_from;
+    uint64_t m_until;
+    Scheduler *m_scheduler = nullptr;
+    EventId m_event = 0;
+    std::vector<HashLogEntry> m_entries;
+
+    // Next multiple of the interval strictly after `cycle`, clamped into the logged range
+    auto schedule_after(uint64_t cycle) -> void {
+        const uint64_t next = std::max(m_from, (cycle / m_interval + 1) * m_interval);
+        if (next <= m_until) m_event = m_scheduler->schedule(next, on_event, this);
+    }
+
+    static auto on_event(void *ctx, CPU &cpu) -> void {
+        auto &log = *static_cast<HashLog *>(ctx);
+        if (cpu.instr_counter != 0) { // Mid instruction, retry on the next cycle
+            log.m_event = log.m_scheduler->schedule(cpu.cycles + 1, on_event, ctx);
+            return;
+        }
+        log.m_entries.push_back({.cycle = cpu.cycles, .pc = cpu.PC, .hash = state_hash(cpu)});
+        log.schedule_after(cpu.cycles);
+    }
+};
+
+// One "cycle pc hash" line per entry, hex except for the cycle, so logs diff well as text
+inline auto write_hash_log(const std::string &path, const std::vector<HashLogEntry> &entries) -> bool {
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) return false;
+    for (const auto &e : entries) {
+        std::fprintf(file, "%" PRIu64 " %04X %016" PRIX64 "\n", e.cycle, e.pc, e.hash);
+    }
+    return std::fclose(file) == 0;
+}
+
+[[nodiscard]] inline auto read_hash_log(const std::string &path) -> std::optional<std::vector<HashLogEntry>> {
+    std::FILE *file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) return std::nullopt;
+    std::vector<HashLogEntry> entries;
+    HashLogEntry e;
+    unsigned pc = 0;
+    while (std::fscanf(file, "%" SCNu64 " %X %" SCNx64, &e.cycle, &pc, &e.hash) == 3) {
+        e.pc = static_cast<Address>(pc);
+        entries.push_back(e);
+    }
+    const bool ok = std::feof(file) != 0;
+    std::fclose(file);
+    if (!ok) return std::nullopt;
+    return entries;
+}
+
+struct Divergence {
+    size_t index = 0;             // First entry that differs (or is missing from the shorter log)
+    uint64_t last_equal_cycle = 0; // 0 when the very first entry already differs
+};
+
+// Entries are compared in order, a differing cycle counts as divergence as well
+[[nodiscard]] inline auto first_divergence(const std::vector<HashLogEntry> &a, const std::vector<HashLogEntry> &b)
+    -> std::optional<Divergence> {
+    const size_t common = std::min(a.size(), b.size());
+    for (size_t i = 0; i < common; ++i) {
+        if (a[i] != b[i]) return Divergence{.index = i, .last_equal_cycle = i > 0 ? a[i - 1].cycle : 0};
+    }
+    if (a.size() == b.size()) return std::nullopt;
+    return Divergence{.index = common, .last_equal_cycle = common > 0 ? a[common - 1].cycle : 0};
+}
+} // namespace mos6502
@@ -0,0 +1,167 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "6502.hpp"
+#include "scheduler.hpp"
+
+namespace mos6502 {
+// Several CPUs on one board, each with its own memory, devices and scheduler, talking through
+// regions of RAM mapped into more than one of them. Every CPU runs on its own host thread.
+//
+// Shared accesses are ordered by (cycle, CPU index), the order a cycle-stepped single thread
+// running the CPUs round robin would produce, so results do not depend on host scheduling.
+// Each CPU publishes a horizon: no shared access of its own sorts before it. An access at
+// (cycle, i) first moves its own horizon there, then waits until every other horizon lies
+// beyond it (a conservative barrier). The horizon stays at the access until the CPU publishes
+// again, every cycle makes one bus access so its next one sorts after it anyway. Between
+// accesses a running CPU moves its horizon forward once per quantum, a larger quantum syncs
+// less often but lets a waiting CPU stall longer.
+//
+// Only shared regions may connect CPUs: interrupt lines, devices and schedulers stay private.
+
+inline constexpr uint64_t default_quantum = 64;
+
+class System;
+
+// Bytes visible to several CPUs, possibly at different addresses. Whole pages only.
+struct SharedRegion {
+    std::vector<Byte> bytes;
+};
+
+// A shared region as a device on one CPU's bus
+class SharedPort final : public Device {
+public:
+    SharedPort(System &system, size_t index, SharedRegion &region, Address base)
+        : m_system(system), m_index(index), m_region(region), m_base(base) {}
+
+    auto read(CPU &cpu, Address addr) -> Byte override;
+    auto write(CPU &cpu, Address addr, Byte value) -> void override;
+    // Only consistent while the system is stopped
+    [[nodiscard]] auto peek(const CPU & /*cpu*/, Address addr) const -> Byte override { return m_region.bytes[offset(addr)]; }
+
+private:
+    System &m_system;
+    size_t m_index;
+    SharedRegion &m_region;
+    Address m_base;
+
+    [[nodiscard]] auto offset(Address addr) const -> size_t { return static_cast<size_t>(addr - m_base); }
+};
+
+class System {
+public:
+    static constexpr size_t max_cpus = 255; // Index shares the ordering key with the cycle
+
+    explicit System(uint64_t quantum = default_quantum) : m_quantum(std::max<uint64_t>(quantum, 1)) {}
+
+    System(const System &) = delete;
+    auto operator=(const System &) -> System & = delete;
+
+    auto add_cpu(Variant variant = Variant::nmos) -> size_t {
+        assert(m_nodes.size() < max_cpus);
+        m_nodes.push_back(std::make_unique<Node>());
+        m_nodes.back()->cpu.variant = variant;
+        return m_nodes.size() - 1;
+    }
+
+    auto add_shared_region(size_t size) -> SharedRegion & {
+        assert(size > 0 && size % 0x100 == 0);
+        m_regions.push_back(std::make_unique<SharedRegion>());
+        m_regions.back()->bytes.assign(size, 0x00);
+        return *m_regions.back();
+    }
+
+    // Maps all of region at base into one CPU's address space
+    auto map_shared(size_t index, SharedRegion &region, Address base) -> void {
+        assert((base & 0xFF) == 0 && base + region.bytes.size() <= 0x10000);
+        m_ports.push_back(std::make_unique<SharedPort>(*this, index, region, base));
+        attach_device(cpu(index), *m_ports.back(), base, static_cast<Address>(base + region.bytes.size() - 1));
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return m_nodes.size(); }
+    [[nodiscard]] auto cpu(size_t index) -> CPU & { return m_nodes[index]->cpu; }
+    [[nodiscard]] auto scheduler(size_t index) -> Scheduler & { return m_nodes[index]->scheduler; }
+    [[nodiscard]] auto regions() const -> const std::vector<std::unique_ptr<SharedRegion>> & { return m_regions; }
+
+    // Runs every CPU up to target cycles, returns once all of them got there
+    auto run_until(uint64_t target) -> void {
+        m_horizons = std::make_unique<Horizon[]>(m_nodes.size());
+        for (size_t i = 0; i < m_nodes.size(); ++i) publish(i, m_nodes[i]->cpu.cycles + 1);
+        if (m_nodes.size() == 1) {
+            run_node(0, target);
+            return;
+        }
+        std::vector<std::jthread> threads;
+        threads.reserve(m_nodes.size());
+        for (size_t i = 0; i < m_nodes.size(); ++i) threads.emplace_back([this, i, target] { run_node(i, target); });
+    }
+
+private:
+    friend class SharedPort;
+
+    struct Node {
+        CPU cpu;
+        Scheduler scheduler;
+    };
+
+    struct alignas(64) Horizon {
+        std::atomic<uint64_t> key = 0;
+    };
+
+    static constexpr uint64_t finished = UINT64_MAX;
+
+    uint64_t m_quantum;
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    std::vector<std::unique_ptr<SharedRegion>> m_regions;
+    std::vector<std::unique_ptr<SharedPort>> m_ports;
+    std::unique_ptr<Horizon[]> m_horizons;
+
+    [[nodiscard]] static constexpr auto order_key(uint64_t cycle, size_t index) -> uint64_t {
+        return (cycle << 8) | index;
+    }
+
+    auto publish(size_t index, uint64_t cycle) -> void {
+        m_horizons[index].key.store(order_key(cycle, index), std::memory_order_release);
+    }
+
+    auto run_node(size_t index, uint64_t target) -> void {
+        Node &node = *m_nodes[index];
+        while (node.cpu.cycles < target) {
+            publish(index, node.cpu.cycles + 1);
+            mos6502::run_until(node.cpu, node.scheduler, std::min(target, node.cpu.cycles + m_quantum));
+        }
+        m_horizons[index].key.store(finished, std::memory_order_release); // Later accesses belong to the next run
+    }
+
+    // Blocks until no other CPU can still make a shared access sorting before (cycle, index).
+    // The acquire loads also make every earlier access of the others visible here.
+    auto barrier(size_t index, uint64_t cycle) -> void {
+        const uint64_t key = order_key(cycle, index);
+        m_horizons[index].key.store(key, std::memory_order_release); // Others may be waiting on us, release our earlier accesses
+        for (size_t j = 0; j < m_nodes.size(); ++j) {
+            if (j == index) continue;
+            for (unsigned spins = 0; m_horizons[j].key.load(std::memory_order_acquire) < key; ++spins) {
+                if (spins >= 64) std::this_thread::yield(); // More CPUs than host cores, let the others run
+            }
+        }
+    }
+};
+
+inline auto SharedPort::read(CPU &cpu, Address addr) -> Byte {
+    m_system.barrier(m_index, cpu.cycles);
+    return m_region.bytes[offset(addr)];
+}
+
+inline auto SharedPort::write(CPU &cpu, Address addr, Byte value) -> void {
+    m_system.barrier(m_index, cpu.cycles);
+    m_region.bytes[offset(addr)] = value;
+}
+} // namespace mos6502
@@ -0,0 +1,166 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "6502.hpp"
+
+namespace mos6502 {
+/*
+ * Memory mapped tone generator with an 8 bit DAC.
+ *
+ *   +0  period low     square / noise half period is (period + 1) * 8 cycles
+ *   +1  period high
+ *   +2  volume         0 - 255
+ *   +3  control        bit 0 oscillator on, bit 1 noise instead of square, bit 2 output the DAC
+ *   +4  dac            unsigned sample, $80 is silence
+ *
+ * Writes only log (cycle, register, value). render() replays that log against the cycle
+ * axis and box filters the output into PCM, so the waveform is cycle exact no matter how
+ * the emulation is scheduled against wall time, and the CPU never waits on audio.
+ */
+class ToneDevice : public Device {
+public:
+    enum Register : Byte {
+        period_lo = 0x0,
+        period_hi = 0x1,
+        volume = 0x2,
+        control = 0x3,
+        dac = 0x4,
+    };
+    static constexpr size_t register_count = 5;
+
+    static constexpr Byte control_enable = 0x01;
+    static constexpr Byte control_noise = 0x02;
+    static constexpr Byte control_dac = 0x04;
+
+    auto attach(CPU &cpu, Address first, Address last) -> void { attach_device(cpu, *this, first, last); }
+
+    auto read(CPU &cpu, Address addr) -> Byte override { return peek(cpu, addr); }
+
+    auto write(CPU &cpu, Address addr, Byte value) -> void override {
+        const Byte reg = addr & 0x0F;
+        if (reg >= register_count) return;
+        m_registers[reg] = value;
+        m_log.push_back({.cycle = cpu.cycles, .reg = reg, .value = value});
+    }
+
+    [[nodiscard]] auto peek(const CPU & /*cpu*/, Address addr) const -> Byte override {
+        const Byte reg = addr & 0x0F;
+        return reg < register_count ? m_registers[reg] : 0xFF;
+    }
+
+    // Appends every sample that ends at or before `until`, cycles_per_sample may be fractional
+    // and change between calls (rate control). Returns the number of samples appended.
+    auto render(uint64_t until, double cycles_per_sample, std::vector<int16_t> &out) -> size_t {
+        const auto end = static_cast<double>(until);
+        if (m_position < 0.0 || end < m_position - cycles_per_sample) {
+            resync(until); // First call or the CPU was rewound (snapshot, save state)
+        }
+
+        size_t event = 0;
+        size_t count = 0;
+        while (m_position + cycles_per_sample <= end) {
+            const double sample_end = m_position + cycles_per_sample;
+            double t = m_position;
+            double sum = 0.0;
+            while (t < sample_end) {
+                while (event < m_log.size() && static_cast<double>(m_log[event].cycle) <= t) {
+                    apply(m_log[event++]);
+                }
+                double segment_end = sample_end;
+                if (event < m_log.size()) segment_end = std::min(segment_end, static_cast<double>(m_log[event].cycle));
+                if (oscillating()) segment_end = std::min(segment_end, t + m_until_toggle);
+
+                const double length = segment_end - t;
+                sum += level() * length;
+                if (oscillating()) {
+                    m_until_toggle -= length;
+                    if (m_until_toggle <= 0.0) toggle();
+                }
+                t = segment_end;
+            }
+            out.push_back(static_cast<int16_t>(std::clamp(sum / cycles_per_sample, -1.0, 1.0) * max_amplitude));
+            m_position = sample_end;
+            ++count;
+        }
+
+        m_log.erase(m_log.begin(), m_log.begin() + static_cast<std::ptrdiff_t>(event));
+        return count;
+    }
+
+    auto save_state(std::vector<Byte> &out) const -> void override {
+        out.insert(out.end(), m_registers.begin(), m_registers.end());
+    }
+
+    auto load_state(CPU &cpu, std::span<const Byte> state) -> bool override {
+        if (state.size() != register_count) return false;
+        std::copy(state.begin(), state.end(), m_registers.begin());
+        resync(cpu.cycles);
+        return true;
+    }
+
+private:
+    struct Write {
+        uint64_t cycle;
+        Byte reg;
+        Byte value;
+    };
+
+    static constexpr double max_amplitude = 0.25 * 32767.0; // Leaves headroom, full scale squares are harsh
+
+    std::array<Byte, register_count> m_registers = {0x00, 0x00, 0x00, 0x00, 0x80}; // As seen by the CPU
+    std::vector<Write> m_log;
+
+    // Render side, lags behind the CPU by up to a frame
+    std::array<Byte, register_count> m_applied = {0x00, 0x00, 0x00, 0x00, 0x80};
+    double m_position = -1.0; // Cycle the next sample starts on
+    double m_until_toggle = 0.0;
+    bool m_high = false;
+    uint16_t m_lfsr = 0x4000;
+
+    [[nodiscard]] auto half_period() const -> double {
+        return (static_cast<double>(m_applied[period_lo] | (m_applied[period_hi] << 8)) + 1.0) * 8.0;
+    }
+
+    [[nodiscard]] auto oscillating() const -> bool {
+        return (m_applied[control] & control_enable) && !(m_applied[control] & control_dac);
+    }
+
+    [[nodiscard]] auto level() const -> double {
+        const double gain = m_applied[volume] / 255.0;
+        if (m_applied[control] & control_dac) return (m_applied[dac] - 128.0) / 128.0 * gain;
+        if (!(m_applied[control] & control_enable)) return 0.0;
+        return (m_high ? 1.0 : -1.0) * gain;
+    }
+
+    auto toggle() -> void {
+        if (m_applied[control] & control_noise) {
+            const auto bit = static_cast<uint16_t>((m_lfsr ^ (m_lfsr >> 1)) & 1);
+            m_lfsr = static_cast<uint16_t>((m_lfsr >> 1) | (bit << 14));
+            m_high = m_lfsr & 1;
+        } else {
+            m_high = !m_high;
+        }
+        m_until_toggle += half_period();
+        if (m_until_toggle <= 0.0) m_until_toggle = half_period(); // Period shortened mid wave
+    }
+
+    auto apply(const Write &w) -> void {
+        const bool was_oscillating = oscillating();
+        m_applied[w.reg] = w.value;
+        if (!was_oscillating && oscillating()) m_until_toggle = half_period();
+    }
+
+    auto resync(uint64_t cycle) -> void {
+        m_log.clear();
+        m_applied = m_registers;
+        m_position = static_cast<double>(cycle);
+        m_until_toggle = half_period();
+    }
+};
+} // namespace mos6502
@@ -0,0 +1,447 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "6502.hpp"
+#include "scheduler.hpp"
+
+namespace mos6502 {
+/*
+ * 6522 VIA. Nothing is clocked per tick: the timers and the shift register are kept as
+ * "cycle of the next event" timestamps and caught up from cpu.cycles whenever a register
+ * is accessed. The only periodic work is one scheduler event per underflow / finished
+ * shift that can actually raise IRQ (source enabled in IER), which syncs and updates the line.
+ *
+ * Not emulated: T2 pulse counting on PB6, CB1 clocked shifting and the CA2/CB2
+ * handshake outputs. The corresponding counters simply hold still.
+ */
+class Via : public Device {
+public:
+    enum Register : Byte {
+        orb = 0x0,
+        ora = 0x1,
+        ddrb = 0x2,
+        ddra = 0x3,
+        t1c_l = 0x4,
+        t1c_h = 0x5,
+        t1l_l = 0x6,
+        t1l_h = 0x7,
+        t2c_l = 0x8,
+        t2c_h = 0x9,
+        sr = 0xA,
+        acr = 0xB,
+        pcr = 0xC,
+        ifr = 0xD,
+        ier = 0xE,
+        ora_no_handshake = 0xF,
+    };
+
+    // IFR / IER bits
+    static constexpr Byte irq_ca2 = 0x01;
+    static constexpr Byte irq_ca1 = 0x02;
+    static constexpr Byte irq_sr = 0x04;
+    static constexpr Byte irq_cb2 = 0x08;
+    static constexpr Byte irq_cb1 = 0x10;
+    static constexpr Byte irq_t2 = 0x20;
+    static constexpr Byte irq_t1 = 0x40;
+
+    // irq_source is the bit this VIA owns in cpu.irq_sources
+    Via(Scheduler &scheduler, Byte irq_source)
+        : m_scheduler(scheduler), m_irq_source(irq_source) {}
+
+    // Devices map whole pages, the 16 registers repeat throughout them
+    auto attach(CPU &cpu, Address first, Address last) -> void { attach_device(cpu, *this, first, last); }
+
+    auto read(CPU &cpu, Address addr) -> Byte override {
+        catch_up(cpu.cycles);
+        const auto reg = static_cast<Register>(addr & 0x0F);
+        const Byte value = register_value(reg);
+        switch (reg) {
+        case orb:
+            clear_flags(irq_cb1 | irq_cb2);
+            break;
+        case ora:
+            clear_flags(irq_ca1 | irq_ca2);
+            break;
+        case t1c_l:
+            clear_flags(irq_t1);
+            break;
+        case t2c_l:
+            clear_flags(irq_t2);
+            break;
+        case sr:
+            clear_flags(irq_sr);
+            start_shift(cpu.cycles);
+            break;
+        default:
+            break;
+        }
+        update(cpu);
+        return value;
+    }
+
+    auto write(CPU &cpu, Address addr, Byte value) -> void override {
+        const uint64_t now = cpu.cycles;
+        catch_up(now);
+        switch (static_cast<Register>(addr & 0x0F)) {
+        case orb:
+            m_orb = value;
+            clear_flags(irq_cb1 | irq_cb2);
+            break;
+        case ora:
+            m_ora = value;
+            clear_flags(irq_ca1 | irq_ca2);
+            break;
+        case ora_no_handshake:
+            m_ora = value;
+            break;
+        case ddrb:
+            m_ddrb = value;
+            break;
+        case ddra:
+            m_ddra = value;
+            break;
+        case t1c_l:
+        case t1l_l:
+            m_t1_latch = static_cast<uint16_t>((m_t1_latch & 0xFF00) | value);
+            break;
+        case t1l_h:
+            m_t1_latch = static_cast<uint16_t>((m_t1_latch & 0x00FF) | (value << 8));
+            clear_flags(irq_t1);
+            break;
+        case t1c_h:
+            // Counter reads the latch on the following cycle and underflows one cycle after reaching 0
+            m_t1_latch = static_cast<uint16_t>((m_t1_latch & 0x00FF) | (value << 8));
+            m_t1_underflow = now + m_t1_latch + 2;
+            m_t1_previous_underflow = 0;
+            m_t1_armed = true;
+            m_pb7 = false;
+            clear_flags(irq_t1);
+            break;
+        case t2c_l:
+            m_t2_latch_low = value;
+            break;
+        case t2c_h:
+            m_t2_value = static_cast<uint16_t>((value << 8) | m_t2_latch_low);
+            m_t2_cycle = now + 1;
+            m_t2_armed = true;
+            clear_flags(irq_t2);
+            break;
+        case sr:
+            m_sr = value;
+            clear_flags(irq_sr);
+            start_shift(now);
+            break;
+        case acr:
+            if (t2_counts_pulses() != ((value & 0x20) != 0)) {
+                m_t2_value = t2_value(now); // Freeze or resume the counter where it stands
+                m_t2_cycle = now;
+            }
+            m_acr = value;
+            break;
+        case pcr:
+            m_pcr = value;
+            break;
+        case ifr:
+            clear_flags(value);
+            break;
+        case ier:
+            if (value & 0x80) {
+                m_ier |= value & 0x7F;
+            } else {
+                m_ier &= static_cast<Byte>(~value);
+            }
+            break;
+        }
+        update(cpu);
+    }
+
+    [[nodiscard]] auto peek(const CPU &cpu, Address addr) const -> Byte override {
+        Via view = *this;
+        view.catch_up(cpu.cycles);
+        return view.register_value(static_cast<Register>(addr & 0x0F));
+    }
+
+    // Levels driven onto the port pins from outside, pins configured as outputs ignore them
+    auto set_port_a_input(Byte value) -> void { m_port_a_in = value; }
+    auto set_port_b_input(Byte value) -> void { m_port_b_in = value; }
+    [[nodiscard]] auto port_a_output() const -> Byte { return static_cast<Byte>((m_ora & m_ddra) | (m_port_a_in & ~m_ddra)); }
+    [[nodiscard]] auto port_b_output(const CPU &cpu) const -> Byte {
+        Via view = *this;
+        view.catch_up(cpu.cycles);
+        return view.register_value(orb);
+    }
+
+    // Control line inputs, the active edge is selected through PCR
+    auto set_ca1(CPU &cpu, bool level) -> void {
+        set_control_line(cpu, m_ca1, level, (m_pcr & 0x01) != 0, irq_ca1);
+    }
+    auto set_cb1(CPU &cpu, bool level) -> void {
+        set_control_line(cpu, m_cb1, level, (m_pcr & 0x10) != 0, irq_cb1);
+    }
+
+    auto save_state(std::vector<Byte> &out) const -> void override {
+        const auto put = [&](uint64_t value, int size) {
+            for (int i = 0; i < size; ++i) out.push_back(static_cast<Byte>(value >> (8 * i)));
+        };
+        for (Byte b : {m_ora, m_orb, m_ddra, m_ddrb, m_port_a_in, m_port_b_in, m_acr, m_pcr, m_ifr, m_ier,
+                 m_t2_latch_low, m_sr, m_sr_bits_left}) {
+            put(b, 1);
+        }
+        put(static_cast<uint64_t>(m_t1_armed | (m_t2_armed << 1) | (m_pb7 << 2) | (m_ca1 << 3) | (m_cb1 << 4)), 1);
+        put(m_t1_latch, 2);
+        put(m_t2_value, 2);
+        put(m_t1_underflow, 8);
+        put(m_t1_previous_underflow, 8);
+        put(m_t2_cycle, 8);
+        put(m_sr_cycle, 8);
+        put(m_synced_cycle, 8);
+    }
+
+    auto load_state(CPU &cpu, std::span<const Byte> state) -> bool override {
+        if (state.size() != state_size) return false;
+        size_t pos = 0;
+        const auto get = [&](int size) {
+            uint64_t value = 0;
+            for (int i = 0; i < size; ++i) value |= static_cast<uint64_t>(state[pos++]) << (8 * i);
+            return value;
+        };
+        for (Byte *b : {&m_ora, &m_orb, &m_ddra, &m_ddrb, &m_port_a_in, &m_port_b_in, &m_acr, &m_pcr, &m_ifr,
+                 &m_ier, &m_t2_latch_low, &m_sr, &m_sr_bits_left}) {
+            *b = static_cast<Byte>(get(1));
+        }
+        const auto bits = get(1);
+        m_t1_armed = bits & 0x01;
+        m_t2_armed = bits & 0x02;
+        m_pb7 = bits & 0x04;
+        m_ca1 = bits & 0x08;
+        m_cb1 = bits & 0x10;
+        m_t1_latch = static_cast<uint16_t>(get(2));
+        m_t2_value = static_cast<uint16_t>(get(2));
+        m_t1_underflow = get(8);
+        m_t1_previous_underflow = get(8);
+        m_t2_cycle = get(8);
+        m_sr_cycle = get(8);
+        m_synced_cycle = get(8);
+        // The pending event belongs to the replaced state, possibly to a later cycle
+        m_scheduler.cancel(m_event);
+        m_event = 0;
+        m_event_cycle = no_event;
+        update(cpu);
+        return true;
+    }
+
+private:
+    static constexpr size_t state_size = 13 + 1 + 2 + 2 + 5 * 8;
+
+    Scheduler &m_scheduler;
+    Byte m_irq_source;
+    EventId m_event = 0;
+    uint64_t m_event_cycle = no_event;
+
+    Byte m_ora = 0x00;
+    Byte m_orb = 0x00;
+    Byte m_ddra = 0x00;
+    Byte m_ddrb = 0x00;
+    Byte m_port_a_in = 0xFF; // Unconnected inputs float high
+    Byte m_port_b_in = 0xFF;
+    Byte m_acr = 0x00;
+    Byte m_pcr = 0x00;
+    Byte m_ifr = 0x00;
+    Byte m_ier = 0x00;
+    bool m_ca1 = false;
+    bool m_cb1 = false;
+
+    // Timer 1: the counter reads latch, ..., 0, $FFFF and reloads on the next cycle,
+    // so consecutive underflows are latch + 2 cycles apart. One-shot mode reloads too
+    // but only the first underflow after writing T1C-H sets the flag.
+    uint16_t m_t1_latch = 0xFFFF;
+    uint64_t m_t1_underflow = no_event; // Cycle on which the counter reads $FFFF next
+    uint64_t m_t1_previous_underflow = 0;
+    bool m_t1_armed = false;
+    bool m_pb7 = false;
+
+    // Timer 2 counts down from m_t2_value starting at m_t2_cycle and never reloads
+    Byte m_t2_latch_low = 0xFF;
+    uint16_t m_t2_value = 0xFFFF;
+    uint64_t m_t2_cycle = 0;
+    bool m_t2_armed = false;
+
+    Byte m_sr = 0x00;
+    Byte m_sr_bits_left = 0; // Of the current 8 bit transfer, 0 when idle
+    uint64_t m_sr_cycle = 0; // Cycle the next bit is shifted on
+
+    uint64_t m_synced_cycle = 0;
+
+    [[nodiscard]] auto t1_free_running() const -> bool { return (m_acr & 0x40) != 0; }
+    [[nodiscard]] auto t1_drives_pb7() const -> bool { return (m_acr & 0x80) != 0; }
+    [[nodiscard]] auto t2_counts_pulses() const -> bool { return (m_acr & 0x20) != 0; }
+    [[nodiscard]] auto shift_mode() const -> Byte { return static_cast<Byte>((m_acr >> 2) & 0x07); }
+    [[nodiscard]] auto shift_out() const -> bool { return (shift_mode() & 0x04) != 0; }
+
+    // Cycles per shifted bit, 0 for modes that do not shift on their own
+    [[nodiscard]] auto shift_period() const -> uint64_t {
+        switch (shift_mode()) {
+        case 1:
+        case 4:
+        case 5:
+            return 2 * (static_cast<uint64_t>(m_t2_latch_low) + 2); // CB1 toggles on each T2 low byte timeout
+        case 2:
+        case 6:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    [[nodiscard]] auto t1_period() const -> uint64_t { return static_cast<uint64_t>(m_t1_latch) + 2; }
+
+    [[nodiscard]] auto t1_value(uint64_t now) const -> uint16_t {
+        if (m_t1_underflow == no_event) return 0xFFFF;
+        if (now == m_t1_previous_underflow) return 0xFFFF;
+        return static_cast<uint16_t>(m_t1_underflow - now - 1);
+    }
+
+    [[nodiscard]] auto t2_value(uint64_t now) const -> uint16_t {
+        if (t2_counts_pulses() || now < m_t2_cycle) return m_t2_value;
+        return static_cast<uint16_t>(m_t2_value - (now - m_t2_cycle));
+    }
+
+    [[nodiscard]] auto t2_underflow() const -> uint64_t { return m_t2_cycle + m_t2_value + 1; }
+
+    [[nodiscard]] auto register_value(Register reg) const -> Byte {
+        switch (reg) {
+        case orb: {
+            Byte value = static_cast<Byte>((m_orb & m_ddrb) | (m_port_b_in & ~m_ddrb));
+            if (t1_drives_pb7()) value = static_cast<Byte>((value & 0x7F) | (m_pb7 << 7));
+            return value;
+        }
+        case ora:
+        case ora_no_handshake:
+            return port_a_output();
+        case ddrb:
+            return m_ddrb;
+        case ddra:
+            return m_ddra;
+        case t1c_l:
+            return static_cast<Byte>(t1_value(m_synced_cycle) & 0xFF);
+        case t1c_h:
+            return static_cast<Byte>(t1_value(m_synced_cycle) >> 8);
+        case t1l_l:
+            return static_cast<Byte>(m_t1_latch & 0xFF);
+        case t1l_h:
+            return static_cast<Byte>(m_t1_latch >> 8);
+        case t2c_l:
+            return static_cast<Byte>(t2_value(m_synced_cycle) & 0xFF);
+        case t2c_h:
+            return static_cast<Byte>(t2_value(m_synced_cycle) >> 8);
+        case sr:
+            return m_sr;
+        case acr:
+            return m_acr;
+        case pcr:
+            return m_pcr;
+        case ifr:
+            return static_cast<Byte>(m_ifr | ((m_ifr & m_ier & 0x7F) ? 0x80 : 0x00));
+        case ier:
+            return static_cast<Byte>(m_ier | 0x80);
+        }
+        return 0xFF;
+    }
+
+    auto clear_flags(Byte mask) -> void { m_ifr &= static_cast<Byte>(~mask & 0x7F); }
+
+    // Applies everything that happened between the last access and now in O(1)
+    auto catch_up(uint64_t now) -> void {
+        if (now < m_synced_cycle) return;
+        m_synced_cycle = now;
+
+        if (m_t1_underflow != no_event && now >= m_t1_underflow) {
+            const uint64_t period = t1_period();
+            const uint64_t count = (now - m_t1_underflow) / period + 1;
+            if (m_t1_armed || t1_free_running()) m_ifr |= irq_t1;
+            if (t1_free_running()) {
+                if (count % 2 == 1) m_pb7 = !m_pb7;
+            } else if (m_t1_armed) {
+                m_pb7 = true;
+            }
+            m_t1_armed = false;
+            m_t1_previous_underflow = m_t1_underflow + (count - 1) * period;
+            m_t1_underflow = m_t1_previous_underflow + period;
+        }
+
+        if (m_t2_armed && !t2_counts_pulses() && now >= t2_underflow()) {
+            m_ifr |= irq_t2;
+            m_t2_armed = false;
+        }
+
+        const uint64_t period = shift_period();
+        if (period != 0 && m_sr_bits_left > 0 && now >= m_sr_cycle) {
+            const uint64_t due = (now - m_sr_cycle) / period + 1;
+            const bool free_running = shift_mode() == 4;
+            const auto bits = static_cast<Byte>(free_running ? due % 8 : std::min<uint64_t>(due, m_sr_bits_left));
+            if (shift_out()) {
+                m_sr = static_cast<Byte>((m_sr << bits) | (m_sr >> ((8 - bits) % 8))); // Out on CB2 and back in
+            } else {
+                m_sr = static_cast<Byte>((m_sr << bits) | ((1u << bits) - 1)); // CB2 input floats high
+            }
+            m_sr_cycle += due * period;
+            if (!free_running) {
+                m_sr_bits_left = static_cast<Byte>(m_sr_bits_left - bits);
+                if (m_sr_bits_left == 0) m_ifr |= irq_sr;
+            }
+        }
+    }
+
+    auto start_shift(uint64_t now) -> void {
+        const uint64_t period = shift_period();
+        if (period == 0) return;
+        m_sr_bits_left = 8;
+        m_sr_cycle = now + period;
+    }
+
+    // Earliest cycle at which a flag gets set that would assert IRQ, no_event when none will
+    [[nodiscard]] auto next_irq_cycle() const -> uint64_t {
+        uint64_t next = no_event;
+        if ((m_ier & irq_t1) && (m_t1_armed || t1_free_running())) next = std::min(next, m_t1_underflow);
+        if ((m_ier & irq_t2) && m_t2_armed && !t2_counts_pulses()) next = std::min(next, t2_underflow());
+        const uint64_t period = shift_period();
+        if ((m_ier & irq_sr) && period != 0 && m_sr_bits_left > 0 && shift_mode() != 4) {
+            next = std::min(next, m_sr_cycle + (m_sr_bits_left - 1) * period);
+        }
+        return next;
+    }
+
+    // Drives the IRQ line from IFR & IER and keeps exactly one event pending for the next assertion
+    auto update(CPU &cpu) -> void {
+        set_irq(cpu, m_irq_source, (m_ifr & m_ier & 0x7F) != 0);
+
+        const uint64_t next = next_irq_cycle();
+        if (next == m_event_cycle) return;
+        m_scheduler.cancel(m_event);
+        m_event_cycle = next;
+        m_event = (next == no_event) ? 0 : m_scheduler.schedule(next, on_event, this);
+    }
+
+    static auto on_event(void *ctx, CPU &cpu) -> void {
+        auto &via = *static_cast<Via *>(ctx);
+        via.m_event_cycle = no_event;
+        via.catch_up(cpu.cycles);
+        via.update(cpu);
+    }
+
+    auto set_control_line(CPU &cpu, bool &line, bool level, bool positive_edge, Byte flag) -> void {
+        if (line != level && level == positive_edge) {
+            catch_up(cpu.cycles);
+            m_ifr |= flag;
+            update(cpu);
+        }
+        line = level;
+    }
+};
+} // namespace mos6502
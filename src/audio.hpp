@@ -0,0 +1,133 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <print>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+
+#include "6502/tone.hpp"
+#include "spsc_ring.hpp"
+
+using std::println;
+
+namespace AUDIO {
+inline constexpr int sample_rate = 44100;
+inline constexpr Uint16 callback_frames = 512;
+inline constexpr size_t target_fill = 2048;      // ~46 ms of latency the rate control steers towards
+inline constexpr double max_rate_adjust = 0.005; // Pitch change stays inaudible below ~0.5 %
+
+struct Output {
+    SDL_AudioDeviceID device = 0;
+    int frequency = sample_rate;
+    UTIL::SpscRing<int16_t, 8192> ring;
+    std::atomic<uint64_t> underruns = 0; // Callbacks that ran out of samples, for the debug window
+    std::thread opener;
+    std::atomic<bool> ready = false; // device and frequency are only read once this is set
+
+    // Emulation side only
+    std::vector<int16_t> scratch;
+    double clock_estimate = 0.0; // Emulated cycles per wall second, smoothed
+    double rate_adjust = 1.0;
+    uint64_t last_cycle = 0;
+    std::chrono::steady_clock::time_point last_time;
+
+    // Audio thread only
+    int16_t last_sample = 0;
+
+    // Early exits skip close, a still joinable opener would terminate the process
+    ~Output() {
+        if (opener.joinable()) opener.join();
+    }
+};
+
+// Runs on SDL's audio thread: only touches the consumer end of the ring and never waits.
+// Missing samples hold the last value and decay towards zero instead of clicking.
+inline auto callback(void *userdata, Uint8 *stream, int len) -> void {
+    auto &out = *static_cast<Output *>(userdata);
+    std::span<int16_t> samples(reinterpret_cast<int16_t *>(stream), static_cast<size_t>(len) / sizeof(int16_t));
+
+    const size_t got = out.ring.pop(samples);
+    if (got > 0) out.last_sample = samples[got - 1];
+    if (got < samples.size()) {
+        out.underruns.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = got; i < samples.size(); ++i) {
+            out.last_sample = static_cast<int16_t>(out.last_sample * 63 / 64);
+            samples[i] = out.last_sample;
+        }
+    }
+}
+
+// Missing audio is not fatal, the emulator keeps running silently
+inline auto open(Output &out) -> bool {
+    SDL_AudioSpec desired{};
+    desired.freq = sample_rate;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = callback_frames;
+    desired.callback = callback;
+    desired.userdata = &out;
+
+    SDL_AudioSpec obtained{};
+    out.device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (out.device == 0) {
+        println(std::cerr, "Audio disabled: {}", SDL_GetError());
+        return false;
+    }
+    out.frequency = obtained.freq;
+    SDL_PauseAudioDevice(out.device, 0);
+    return true;
+}
+
+// Bringing up a device can take a noticeable while (sound servers, Bluetooth sinks), so it
+// happens off the main thread. Until it is ready pump renders and drops like without audio.
+inline auto open_async(Output &out) -> void {
+    out.last_time = std::chrono::steady_clock::now();
+    out.opener = std::thread([&out] {
+        open(out);
+        out.ready.store(true, std::memory_order_release);
+    });
+}
+
+inline auto close(Output &out) -> void {
+    if (out.opener.joinable()) out.opener.join();
+    if (out.device != 0) SDL_CloseAudioDevice(out.device);
+    out.device = 0;
+}
+
+// Emulation side, once per frame: renders everything the CPU produced since the last call.
+// The cycles -> samples ratio follows the measured emulation speed and is nudged by the ring
+// fill level so that frame time jitter neither drains the ring (underrun) nor overflows it.
+inline auto pump(Output &out, mos6502::ToneDevice &tone, uint64_t cycle) -> void {
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - out.last_time).count();
+    const uint64_t cycles = cycle - std::min(cycle, out.last_cycle);
+    out.last_time = now;
+    out.last_cycle = cycle;
+    if (cycles == 0 || seconds <= 0.0) return; // Paused or stepping, let the callback fade out
+
+    if (seconds < 0.25) { // Longer gaps are pauses (debugger, window drag), not emulation speed
+        const double measured = static_cast<double>(cycles) / seconds;
+        out.clock_estimate = (out.clock_estimate <= 0.0) ? measured : out.clock_estimate * 0.95 + measured * 0.05;
+    }
+    if (out.clock_estimate <= 0.0) return;
+
+    const double fill = static_cast<double>(out.ring.size());
+    const double error = std::clamp((fill - static_cast<double>(target_fill)) / static_cast<double>(target_fill), -1.0, 1.0);
+    out.rate_adjust = 1.0 + max_rate_adjust * error;
+
+    const bool ready = out.ready.load(std::memory_order_acquire);
+    const double cycles_per_sample = out.clock_estimate / (ready ? out.frequency : sample_rate) * out.rate_adjust;
+    out.scratch.clear();
+    tone.render(cycle, cycles_per_sample, out.scratch);
+    if (ready && out.device != 0) out.ring.push(out.scratch); // Whatever does not fit is dropped
+}
+} // namespace AUDIO
@@ -15,8 +15,15 @@ inline constexpr int window_height = 720;
 inline constexpr float aspect_ratio = static_cast<float>(window_width) / window_height;
 
 inline constexpr size_t n_iter_per_frame = 700;
+inline constexpr size_t turbo_batch_cycles = 20'000; // Between two clock checks in turbo mode
+inline constexpr uint64_t history_interval = 1'000'000; // Cycles between search checkpoints, doubled as the history fills
+inline constexpr auto performance_window = 500ms;
 inline constexpr auto timer_update_delay = 16'666'667ns; // 1 second / 60 in nanoseconds
 
+// ImGui needs a few frames after an event to settle hover states and layout
+inline constexpr int redraw_frames_after_event = 3;
+inline constexpr int idle_wait_timeout_ms = 500;
+
 inline constexpr std::array<float, 12> square_vertices = {
     1.0f, -1.0f, 0.0f,
     1.0f, 0.0f, 0.0f,
@@ -75,6 +82,14 @@ inline constexpr TYPES::COLOR::Color background_debug = TYPES::COLOR::from_u8(31
 inline constexpr char const *fp_shader_dir = "assets/shaders/";
 inline constexpr char const *fp_vertex_shader = "assets/shaders/vertex.glsl";
 inline constexpr char const *fp_fragment_shader = "assets/shaders/fragment.glsl";
+inline constexpr char const *fp_blit_vertex_shader = "assets/shaders/blit_vertex.glsl";
+inline constexpr char const *fp_blit_fragment_shader = "assets/shaders/blit_fragment.glsl";
+
+inline constexpr char const *fp_font = "assets/fonts/MonaspaceKrypton-Regular.otf";
+inline constexpr char const *fp_font_cache = "font_atlas.cache";
 
 inline constexpr char const *fp_sound_beep = "assets/sound/beep.wav";
+inline constexpr char const *fp_save_state = "savestate.65sv";
+inline constexpr char const *fp_profile = "profile.folded";
+inline constexpr char const *fp_trace = "trace.json";
 } // namespace CONSTANTS
\ No newline at end of file
@@ -0,0 +1,190 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "6502/6502.hpp"
+#include "gl.hpp"
+
+namespace DISPLAY {
+inline constexpr size_t pbo_count = 3;
+
+// Guest visible framebuffer: width * height bytes of palette indices in plain RAM starting at base,
+// one byte per pixel, row major. Programs draw with ordinary stores, the host side only watches
+// cpu.page_generation of the covered pages to decide whether a new upload is needed.
+struct Framebuffer {
+    Address base = 0x0200;
+    int width = 32;
+    int height = 32;
+
+    GLuint index_texture = GL_ZERO;   // GL_R8UI, palette indices
+    GLuint palette_texture = GL_ZERO; // 256 x 1 RGBA8
+    std::array<GLuint, pbo_count> pbos = {};
+    std::array<Byte *, pbo_count> mapped = {}; // Persistent mappings, null on the fallback path
+    std::array<GLsync, pbo_count> fences = {};
+    size_t next_pbo = 0;
+    bool persistent = false;
+
+    bool dirty = true;
+    std::array<uint32_t, 256> seen_generation = {};
+
+    [[nodiscard]] auto size() const -> size_t { return static_cast<size_t>(width) * static_cast<size_t>(height); }
+    [[nodiscard]] auto first_page() const -> size_t { return base >> 8; }
+    [[nodiscard]] auto last_page() const -> size_t { return (base + size() - 1) >> 8; }
+};
+
+// 3-3-2 RGB, index 0 is black and 255 white
+[[nodiscard]] inline auto default_palette() -> std::array<uint32_t, 256> {
+    std::array<uint32_t, 256> palette{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        const uint32_t r = ((i >> 5) & 0x07) * 255 / 7;
+        const uint32_t g = ((i >> 2) & 0x07) * 255 / 7;
+        const uint32_t b = (i & 0x03) * 255 / 3;
+        palette[i] = r | (g << 8) | (b << 16) | (0xFFu << 24);
+    }
+    return palette;
+}
+
+inline auto set_palette(Framebuffer &fb, const std::array<uint32_t, 256> &palette) -> void {
+    glBindTexture(GL_TEXTURE_2D, fb.palette_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, palette.data());
+    glBindTexture(GL_TEXTURE_2D, GL_ZERO);
+}
+
+// Buffer storage (GL 4.4 / ARB_buffer_storage) lets all PBOs stay mapped for their whole
+// lifetime. Plain 4.1 contexts (macOS) map unsynchronized per upload instead, both paths
+// rely on the per PBO fences so a buffer the GPU may still read is never written.
+inline auto setup(Framebuffer &fb) -> void {
+    assert(fb.width > 0 && fb.height > 0 && fb.base + fb.size() <= 0x10000);
+
+    glGenTextures(1, &fb.index_texture);
+    glBindTexture(GL_TEXTURE_2D, fb.index_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // Integer textures can not be filtered
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, fb.width, fb.height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+    glGenTextures(1, &fb.palette_texture);
+    glBindTexture(GL_TEXTURE_2D, fb.palette_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, GL_ZERO);
+    set_palette(fb, default_palette());
+
+    const auto bytes = static_cast<GLsizeiptr>(fb.size());
+    fb.persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+    glGenBuffers(static_cast<GLsizei>(pbo_count), fb.pbos.data());
+    for (size_t i = 0; i < pbo_count; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, fb.pbos[i]);
+        if (fb.persistent) {
+            constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, flags);
+            fb.mapped[i] = static_cast<Byte *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags));
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_ZERO);
+    fb.dirty = true;
+}
+
+inline auto cleanup(Framebuffer &fb) -> void {
+    for (size_t i = 0; i < pbo_count; ++i) {
+        if (fb.fences[i] != nullptr) glDeleteSync(fb.fences[i]);
+        if (fb.mapped[i] != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, fb.pbos[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_ZERO);
+    glDeleteBuffers(static_cast<GLsizei>(pbo_count), fb.pbos.data());
+    glDeleteTextures(1, &fb.index_texture);
+    glDeleteTextures(1, &fb.palette_texture);
+    fb = Framebuffer{.base = fb.base, .width = fb.width, .height = fb.height};
+}
+
+// Copies the framebuffer region into the next free PBO and queues the texture update from it.
+// Returns without uploading when no covered page was written since the last upload, or when
+// the next PBO is still in flight (then the frame keeps the previous image and retries).
+inline auto upload(Framebuffer &fb, const mos6502::CPU &cpu) -> void {
+    for (size_t page = fb.first_page(); page <= fb.last_page(); ++page) {
+        if (fb.seen_generation[page] != cpu.page_generation[page]) fb.dirty = true;
+    }
+    if (!fb.dirty) return;
+
+    const size_t slot = fb.next_pbo;
+    GLsync &fence = fb.fences[slot];
+    if (fence != nullptr) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) return; // Poll only, never stall
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    const auto bytes = static_cast<GLsizeiptr>(fb.size());
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, fb.pbos[slot]);
+    if (fb.persistent) {
+        std::memcpy(fb.mapped[slot], cpu.mem.data() + fb.base, fb.size());
+    } else {
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+        if (dst == nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_ZERO);
+            return;
+        }
+        std::memcpy(dst, cpu.mem.data() + fb.base, fb.size());
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, fb.index_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fb.width, fb.height, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, GL_ZERO);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GL_ZERO);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    fb.next_pbo = (slot + 1) % pbo_count;
+    for (size_t page = fb.first_page(); page <= fb.last_page(); ++page) {
+        fb.seen_generation[page] = cpu.page_generation[page];
+    }
+    fb.dirty = false;
+}
+
+// Draws the framebuffer centered and as large as the window allows at its own aspect ratio
+inline auto draw(const Framebuffer &fb, const GL::ShaderProgram &shader, const GL::GeometryBuffers &quad,
+    const GL::DrawBuffer &draw_buffer, float window_aspect_ratio) -> void {
+    const float aspect = static_cast<float>(fb.width) / static_cast<float>(fb.height);
+    float width = 2.0f;
+    float height = 2.0f;
+    if (aspect > window_aspect_ratio) {
+        height = 2.0f * window_aspect_ratio / aspect;
+    } else {
+        width = 2.0f * aspect / window_aspect_ratio;
+    }
+
+    GL::DrawBatch batch;
+    GL::DrawBlock &block = batch.add();
+    GL::fill_box_block(block, Rect{.position = {-width / 2.0f, height / 2.0f}, .width = width, .height = height});
+    block.size = vec2{static_cast<float>(fb.width), static_cast<float>(fb.height)};
+
+    shader.bind();
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fb.index_texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, fb.palette_texture);
+
+    batch.draw(draw_buffer, quad, 6);
+
+    glBindTexture(GL_TEXTURE_2D, GL_ZERO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, GL_ZERO);
+    GL::ShaderProgram::unbind();
+}
+} // namespace DISPLAY
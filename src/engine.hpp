@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <future>
 #include <print>
 
 using std::println;
@@ -11,16 +12,68 @@ using std::println;
 #include <SDL.h>
 #include <glad/glad.h>
 
+#include "audio.hpp"
+#include "font_cache.hpp"
 #include "global.hpp"
 #include "utils.hpp"
 
 namespace ENGINE {
+// Falls back to rasterising the font when the cache is missing or stale and refreshes it
+inline auto setup_font(ImGuiIO &io, FONT_CACHE::Assets &assets) -> void {
+    constexpr int oversample = 3;
+    constexpr float base_font_size = 6.0f;
+
+    float dpi_scale = 1.0f;
+    float ddpi;
+    if (SDL_GetDisplayDPI(0, &ddpi, nullptr, nullptr) == 0 && ddpi > 0.0f) {
+        dpi_scale = ddpi / 96.0f;
+        // if (dpi_scale > 1.5f) dpi_scale = 1.5f; // Cap it for Retina
+    }
+    if (assets.font.empty()) {
+        println(std::cerr, "Failed to read font {}", CONSTANTS::fp_font);
+        return;
+    }
+
+    const float font_size = base_font_size * dpi_scale;
+    const uint64_t key = FONT_CACHE::key(assets.font_hash, font_size, dpi_scale, oversample);
+    if (ImFont *font = FONT_CACHE::install(assets.cache, key, *io.Fonts)) {
+        io.FontDefault = font;
+        return;
+    }
+
+    ImFontConfig font_cfg;
+    font_cfg.OversampleH = oversample;
+    font_cfg.OversampleV = oversample;
+    font_cfg.FontDataOwnedByAtlas = false;
+    ImFont *mono_font = io.Fonts->AddFontMemoryTTF(assets.font.data(), static_cast<int>(assets.font.size()), font_size, &font_cfg);
+    if (!mono_font || !io.Fonts->Build()) {
+        println(std::cerr, "Failed to build font {}, using the default font", CONSTANTS::fp_font);
+        io.Fonts->Clear(); // Drops the pointer into assets.font before the bytes go away
+        io.Fonts->AddFontDefault();
+        return;
+    }
+    io.FontDefault = mono_font;
+    if (!FONT_CACHE::save(CONSTANTS::fp_font_cache, key, *io.Fonts)) {
+        println(std::cerr, "Failed to write font cache {}", CONSTANTS::fp_font_cache);
+    }
+    io.Fonts->ClearInputData(); // Drops the pointer into assets.font, the baked atlas stays
+}
+
 [[nodiscard]] inline auto setup() -> bool {
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
+    // File reads overlap window and GL context creation, nothing here waits on them until
+    // the font is needed. The audio device comes up whenever it is ready.
+    auto assets = std::async(std::launch::async, [] {
+        const TRACE::Scope zone(TRACE::Zone::load_assets);
+        return FONT_CACHE::load_assets(CONSTANTS::fp_font, CONSTANTS::fp_font_cache);
+    });
+
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO) != 0) {
         println(std::cerr, "{}", SDL_GetError());
         return false;
     }
 
+    AUDIO::open_async(global.audio);
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -55,6 +108,7 @@ namespace ENGINE {
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    global.renderer.draw_buffer.create(GL::UniformBlock::draw);
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -62,26 +116,8 @@ namespace ENGINE {
     ImGuiIO &io = ImGui::GetIO();
     global.renderer.imgui_io = io;
 
-    ImFontConfig font_cfg;
-    font_cfg.OversampleH = 3;
-    font_cfg.OversampleV = 3;
-
-    float dpi_scale = 1.0f;
-    float ddpi;
-    if (SDL_GetDisplayDPI(0, &ddpi, nullptr, nullptr) == 0 && ddpi > 0.0f) {
-        dpi_scale = ddpi / 96.0f;
-        // if (dpi_scale > 1.5f) dpi_scale = 1.5f; // Cap it for Retina
-    }
-
-    constexpr float base_font_size = 6.0f;
-    ImFont *mono_font = io.Fonts->AddFontFromFileTTF(
-        "assets/fonts/MonaspaceKrypton-Regular.otf",
-        base_font_size * dpi_scale,
-        &font_cfg);
-
-    if (mono_font) {
-        io.FontDefault = mono_font;
-    }
+    auto font_assets = assets.get();
+    setup_font(io, font_assets);
 
     ImGui::StyleColorsDark();
 
@@ -91,9 +127,24 @@ namespace ENGINE {
     return true;
 }
 
+// Quad and shader presenting the guest framebuffer, only needed when a display is mapped
+inline auto setup_blit() -> void {
+    global.renderer.blit_quad = GL::create_geometry(CONSTANTS::square_vertices, CONSTANTS::square_indices);
+    global.renderer.blit_shader.load(CONSTANTS::fp_blit_vertex_shader, CONSTANTS::fp_blit_fragment_shader);
+    // Texture units never change, only the Draw block is updated per frame
+    global.renderer.blit_shader.bind();
+    global.renderer.blit_shader.set_uniform(GL::Uniform::indices, 0);
+    global.renderer.blit_shader.set_uniform(GL::Uniform::palette, 1);
+    GL::ShaderProgram::unbind();
+}
+
 inline auto cleanup() -> void {
     println("Cleaning up engine resources");
 
+    if (global.display) DISPLAY::cleanup(*global.display);
+
+    AUDIO::close(global.audio);
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
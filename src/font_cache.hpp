@@ -0,0 +1,155 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+
+namespace FONT_CACHE {
+// The baked ImGui atlas of a single font, so later starts skip rasterising it. Only this
+// machine reads the blob back, it is a header followed by the raw in-memory arrays and any
+// mismatch (font file, size, DPI, ImGui version) simply rebuilds and overwrites it.
+inline constexpr char magic[8] = {'6', '5', 'F', 'O', 'N', 'T', '0', '1'};
+
+struct Header {
+    char magic[8];
+    uint64_t key;
+    int32_t tex_width;
+    int32_t tex_height;
+    ImVec2 tex_uv_white_pixel;
+    float font_size;
+    float ascent;
+    float descent;
+    ImWchar ellipsis_char; // Picked by the atlas build, which a cache hit skips
+    ImWchar dot_char;
+    uint32_t glyph_count;
+};
+
+// Read by the background loader, font bytes are kept so a cache miss does not read them twice
+struct Assets {
+    std::vector<unsigned char> font;
+    uint64_t font_hash = 0;
+    std::vector<unsigned char> cache;
+};
+
+inline auto read_file(const std::string &path) -> std::vector<unsigned char> {
+    std::vector<unsigned char> bytes;
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) return bytes;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        const long size = std::ftell(file);
+        if (size > 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+            bytes.resize(static_cast<size_t>(size));
+            if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size()) bytes.clear();
+        }
+    }
+    std::fclose(file);
+    return bytes;
+}
+
+inline constexpr uint64_t fnv_offset = 0xCBF29CE484222325ULL;
+inline constexpr uint64_t fnv_prime = 0x100000001B3ULL;
+
+[[nodiscard]] inline auto fnv1a(std::span<const unsigned char> bytes, uint64_t h = fnv_offset) -> uint64_t {
+    for (const unsigned char b : bytes) {
+        h ^= b;
+        h *= fnv_prime;
+    }
+    return h;
+}
+
+inline auto load_assets(const std::string &font_path, const std::string &cache_path) -> Assets {
+    Assets assets{.font = read_file(font_path), .cache = read_file(cache_path)};
+    assets.font_hash = fnv1a(assets.font);
+    return assets;
+}
+
+// The font file hash extended by everything else the baked result depends on
+[[nodiscard]] inline auto key(uint64_t font_hash, float size, float dpi_scale, int oversample) -> uint64_t {
+    uint64_t h = font_hash;
+    const auto mix = [&h](uint64_t v) {
+        unsigned char bytes[8];
+        for (int i = 0; i < 8; ++i) bytes[i] = static_cast<unsigned char>(v >> (8 * i));
+        h = fnv1a(bytes, h);
+    };
+    mix(std::bit_cast<uint32_t>(size));
+    mix(std::bit_cast<uint32_t>(dpi_scale));
+    mix(static_cast<uint64_t>(oversample));
+    mix(IMGUI_VERSION_NUM);
+    mix(sizeof(ImFontGlyph));
+    return h;
+}
+
+inline constexpr size_t tex_lines = IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1;
+
+// atlas must be built and hold exactly the one font
+inline auto save(const std::string &path, uint64_t key, const ImFontAtlas &atlas) -> bool {
+    if (atlas.Fonts.Size != 1 || atlas.TexPixelsAlpha8 == nullptr) return false;
+    const ImFont &font = *atlas.Fonts[0];
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.key = key;
+    header.tex_width = atlas.TexWidth;
+    header.tex_height = atlas.TexHeight;
+    header.tex_uv_white_pixel = atlas.TexUvWhitePixel;
+    header.font_size = font.FontSize;
+    header.ascent = font.Ascent;
+    header.descent = font.Descent;
+    header.ellipsis_char = font.EllipsisChar;
+    header.dot_char = font.DotChar;
+    header.glyph_count = static_cast<uint32_t>(font.Glyphs.Size);
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    const size_t pixels = static_cast<size_t>(atlas.TexWidth) * static_cast<size_t>(atlas.TexHeight);
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && std::fwrite(atlas.TexUvLines, sizeof(ImVec4), tex_lines, file) == tex_lines;
+    ok = ok && std::fwrite(font.Glyphs.Data, sizeof(ImFontGlyph), header.glyph_count, file) == header.glyph_count;
+    ok = ok && std::fwrite(atlas.TexPixelsAlpha8, 1, pixels, file) == pixels;
+    return std::fclose(file) == 0 && ok;
+}
+
+// Replaces whatever the atlas holds with the cached font and marks it built, the backend then
+// uploads it without ImGui rasterising anything. Returns nullptr when the blob does not match.
+inline auto install(std::span<const unsigned char> blob, uint64_t key, ImFontAtlas &atlas) -> ImFont * {
+    Header header;
+    if (blob.size() < sizeof(header)) return nullptr;
+    std::memcpy(&header, blob.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.key != key) return nullptr;
+    if (header.tex_width <= 0 || header.tex_height <= 0) return nullptr;
+    const size_t pixels = static_cast<size_t>(header.tex_width) * static_cast<size_t>(header.tex_height);
+    const size_t lines_at = sizeof(header);
+    const size_t glyphs_at = lines_at + tex_lines * sizeof(ImVec4);
+    const size_t pixels_at = glyphs_at + header.glyph_count * sizeof(ImFontGlyph);
+    if (blob.size() != pixels_at + pixels) return nullptr;
+
+    atlas.Clear();
+    auto *font = IM_NEW(ImFont);
+    atlas.Fonts.push_back(font);
+    font->ContainerAtlas = &atlas;
+    font->FontSize = header.font_size;
+    font->Ascent = header.ascent;
+    font->Descent = header.descent;
+    font->EllipsisChar = header.ellipsis_char;
+    font->DotChar = header.dot_char;
+    font->Glyphs.resize(static_cast<int>(header.glyph_count));
+    std::memcpy(font->Glyphs.Data, blob.data() + glyphs_at, header.glyph_count * sizeof(ImFontGlyph));
+    font->BuildLookupTable();
+
+    atlas.TexWidth = header.tex_width;
+    atlas.TexHeight = header.tex_height;
+    atlas.TexUvScale = ImVec2(1.0f / static_cast<float>(header.tex_width), 1.0f / static_cast<float>(header.tex_height));
+    atlas.TexUvWhitePixel = header.tex_uv_white_pixel;
+    std::memcpy(atlas.TexUvLines, blob.data() + lines_at, tex_lines * sizeof(ImVec4));
+    atlas.TexPixelsAlpha8 = static_cast<unsigned char *>(IM_ALLOC(pixels));
+    std::memcpy(atlas.TexPixelsAlpha8, blob.data() + pixels_at, pixels);
+    atlas.TexReady = true;
+    return font;
+}
+} // namespace FONT_CACHE
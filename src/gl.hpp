@@ -1,14 +1,18 @@
 /* danielsinkin97@gmail.com */
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <iostream>
+#include <span>
 #include <sstream>
 #include <string>
-#include <unordered_map>
 
 #include "types.hpp"
 using TYPES::Rect;
@@ -22,10 +26,76 @@ using ShaderID = GLuint;
 using ProgramID = GLuint;
 using UniformLocation = GLint;
 
+// Uniforms declared outside of blocks. Programs resolve them once at link time into a table
+// indexed by this enum, setting one is an array lookup instead of a search by name.
+enum class Uniform : uint8_t {
+    time,
+    aspect_ratio,
+    indices,
+    palette,
+    count,
+};
+
+inline constexpr std::array<const char *, static_cast<size_t>(Uniform::count)> uniform_names = {
+    "u_Time",
+    "u_AspectRatio",
+    "u_Indices",
+    "u_Palette",
+};
+
+// Every program declaring a block gets it bound to the binding point of its enum value
+enum class UniformBlock : GLuint {
+    draw,
+    count,
+};
+
+inline constexpr std::array<const char *, static_cast<size_t>(UniformBlock::count)> uniform_block_names = {
+    "Draw",
+};
+
+// std140 layout of one element of the Draw block's u_Draws array, what changes from one quad to
+// the next. Shaders declare the whole struct even when they only read part of it.
+struct DrawBlock {
+    glm::vec2 pos = glm::vec2(0.0f);
+    float width = 0.0f;
+    float height = 0.0f;
+    glm::vec3 color = glm::vec3(0.0f);
+    float pad_color = 0.0f; // A vec3 takes up a whole vec4 slot
+    glm::vec2 size = glm::vec2(0.0f); // Guest framebuffer in pixels, read by the blit shader
+    glm::vec2 pad_size = glm::vec2(0.0f);
+};
+static_assert(offsetof(DrawBlock, color) == 16 && offsetof(DrawBlock, size) == 32 && sizeof(DrawBlock) == 48);
+
+inline constexpr size_t max_batch_draws = 64; // Length of u_Draws in the shaders
+
+// One buffer per block type holding an array of Count blocks, bound to its binding point for
+// good and rewritten once per batch
+template <typename Block, size_t Count>
+struct UniformBuffer {
+    GLuint m_id = GL_ZERO;
+
+    auto create(UniformBlock binding) -> void {
+        glGenBuffers(1, &m_id);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block) * Count, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, GL_ZERO);
+        glBindBufferBase(GL_UNIFORM_BUFFER, static_cast<GLuint>(binding), m_id);
+    }
+
+    auto upload(std::span<const Block> blocks) const -> void {
+        if (m_id == GL_ZERO || blocks.size() > Count) assert(false);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(blocks.size_bytes()), blocks.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, GL_ZERO);
+    }
+};
+
+using DrawBuffer = UniformBuffer<DrawBlock, max_batch_draws>;
+
 class ShaderProgram {
 public:
     ProgramID m_id = GL_ZERO;
-    std::unordered_map<std::string, UniformLocation> m_uniforms;
+    std::array<UniformLocation, static_cast<size_t>(Uniform::count)> m_locations{};
 
     auto bind() const -> void {
         if (m_id == GL_ZERO) assert(false);
@@ -33,16 +103,21 @@ public:
     }
     static auto unbind() -> void { glUseProgram(GL_ZERO); }
 
-    auto set_uniform(const std::string &name, float value) const -> void {
-        glUniform1f(get_uniform(name), value);
+    // Uniforms this program does not use are located at -1, which GL ignores
+    auto set_uniform(Uniform uniform, int value) const -> void {
+        glUniform1i(location(uniform), value);
+    }
+
+    auto set_uniform(Uniform uniform, float value) const -> void {
+        glUniform1f(location(uniform), value);
     }
 
-    auto set_uniform(const std::string &name, const glm::vec2 &v) const -> void {
-        glUniform2f(get_uniform(name), v.x, v.y);
+    auto set_uniform(Uniform uniform, const glm::vec2 &v) const -> void {
+        glUniform2f(location(uniform), v.x, v.y);
     }
 
-    auto set_uniform(const std::string &name, const glm::vec3 &v) const -> void {
-        glUniform3f(get_uniform(name), v.x, v.y, v.z);
+    auto set_uniform(Uniform uniform, const glm::vec3 &v) const -> void {
+        glUniform3f(location(uniform), v.x, v.y, v.z);
     }
 
     auto load(const char *vertex_path, const char *fragment_path) -> void {
@@ -64,13 +139,44 @@ public:
 
         glDeleteShader(vert);
         glDeleteShader(frag);
+
+        reflect();
     }
 
 private:
-    [[nodiscard]] auto get_uniform(const std::string &name) const -> UniformLocation {
-        auto it = m_uniforms.find(name);
-        if (it != m_uniforms.end()) return it->second;
-        assert(false);
+    [[nodiscard]] auto location(Uniform uniform) const -> UniformLocation {
+        return m_locations[static_cast<size_t>(uniform)];
+    }
+
+    template <size_t N>
+    [[nodiscard]] static auto find_name(const std::array<const char *, N> &names, const char *name) -> size_t {
+        return static_cast<size_t>(std::ranges::find_if(names, [name](const char *n) { return std::strcmp(n, name) == 0; }) - names.begin());
+    }
+
+    // Walks the active uniforms and blocks once after linking. Block members are not in the
+    // table and are skipped, a block missing from uniform_block_names is a shader bug.
+    auto reflect() -> void {
+        m_locations.fill(-1);
+        char name[64];
+
+        GLint uniforms = 0;
+        glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &uniforms);
+        for (GLuint i = 0; i < static_cast<GLuint>(uniforms); ++i) {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(m_id, i, sizeof(name), nullptr, &size, &type, name);
+            const size_t index = find_name(uniform_names, name);
+            if (index < m_locations.size()) m_locations[index] = glGetUniformLocation(m_id, name);
+        }
+
+        GLint blocks = 0;
+        glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+        for (GLuint i = 0; i < static_cast<GLuint>(blocks); ++i) {
+            glGetActiveUniformBlockName(m_id, i, sizeof(name), nullptr, name);
+            const size_t binding = find_name(uniform_block_names, name);
+            if (binding >= uniform_block_names.size()) assert(false);
+            glUniformBlockBinding(m_id, i, static_cast<GLuint>(binding));
+        }
     }
 
     [[nodiscard]] auto compile_shader_from_file(const char *filepath, GLenum type) -> ShaderID {
@@ -131,23 +237,49 @@ template <size_t VertexCount, size_t IndexCount>
     return gb;
 }
 
-inline auto set_box_uniforms(const ShaderProgram &sp, const Rect &box) -> void {
-    sp.set_uniform("u_Pos", vec2{box.position.x, box.position.y});
-    sp.set_uniform("u_Width", box.width);
-    sp.set_uniform("u_Height", box.height);
+inline auto fill_box_block(DrawBlock &block, const Rect &box) -> void {
+    block.pos = vec2{box.position.x, box.position.y};
+    block.width = box.width;
+    block.height = box.height;
 }
 
-inline auto set_color_uniforms(const ShaderProgram &sp, const Color &color) -> void {
-    sp.set_uniform("u_Color", vec3{color.r, color.g, color.b});
+inline auto fill_color_block(DrawBlock &block, const Color &color) -> void {
+    block.color = vec3{color.r, color.g, color.b};
 }
 
-inline auto draw_simple_vao(const GeometryBuffers &geom, GLsizei index_count) -> void {
+// Draws geom once per instance, gl_InstanceID picks the instance's entry of u_Draws
+inline auto draw_simple_vao(const GeometryBuffers &geom, GLsizei index_count, GLsizei instances = 1) -> void {
     if (geom.vao == GL_ZERO || geom.ebo == GL_ZERO) {
         assert(false);
     }
 
     glBindVertexArray(geom.vao);
-    glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr);
+    glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr, instances);
     glBindVertexArray(0);
 }
+
+// Quads sharing one shader and geometry. Their blocks are collected on the CPU side and go to the
+// GPU with one upload and one instanced draw call, however many quads the batch holds.
+class DrawBatch {
+public:
+    [[nodiscard]] auto add() -> DrawBlock & {
+        if (m_count == m_blocks.size()) assert(false);
+        m_blocks[m_count] = DrawBlock{};
+        return m_blocks[m_count++];
+    }
+
+    [[nodiscard]] auto full() const -> bool { return m_count == m_blocks.size(); }
+
+    // Expects the shader bound, empties the batch
+    auto draw(const DrawBuffer &buffer, const GeometryBuffers &geom, GLsizei index_count) -> void {
+        if (m_count == 0) return;
+        buffer.upload(std::span<const DrawBlock>(m_blocks.data(), m_count));
+        draw_simple_vao(geom, index_count, static_cast<GLsizei>(m_count));
+        m_count = 0;
+    }
+
+private:
+    std::array<DrawBlock, max_batch_draws> m_blocks;
+    size_t m_count = 0;
+};
 } // namespace GL
\ No newline at end of file
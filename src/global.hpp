@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cassert>
+#include <future>
+#include <memory>
+#include <optional>
 #include <stack>
 
 #include <SDL.h>
@@ -8,8 +11,21 @@
 #include <imgui.h>
 
 #include "6502/6502.hpp"
+#include "6502/bus_log.hpp"
+#include "6502/coverage.hpp"
+#include "6502/disassembler.hpp"
+#include "6502/loader.hpp"
+#include "6502/profiler.hpp"
+#include "6502/scheduler.hpp"
+#include "6502/search.hpp"
+#include "6502/state_hash.hpp"
+#include "6502/tone.hpp"
+#include "6502/via.hpp"
+#include "audio.hpp"
 #include "constants.hpp"
+#include "display.hpp"
 #include "gl.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 
 using TYPES::Position;
@@ -27,6 +43,7 @@ struct RendererState {
     GL::GeometryBuffers blit_quad;
     GLuint chip8_texture = 0;
     GL::ShaderProgram blit_shader;
+    GL::DrawBuffer draw_buffer;
 
     int gl_success;
     char gl_error_buffer[512];
@@ -38,6 +55,21 @@ struct RendererState {
     }
 };
 
+// Where host time goes, aggregated over CONSTANTS::performance_window and then published
+struct PerformanceStats {
+    std::chrono::steady_clock::time_point window_start;
+    uint64_t window_cycles = 0;
+    uint64_t window_idle_cycles = 0; // Part of window_cycles fast-forwarded through idle loops
+    std::chrono::duration<double> emulate_time{0};
+    std::chrono::duration<double> render_time{0};
+
+    double emulated_mhz = 0.0;
+    double emulate_share = 0.0; // Of the host time spent emulating + rendering
+    double presented_fps = 0.0;
+    double idle_share = 0.0; // Of the emulated cycles
+    int window_frames = 0;
+};
+
 struct SimulationState {
     int frame_counter = 0;
     std::chrono::steady_clock::time_point run_start_time;
@@ -47,6 +79,14 @@ struct SimulationState {
     bool is_debugging = false;
     bool step_once = false;
     bool step_back = false;
+    bool turbo = false; // Run uncapped, present at most every CONSTANTS::timer_update_delay
+    PerformanceStats perf;
+    int redraw_frames = CONSTANTS::redraw_frames_after_event; // Frames still to present before a paused debugger may go idle
+
+    // Paused with nothing left to show, the loop may sleep until the next event
+    [[nodiscard]] auto is_idle() const -> bool {
+        return is_debugging && !step_once && !step_back && redraw_frames == 0;
+    }
 
     auto validate() -> void {
         if (step_once && !is_debugging) assert(false);
@@ -58,6 +98,24 @@ struct InputState {
     double mouse_pos_y;
 };
 
+struct DisassemblyViewState {
+    bool follow_pc = true;
+    Address cursor = 0x0000; // Instruction boundary shown on the highlighted row when not following PC
+    int rows = 24;
+};
+
+struct MemoryViewState {
+    bool coverage_overlay = mos6502::coverage_enabled;
+};
+
+// Condition being edited and the search running in the background, emulation goes on meanwhile
+struct SearchState {
+    mos6502::Condition condition;
+    std::future<mos6502::SearchResult> job;
+    mos6502::SearchResult result;
+    bool searched = false; // result holds a finished search
+};
+
 struct ColorPalette {
     Color background = TYPES::COLOR::from_u8(15, 15, 21);
     Color pixel_on = Color{1.0f, 1.0f, 1.0f};
@@ -71,12 +129,41 @@ struct Global {
     InputState input;
     ColorPalette color;
     mos6502::CPU cpu;
+    mos6502::Scheduler scheduler;
+    mos6502::DisassemblyCache disassembly;
+    DisassemblyViewState disassembly_view;
+    MemoryViewState memory_view;
+
+    // Backing storage for images mapped into cpu.rom_pages, must outlive the mapping
+    std::optional<mos6502::MappedFile> rom_image;
+    std::unique_ptr<mos6502::BankedRom> cartridge;
+    std::unique_ptr<mos6502::Via> via;
+    std::unique_ptr<mos6502::ToneDevice> tone;
+    AUDIO::Output audio;
+    std::optional<DISPLAY::Framebuffer> display;
+
+    std::unique_ptr<mos6502::HashLog> hash_log; // Written to hash_log_path on exit
+    std::string hash_log_path;
+    std::string coverage_path; // Written on exit, needs a MOS6502_COVERAGE build
+    std::unique_ptr<mos6502::CallProfiler> profiler; // Attached as cpu.call_observer
+    std::string profile_path;                        // Folded stacks, written on exit
+    std::unique_ptr<mos6502::BusLog> bus_log; // Attached to cpu.instrumentation, needs MOS6502_INSTRUMENTATION=2
+    std::string bus_log_path;                 // Written on exit
+    TRACE::Collector trace;                   // Drained once per frame, captures go to CONSTANTS::fp_trace
+    std::optional<mos6502::History> history;  // Checkpoints for the Search window, only kept without devices
+    SearchState search;
 
     std::stack<mos6502::CPUSnapshot> cpu_snapshots;
 
     auto validate() -> void {
         sim.validate();
     }
+    // The CPU and its devices went back to an earlier state (step back, Go to, loaded state). The
+    // devices re-armed their own scheduler events while loading, the logs follow here.
+    auto rewound() -> void {
+        if (hash_log) hash_log->rewind(cpu);
+        if (history) history->truncate(cpu.cycles);
+    }
     auto debug_activate() -> void {
         sim.is_debugging = true;
         color.background = CONSTANTS::COLOR::background_debug;
@@ -5,6 +5,8 @@
 #include "types.hpp"
 #include "utils.hpp"
 
+#include "6502/save_state.hpp"
+
 #include "backends/imgui_impl_sdl.h"
 #include <SDL.h>
 
@@ -18,6 +20,7 @@ inline auto update_mouse_position() -> void {
 
 inline auto handle_event(const SDL_Event &event) -> void {
     ImGui_ImplSDL2_ProcessEvent(&event);
+    global.sim.redraw_frames = CONSTANTS::redraw_frames_after_event;
 
     switch (event.type) {
     case SDL_KEYDOWN: {
@@ -50,6 +53,30 @@ inline auto handle_event(const SDL_Event &event) -> void {
             global.color.background = CONSTANTS::COLOR::background_debug;
             break;
 
+        case SDLK_t:
+            global.sim.turbo = !global.sim.turbo;
+            SDL_GL_SetSwapInterval(global.sim.turbo ? 0 : 1); // A vsync'ed swap would stall the batches
+            println("Turbo mode {}", global.sim.turbo ? "on" : "off");
+            break;
+
+        case SDLK_F5:
+            if (mos6502::save_state_file(CONSTANTS::fp_save_state, global.cpu)) {
+                println("Saved state to {}", CONSTANTS::fp_save_state);
+            }
+            break;
+
+        case SDLK_F9:
+            if (mos6502::load_state_file(CONSTANTS::fp_save_state, global.cpu)) {
+                std::stack<mos6502::CPUSnapshot>().swap(global.cpu_snapshots);
+                if (global.hash_log) global.hash_log->rewind(global.cpu);
+                if (global.history) {
+                    global.history->clear(); // The past of the loaded state is unknown
+                    global.history->record(global.cpu);
+                }
+                println("Loaded state from {}", CONSTANTS::fp_save_state);
+            }
+            break;
+
         case SDLK_ESCAPE:
             println("Escape key pressed — exiting");
             global.is_running = false;
@@ -67,4 +94,14 @@ inline auto handle_input() -> void {
         handle_event(event);
     }
 }
+
+// Blocks until an event arrives (keys like SDLK_n wake it immediately) or the timeout passes,
+// then drains the queue like handle_input. Returns false when it timed out without events.
+inline auto wait_for_input(int timeout_ms) -> bool {
+    SDL_Event event;
+    if (!SDL_WaitEventTimeout(&event, timeout_ms)) return false;
+    handle_event(event);
+    handle_input();
+    return true;
+}
 } // namespace INPUT
\ No newline at end of file
@@ -14,6 +14,8 @@
 #include <bitset>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <format>
 #include <iostream>
 #include <thread>
@@ -22,7 +24,9 @@ using std::chrono::steady_clock;
 using namespace std::chrono_literals;
 
 // Project headers
+#include "audio.hpp"
 #include "constants.hpp"
+#include "display.hpp"
 #include "engine.hpp"
 #include "gl.hpp"
 #include "global.hpp"
@@ -32,38 +36,226 @@ using namespace std::chrono_literals;
 #include "utils.hpp"
 
 #include "6502/6502.hpp"
+#include "6502/assembler.hpp"
+#include "6502/bus_log.hpp"
+#include "6502/coverage.hpp"
+#include "6502/loader.hpp"
+#include "6502/profiler.hpp"
+#include "6502/save_state.hpp"
+#include "6502/scheduler.hpp"
+#include "6502/state_hash.hpp"
+#include "6502/tone.hpp"
+#include "6502/via.hpp"
 #include "6502/program_writer.hpp"
 
+constexpr auto example_simple = mos6502::assemble<R"(
+        lda #$44
+        jmp (vector)
+        jmp $0000
+
+        .org $10
+vector: .word loop
+
+        .org $20
+loop:   jmp loop
+)">();
+
 auto load_example_simple() -> void {
-    auto pw = mos6502::ProgramWriter(global.cpu);
-    pw.lda_immediate();
-    pw(0x44);
+    mos6502::load_image(global.cpu, example_simple);
+}
+
+// Usage: main [--rom] [--addr HEX] [--cpu 6502|6502u|65c02] [--via HEX] [--tone HEX] [--display HEX] [--display-size WxH]
+//             [--hash-log FILE [--hash-interval N] [--hash-from CYCLE] [--hash-until CYCLE]]
+//             [--coverage FILE] [--profile FILE] [--bus-log FILE [--bus-log-size N]] [image]
+//        main --hash-compare FILE FILE
+//   image    raw binary, .prg, Intel HEX or S-record; images over 64 KiB are treated as
+//            a UxROM style cartridge (16 KiB banks at $8000, last bank fixed at $C000)
+//   --rom    map a raw image read-only straight from the file instead of copying it
+//   --addr   load address of raw images, page aligned when combined with --rom
+//   --cpu    chip variant: NMOS 6502 (default), NMOS with undocumented opcodes, or 65C02
+//   --via    map a 6522 VIA onto the page holding the given address, wired to IRQ
+//   --tone   map the tone generator onto the page holding the given address
+//   --display       show width * height bytes of palette indices starting at the given address
+//   --display-size  framebuffer dimensions, 32x32 unless given (e.g. 256x240)
+//   --hash-log      log the state hash every N (100000) cycles within [from, until] to FILE on exit
+//   --hash-compare  report the first entry where two hash logs differ and exit
+//   --coverage      write byte coverage on exit, JSON address ranges for *.json and a raw
+//                   64 KiB flag dump otherwise, only available when built with MOS6502_COVERAGE
+//   --profile       track guest calls (Profiler window) and write folded stacks for flamegraphs on exit
+//   --bus-log       write the last N (1000000) bus cycles, one line per cycle, to FILE on exit,
+//                   idle loops are run instead of fast-forwarded so none of their cycles are missing,
+//                   only available when built with MOS6502_INSTRUMENTATION=2
+auto load_program_from_args(int argc, char *argv[]) -> bool {
+    std::string_view path;
+    Address addr = 0x0000;
+    bool as_rom = false;
+    uint64_t hash_interval = 100'000;
+    uint64_t hash_from = 0;
+    uint64_t hash_until = mos6502::no_event;
+    size_t bus_log_size = 1'000'000;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--rom") {
+            as_rom = true;
+        } else if (arg == "--addr" && i + 1 < argc) {
+            addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--cpu" && i + 1 < argc) {
+            const auto variant = mos6502::parse_variant(argv[++i]);
+            if (!variant) {
+                println(std::cerr, "Unknown CPU {}, expected 6502, 6502u or 65c02", argv[i]);
+                return false;
+            }
+            global.cpu.variant = *variant;
+        } else if (arg == "--via" && i + 1 < argc) {
+            const auto base = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+            global.via = std::make_unique<mos6502::Via>(global.scheduler, 0x01);
+            global.via->attach(global.cpu, base, base);
+        } else if (arg == "--tone" && i + 1 < argc) {
+            const auto base = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+            global.tone = std::make_unique<mos6502::ToneDevice>();
+            global.tone->attach(global.cpu, base, base);
+        } else if (arg == "--display" && i + 1 < argc) {
+            if (!global.display) global.display.emplace();
+            global.display->base = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--display-size" && i + 1 < argc) {
+            if (!global.display) global.display.emplace();
+            if (std::sscanf(argv[++i], "%dx%d", &global.display->width, &global.display->height) != 2) return false;
+        } else if (arg == "--hash-log" && i + 1 < argc) {
+            global.hash_log_path = argv[++i];
+        } else if (arg == "--hash-interval" && i + 1 < argc) {
+            hash_interval = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--hash-from" && i + 1 < argc) {
+            hash_from = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--hash-until" && i + 1 < argc) {
+            hash_until = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--coverage" && i + 1 < argc) {
+            global.coverage_path = argv[++i];
+            if (!mos6502::coverage_enabled) println(std::cerr, "--coverage needs a build with MOS6502_COVERAGE, ignored");
+        } else if (arg == "--profile" && i + 1 < argc) {
+            global.profile_path = argv[++i];
+        } else if (arg == "--bus-log" && i + 1 < argc) {
+            global.bus_log_path = argv[++i];
+            if (MOS6502_INSTRUMENTATION != 2) println(std::cerr, "--bus-log needs a build with MOS6502_INSTRUMENTATION=2, ignored");
+        } else if (arg == "--bus-log-size" && i + 1 < argc) {
+            bus_log_size = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            path = arg;
+        }
+    }
+#if MOS6502_INSTRUMENTATION == 2
+    if (!global.bus_log_path.empty()) {
+        global.bus_log = std::make_unique<mos6502::BusLog>(bus_log_size);
+        global.cpu.instrumentation.log = global.bus_log.get();
+        global.cpu.config.fast_forward_idle_loops = false; // Skipped cycles would leave gaps in the log
+    }
+#endif
+    if (!global.hash_log_path.empty()) {
+        global.hash_log = std::make_unique<mos6502::HashLog>(hash_interval, hash_from, hash_until);
+        global.hash_log->start(global.cpu, global.scheduler);
+    }
+    if (path.empty()) {
+        load_example_simple();
+        return true;
+    }
+
+    auto file = mos6502::MappedFile::open(std::string(path));
+    if (!file) return false;
+
+    constexpr size_t address_space = 64 * 1024;
+    if (file->size() > address_space) {
+        global.cartridge = std::make_unique<mos6502::BankedRom>(std::move(*file), 0x8000, 16 * 1024, 2, true);
+        global.cartridge->attach(global.cpu);
+        global.cpu.PC = static_cast<Address>(mos6502::peek(global.cpu, 0xFFFC) | (mos6502::peek(global.cpu, 0xFFFD) << 8));
+        println("Mapped {} banks from {}", global.cartridge->bank_count(), path);
+        return true;
+    }
 
-    pw.jmp_indirect();
-    pw(0x10);
-    pw(0x00);
+    optional<mos6502::LoadResult> result;
+    if (as_rom) {
+        global.rom_image = std::move(*file);
+        result = mos6502::map_rom(global.cpu, *global.rom_image, addr);
+    } else {
+        const auto format = mos6502::detect_format(path, file->bytes());
+        result = mos6502::load_image(global.cpu, file->bytes(), format, addr);
+    }
+    if (!result) return false;
 
-    pw.jmp_absolute();
-    pw(0x00);
-    pw(0x00);
+    global.cpu.PC = mos6502::entry_point(global.cpu, *result);
+    println("Loaded {} into 0x{:04X}-0x{:04X}, PC = 0x{:04X}", path, result->first, result->last, global.cpu.PC);
+    return true;
+}
 
-    pw.addr = 0x10;
-    pw(0x20);
+// Publishes MHz and the emulate / render split once per CONSTANTS::performance_window
+auto update_performance_stats(PerformanceStats &perf) -> void {
+    ++perf.window_frames;
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - perf.window_start;
+    if (elapsed < CONSTANTS::performance_window) return;
 
-    pw.addr = 0x20;
-    pw.jmp_absolute();
-    pw(0x20);
-    pw(0x00);
+    const double busy = (perf.emulate_time + perf.render_time).count();
+    perf.emulated_mhz = static_cast<double>(perf.window_cycles) / elapsed.count() / 1e6;
+    perf.emulate_share = busy > 0.0 ? perf.emulate_time.count() / busy : 0.0;
+    perf.presented_fps = perf.window_frames / elapsed.count();
+    perf.idle_share = perf.window_cycles > 0 ? static_cast<double>(perf.window_idle_cycles) / static_cast<double>(perf.window_cycles) : 0.0;
+    perf = PerformanceStats{
+        .window_start = now,
+        .emulated_mhz = perf.emulated_mhz,
+        .emulate_share = perf.emulate_share,
+        .presented_fps = perf.presented_fps,
+        .idle_share = perf.idle_share,
+    };
 }
 
-auto main() -> int {
+auto compare_hash_logs(const std::string &path_a, const std::string &path_b) -> int {
+    const auto a = mos6502::read_hash_log(path_a);
+    const auto b = mos6502::read_hash_log(path_b);
+    if (!a || !b) {
+        println(std::cerr, "Failed to read hash logs");
+        return EXIT_FAILURE;
+    }
+    const auto divergence = mos6502::first_divergence(*a, *b);
+    if (!divergence) {
+        println("No divergence in {} entries", a->size());
+        return EXIT_SUCCESS;
+    }
+    const size_t i = divergence->index;
+    println("Runs diverge after cycle {} (entry {})", divergence->last_equal_cycle, i);
+    if (i < a->size()) println("  {}: cycle {} PC 0x{:04X} hash {:016X}", path_a, (*a)[i].cycle, (*a)[i].pc, (*a)[i].hash);
+    if (i < b->size()) println("  {}: cycle {} PC 0x{:04X} hash {:016X}", path_b, (*b)[i].cycle, (*b)[i].pc, (*b)[i].hash);
+    println("Log that window with --hash-interval 1 --hash-from {} to find the first divergent instruction",
+        divergence->last_equal_cycle);
+    return EXIT_FAILURE;
+}
+
+auto main(int argc, char *argv[]) -> int {
+    if (argc == 4 && std::string_view(argv[1]) == "--hash-compare") return compare_hash_logs(argv[2], argv[3]);
+
     println("Application starting");
     if (!ENGINE::setup()) assert(false);
     println("Engine setup complete");
 
-    mos6502::initialize_instructions();
     // global.cpu = mos6502::CPU();
-    load_example_simple();
+    if (!load_program_from_args(argc, argv)) {
+        println(std::cerr, "Failed to load program");
+        return EXIT_FAILURE;
+    }
+    if (!global.profile_path.empty()) {
+        global.profiler = std::make_unique<mos6502::CallProfiler>(global.cpu);
+        global.cpu.call_observer = global.profiler.get();
+    }
+    if (mos6502::searchable(global.cpu)) {
+        global.history.emplace(CONSTANTS::history_interval);
+        global.history->record(global.cpu);
+    }
+    if (global.display) {
+        const auto &fb = *global.display;
+        if (fb.width <= 0 || fb.height <= 0 || fb.base + fb.size() > 0x10000) {
+            println(std::cerr, "Display {}x{} at 0x{:04X} does not fit into memory", fb.width, fb.height, fb.base);
+            return EXIT_FAILURE;
+        }
+        ENGINE::setup_blit();
+        DISPLAY::setup(*global.display);
+    }
     // auto pw = mos6502::ProgramWriter(global.cpu);
     // pw.bne();
     // pw(0x05);
@@ -73,6 +265,7 @@ auto main() -> int {
     global.is_running = true;
     global.sim.run_start_time = std::chrono::steady_clock::now();
     global.sim.frame_start_time = global.sim.run_start_time;
+    global.sim.perf.window_start = global.sim.run_start_time;
 
     println("Entering main loop");
     while (global.is_running) {
@@ -83,39 +276,102 @@ auto main() -> int {
         global.sim.frame_start_time = now;
         global.sim.total_runtime = now - global.sim.run_start_time;
 
-        INPUT::handle_input();
+        if (global.sim.is_idle()) {
+            // Nothing changes while paused without input, skip the UI rebuild and the swap entirely
+            if (!INPUT::wait_for_input(CONSTANTS::idle_wait_timeout_ms)) continue;
+        } else {
+            const TRACE::Scope zone(TRACE::Zone::input);
+            INPUT::handle_input();
+        }
+        const TRACE::Scope frame_zone(TRACE::Zone::frame); // Up to the swap, waiting for input while idle is not part of it
 
         if (global.sim.is_debugging) {
             if (global.sim.step_once) {
-                global.cpu_snapshots.push(mos6502::CPUSnapshot{.cpu = global.cpu});
+                mos6502::CPUSnapshot snapshot{.cpu = global.cpu};
+                mos6502::encode_devices(global.cpu, snapshot.devices);
+                global.cpu_snapshots.push(std::move(snapshot));
                 if (global.cpu_snapshots.size() > 100) {
                     println("There are more than 100 Snapshots stored, currently we copy entire memory buffer for every snapshot!");
                 }
                 mos6502::tick(global.cpu);
+                global.scheduler.dispatch_due(global.cpu);
                 global.sim.step_once = false;
             } else if (global.sim.step_back) {
                 if (!global.cpu_snapshots.empty()) {
-                    global.cpu = global.cpu_snapshots.top().cpu;
+                    const mos6502::CPUSnapshot &snapshot = global.cpu_snapshots.top();
+                    global.cpu = snapshot.cpu;
+                    if (!mos6502::decode_devices(global.cpu, snapshot.devices)) println("Devices did not take their snapshot back");
                     global.cpu_snapshots.pop();
+                    global.rewound();
                 } else {
                     println("Tried to step back but empyt snapshot registry");
                 }
                 global.sim.step_back = false;
             }
         } else {
-            mos6502::tick(global.cpu);
+            const auto emulate_start = std::chrono::steady_clock::now();
+            const uint64_t start_cycles = global.cpu.cycles;
+            if (global.sim.turbo) {
+                // Flat out in large batches until the next UI refresh is due, every frame in between is skipped
+                const auto deadline = global.sim.frame_start_time + CONSTANTS::timer_update_delay;
+                do {
+                    const TRACE::Scope zone(TRACE::Zone::emulate);
+                    global.sim.perf.window_idle_cycles +=
+                        mos6502::run_until(global.cpu, global.scheduler, global.cpu.cycles + CONSTANTS::turbo_batch_cycles);
+                } while (std::chrono::steady_clock::now() < deadline);
+            } else {
+                const TRACE::Scope zone(TRACE::Zone::emulate);
+                global.sim.perf.window_idle_cycles +=
+                    mos6502::run_until(global.cpu, global.scheduler, global.cpu.cycles + CONSTANTS::n_iter_per_frame);
+            }
+            if (global.tone) AUDIO::pump(global.audio, *global.tone, global.cpu.cycles);
+            if (global.history) global.history->record(global.cpu);
+            global.sim.perf.emulate_time += std::chrono::steady_clock::now() - emulate_start;
+            global.sim.perf.window_cycles += global.cpu.cycles - start_cycles;
         }
 
-        RENDER::gui_debug();
-        RENDER::frame();
-
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(global.renderer.window);
+        const auto render_start = std::chrono::steady_clock::now();
+        {
+            const TRACE::Scope zone(TRACE::Zone::gui_debug);
+            RENDER::gui_debug();
+        }
+        {
+            const TRACE::Scope zone(TRACE::Zone::imgui_render);
+            ImGui::Render();
+        }
+        {
+            const TRACE::Scope zone(TRACE::Zone::gl_draw);
+            RENDER::frame();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        {
+            const TRACE::Scope zone(TRACE::Zone::swap);
+            SDL_GL_SwapWindow(global.renderer.window);
+        }
+        global.sim.perf.render_time += std::chrono::steady_clock::now() - render_start;
+        update_performance_stats(global.sim.perf);
+        global.trace.collect(); // This frame's zone lands in the next collect, it closes below
 
         global.sim.frame_counter += 1;
+        if (global.sim.redraw_frames > 0) --global.sim.redraw_frames;
     }
 
     println("Main loop exited");
+    if (global.hash_log && !mos6502::write_hash_log(global.hash_log_path, global.hash_log->entries())) {
+        println(std::cerr, "Failed to write hash log {}", global.hash_log_path);
+    }
+    if (global.profiler) {
+        global.profiler->charge(global.cpu);
+        if (!global.profiler->write_folded(global.profile_path)) println(std::cerr, "Failed to write profile {}", global.profile_path);
+    }
+    if (global.bus_log && !mos6502::write_bus_log(global.bus_log_path, *global.bus_log)) {
+        println(std::cerr, "Failed to write bus log {}", global.bus_log_path);
+    }
+#if MOS6502_COVERAGE
+    if (!global.coverage_path.empty() && !mos6502::write_coverage(global.coverage_path, global.cpu.coverage)) {
+        println(std::cerr, "Failed to write coverage {}", global.coverage_path);
+    }
+#endif
     ENGINE::cleanup();
     println("Engine cleanup complete");
     println("Application exiting successfully");
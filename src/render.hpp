@@ -47,6 +47,8 @@ inline auto cpu_register(mos6502::CPU &cpu) -> void {
         ImGui::Text("RDY  %s", cpu.rdy ? "true" : "false");
         ImGui::TableSetColumnIndex(1);
         ImGui::Text("TMP  %02X", cpu.tmp);
+        ImGui::TableSetColumnIndex(2);
+        ImGui::Text("CHIP %s", mos6502::to_string(cpu.variant));
         ImGui::EndTable();
     }
     ImGui::Text(
@@ -54,7 +56,214 @@ inline auto cpu_register(mos6502::CPU &cpu) -> void {
         mos6502::to_string(cpu.instr.mode),
         mos6502::to_string(cpu.instr.type),
         cpu.instr_counter);
+    ImGui::Text("State hash %016llX%s", static_cast<unsigned long long>(mos6502::state_hash(cpu)),
+        cpu.instr_counter == 0 ? "" : " (mid instruction)");
+}
+inline auto disassembly(mos6502::CPU &cpu) -> void {
+    auto &cache = global.disassembly;
+    auto &view = global.disassembly_view;
+
+    const Address current = (cpu.instr_counter == 0) ? cpu.PC : cpu.instr_addr;
+    cache.add_anchor(cpu, current);
+
+    ImGui::Checkbox("Follow PC", &view.follow_pc);
+    ImGui::SameLine();
+    ImGui::SliderInt("Rows", &view.rows, 8, 64);
+    if (view.follow_pc) view.cursor = current;
+
+    ImGui::BeginChild("disassembly_lines", ImVec2(0, 0), true);
+    if (ImGui::IsWindowHovered()) {
+        const int wheel_steps = static_cast<int>(ImGui::GetIO().MouseWheel);
+        if (wheel_steps != 0) view.follow_pc = false;
+        for (int i = 0; i < wheel_steps; ++i) {
+            view.cursor = cache.previous_boundary(cpu, view.cursor);
+        }
+        for (int i = 0; i > wheel_steps; --i) {
+            view.cursor = static_cast<Address>(view.cursor + cache.line_at(cpu, view.cursor).length);
+        }
+    }
+
+    constexpr ImU32 COLOR_PC = IM_COL32(255, 50, 50, 255);
+    constexpr ImU32 COLOR_CURSOR = IM_COL32(50, 150, 255, 255);
+    const auto rows = static_cast<size_t>(view.rows);
+    const size_t before = rows / 3;
+    for (const auto *line : cache.lines_around(cpu, view.cursor, before, rows - before - 1)) {
+        const bool is_pc = line->addr == current;
+        const bool is_cursor = line->addr == view.cursor;
+        if (is_pc) {
+            ImGui::PushStyleColor(ImGuiCol_Text, COLOR_PC);
+        } else if (is_cursor) {
+            ImGui::PushStyleColor(ImGuiCol_Text, COLOR_CURSOR);
+        }
+
+        char bytes[12];
+        switch (line->length) {
+        case 1:
+            std::snprintf(bytes, sizeof(bytes), "%02X", line->bytes[0]);
+            break;
+        case 2:
+            std::snprintf(bytes, sizeof(bytes), "%02X %02X", line->bytes[0], line->bytes[1]);
+            break;
+        default:
+            std::snprintf(bytes, sizeof(bytes), "%02X %02X %02X", line->bytes[0], line->bytes[1], line->bytes[2]);
+            break;
+        }
+        ImGui::Text("%s 0x%04X  %-8s  %s", is_pc ? ">" : " ", line->addr, bytes, line->text.c_str());
+
+        if (is_pc || is_cursor) ImGui::PopStyleColor();
+    }
+    ImGui::EndChild();
+}
+
+// Calling context tree, children sorted by inclusive cycles, hot paths open by default
+inline auto profiler(mos6502::CallProfiler &profiler, const mos6502::CPU &cpu) -> void {
+    profiler.charge(cpu);
+    const auto &nodes = profiler.nodes();
+    const auto inclusive = profiler.inclusive_cycles();
+    const double total = static_cast<double>(std::max<uint64_t>(inclusive[0], 1));
+
+    if (ImGui::Button("Reset")) profiler.reset(cpu);
+    ImGui::SameLine();
+    if (ImGui::Button("Write folded stacks")) {
+        const std::string path = global.profile_path.empty() ? CONSTANTS::fp_profile : global.profile_path;
+        if (profiler.write_folded(path)) println("Wrote profile to {}", path);
+    }
+    ImGui::Text("%zu call paths, shadow stack depth %zu", nodes.size(), profiler.depth());
+
+    std::vector<uint32_t> children;
+    auto draw_node = [&](auto &self, uint32_t index) -> void {
+        const auto &node = nodes[index];
+        const std::string name = mos6502::CallProfiler::frame_name(node, index == 0);
+        const double share = static_cast<double>(inclusive[index]) / total;
+        if (share > 0.2) ImGui::SetNextItemOpen(true, ImGuiCond_Once);
+        const bool open = ImGui::TreeNodeEx(reinterpret_cast<void *>(static_cast<uintptr_t>(index)),
+            node.first_child == mos6502::ProfileNode::none ? ImGuiTreeNodeFlags_Leaf : ImGuiTreeNodeFlags_None,
+            "%-12s %5.1f%%  incl %llu  excl %llu  calls %llu", name.c_str(), 100.0 * share,
+            static_cast<unsigned long long>(inclusive[index]), static_cast<unsigned long long>(node.self_cycles),
+            static_cast<unsigned long long>(node.calls));
+        if (!open) return;
+        const size_t first = children.size();
+        for (uint32_t c = node.first_child; c != mos6502::ProfileNode::none; c = nodes[c].next_sibling) children.push_back(c);
+        std::sort(children.begin() + static_cast<std::ptrdiff_t>(first), children.end(),
+            [&](uint32_t a, uint32_t b) { return inclusive[a] > inclusive[b]; });
+        for (size_t i = first; i < children.size(); ++i) self(self, children[i]);
+        children.resize(first);
+        ImGui::TreePop();
+    };
+    ImGui::BeginChild("profile_tree", ImVec2(0, 0), true);
+    draw_node(draw_node, 0);
+    ImGui::EndChild();
+}
+
+// Rolling frame time graph and per zone percentiles, plus capturing to a Chrome trace
+inline auto frame_timing(TRACE::Collector &trace) -> void {
+    const auto frames = trace.samples(TRACE::Zone::frame);
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "p50 %.2f ms  p99 %.2f ms",
+        trace.percentile(TRACE::Zone::frame, 0.5), trace.percentile(TRACE::Zone::frame, 0.99));
+    ImGui::PlotLines("Frame (ms)", frames.data(), static_cast<int>(frames.size()), trace.offset(TRACE::Zone::frame),
+        overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+    if (ImGui::BeginTable("zones", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Last ms");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p99 ms");
+        ImGui::TableHeadersRow();
+        for (size_t i = 0; i < static_cast<size_t>(TRACE::Zone::count); ++i) {
+            const auto zone = static_cast<TRACE::Zone>(i);
+            if (trace.samples(zone).empty()) continue;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(TRACE::zone_names[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", trace.last(zone));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", trace.percentile(zone, 0.5));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", trace.percentile(zone, 0.99));
+        }
+        ImGui::EndTable();
+    }
+
+    if (!trace.capturing()) {
+        if (ImGui::Button("Start capture")) trace.start_capture();
+    } else if (ImGui::Button("Stop and save capture")) {
+        trace.stop_capture();
+        if (trace.write_chrome_trace(CONSTANTS::fp_trace)) {
+            println("Wrote {} zones to {}", trace.captured(), CONSTANTS::fp_trace);
+        } else {
+            println(std::cerr, "Failed to write trace {}", CONSTANTS::fp_trace);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu zones captured, %llu dropped", trace.captured(), static_cast<unsigned long long>(trace.dropped()));
 }
+
+// Replays the retained checkpoints for the first instruction where the condition holds. The
+// search copies what it needs, so emulation keeps running and the result is a state to go to.
+inline auto history_search(SearchState &search, mos6502::History &history) -> void {
+    const auto &checkpoints = history.checkpoints();
+    ImGui::Text("%zu checkpoints every %llu cycles (%.2f MB)", checkpoints.size(),
+        static_cast<unsigned long long>(history.interval()), UTIL::byte_to_mb(history.bytes()));
+
+    using Kind = mos6502::Condition::Kind;
+    int kind = static_cast<int>(search.condition.kind);
+    if (ImGui::Combo("Condition", &kind, mos6502::condition_names.data(), static_cast<int>(mos6502::condition_names.size()))) {
+        search.condition.kind = static_cast<Kind>(kind);
+    }
+    const Kind selected = search.condition.kind;
+    if (selected == Kind::pc_equals || selected == Kind::mem_equals || selected == Kind::mem_not_equals) {
+        ImGui::InputScalar("addr", ImGuiDataType_U16, &search.condition.addr, nullptr, nullptr, "%04X", ImGuiInputTextFlags_CharsHexadecimal);
+    }
+    if (selected != Kind::pc_equals) {
+        ImGui::InputScalar("value", ImGuiDataType_U8, &search.condition.value, nullptr, nullptr, "%02X", ImGuiInputTextFlags_CharsHexadecimal);
+    }
+
+    if (search.job.valid() && search.job.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        search.result = search.job.get();
+        search.searched = true;
+    }
+    if (search.job.valid()) {
+        global.sim.redraw_frames = CONSTANTS::redraw_frames_after_event; // Keep polling while paused
+        ImGui::Text("Searching cycles %llu..%llu", static_cast<unsigned long long>(checkpoints.empty() ? 0 : checkpoints.front().cycle),
+            static_cast<unsigned long long>(global.cpu.cycles));
+        return;
+    }
+    if (ImGui::Button("Search") && !checkpoints.empty()) {
+        auto wiring = std::make_unique<mos6502::CPU>(global.cpu);
+        search.job = std::async(std::launch::async,
+            [wiring = std::move(wiring), checkpoints = checkpoints, end = global.cpu.cycles, condition = search.condition] {
+                return mos6502::search_first(*wiring, checkpoints, end,
+                    [condition](const mos6502::CPU &cpu) { return condition.holds(cpu); },
+                    std::max(1u, std::thread::hardware_concurrency()));
+            });
+        return;
+    }
+    if (!search.searched) return;
+
+    const double mhz = search.result.seconds > 0.0 ? static_cast<double>(search.result.replayed_cycles) / search.result.seconds / 1e6 : 0.0;
+    ImGui::Text("Replayed %.1fM cycles in %.2f s (%.0f MHz)", static_cast<double>(search.result.replayed_cycles) / 1e6,
+        search.result.seconds, mhz);
+    if (!search.result.cpu) {
+        ImGui::TextUnformatted("Condition never held");
+        return;
+    }
+    const mos6502::CPU &found = *search.result.cpu;
+    ImGui::Text("First held at cycle %llu, PC 0x%04X", static_cast<unsigned long long>(found.cycles), found.PC);
+    ImGui::SameLine();
+    if (ImGui::Button("Go to")) {
+        // Through a save state, the live CPU keeps its observers, logs and coverage
+        std::vector<Byte> state;
+        mos6502::encode_state(found, state);
+        if (mos6502::decode_state(global.cpu, state)) {
+            global.rewound();
+            std::stack<mos6502::CPUSnapshot>().swap(global.cpu_snapshots);
+            global.debug_activate();
+        }
+    }
+}
+
 inline auto gui_debug() -> void {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(global.renderer.window);
@@ -74,16 +283,46 @@ inline auto gui_debug() -> void {
     ImGui::Text("Is Debugging %s", global.sim.is_debugging ? "true" : "false");
     ImGui::Text("Is Stepping      %s", global.sim.step_once ? "true" : "false");
     ImGui::Text("Is Back Stepping %s", global.sim.step_back ? "true" : "false");
+    ImGui::Text("Turbo (T) %s", global.sim.turbo ? "on" : "off");
+    ImGui::Text("Emulated %.3f MHz, %.0f fps presented", global.sim.perf.emulated_mhz, global.sim.perf.presented_fps);
+    ImGui::Text("Host time: %.0f%% emulating, %.0f%% rendering",
+        100.0 * global.sim.perf.emulate_share, 100.0 * (1.0 - global.sim.perf.emulate_share));
+    ImGui::Checkbox("Fast-forward idle loops", &global.cpu.config.fast_forward_idle_loops);
+    ImGui::SameLine();
+    ImGui::Text("(%.0f%% of cycles skipped)", 100.0 * global.sim.perf.idle_share);
+    ImGui::Checkbox("Hybrid execution (whole instructions where timing allows)", &global.cpu.config.hybrid_execution);
+    if constexpr (mos6502::coverage_enabled) {
+        ImGui::Checkbox("Coverage overlay", &global.memory_view.coverage_overlay);
+        ImGui::SameLine();
+        if (ImGui::Button("Reset coverage")) global.cpu.coverage.clear();
+    }
     ImGui::Text("CPU snapshots %zu (%.2f MB)",
         global.cpu_snapshots.size(),
         UTIL::byte_to_mb(global.cpu_snapshots.size() *
                          sizeof(mos6502::CPUSnapshot)));
+    if (ImGui::CollapsingHeader("Frame timing")) frame_timing(global.trace);
     ImGui::End();
 
     ImGui::Begin("CPU");
     cpu_register(global.cpu);
     ImGui::End();
 
+    ImGui::Begin("Disassembly");
+    disassembly(global.cpu);
+    ImGui::End();
+
+    if (global.profiler) {
+        ImGui::Begin("Profiler");
+        profiler(*global.profiler, global.cpu);
+        ImGui::End();
+    }
+
+    if (global.history) {
+        ImGui::Begin("Search");
+        history_search(global.search, *global.history);
+        ImGui::End();
+    }
+
     if (!global.cpu_snapshots.empty()) {
         ImGui::Begin("CPU (Snapshot)");
         cpu_register(global.cpu_snapshots.top().cpu);
@@ -95,6 +334,21 @@ inline auto gui_debug() -> void {
     constexpr ImU32 COLOR_ADDR = IM_COL32(50, 150, 255, 255); // blue
     constexpr ImU32 COLOR_BOTH = IM_COL32(255, 175, 0, 255);  // orange
 
+    /* coverage overlay colors, executed beats written beats read */
+    constexpr ImU32 COLOR_COV_OPCODE = IM_COL32(80, 220, 80, 255);   // green
+    constexpr ImU32 COLOR_COV_OPERAND = IM_COL32(40, 140, 40, 255);  // dark green
+    constexpr ImU32 COLOR_COV_WRITE = IM_COL32(230, 210, 60, 255);   // yellow
+    constexpr ImU32 COLOR_COV_READ = IM_COL32(80, 200, 220, 255);    // cyan
+    constexpr ImU32 COLOR_COV_UNUSED = IM_COL32(110, 110, 110, 255); // grey
+    auto coverage_color = [&](size_t idx) -> ImU32 {
+        const Byte flags = global.cpu.coverage.get(static_cast<Address>(idx));
+        if (flags & mos6502::COVERAGE_OPCODE) return COLOR_COV_OPCODE;
+        if (flags & mos6502::COVERAGE_OPERAND) return COLOR_COV_OPERAND;
+        if (flags & mos6502::COVERAGE_WRITE) return COLOR_COV_WRITE;
+        if (flags & mos6502::COVERAGE_READ) return COLOR_COV_READ;
+        return COLOR_COV_UNUSED;
+    };
+
     auto draw_memory_window = [&](const char *title,
                                   uint16_t center_addr,
                                   size_t display_lines) {
@@ -125,6 +379,7 @@ inline auto gui_debug() -> void {
 
                 bool is_pc = (idx == global.cpu.PC);
                 bool is_addr = (idx == global.cpu.temporary_address_register);
+                bool is_colored = is_pc || is_addr || global.memory_view.coverage_overlay;
 
                 if (is_pc && is_addr) {
                     ImGui::PushStyleColor(ImGuiCol_Text, COLOR_BOTH);
@@ -132,11 +387,13 @@ inline auto gui_debug() -> void {
                     ImGui::PushStyleColor(ImGuiCol_Text, COLOR_PC);
                 } else if (is_addr) {
                     ImGui::PushStyleColor(ImGuiCol_Text, COLOR_ADDR);
+                } else if (global.memory_view.coverage_overlay) {
+                    ImGui::PushStyleColor(ImGuiCol_Text, coverage_color(idx));
                 }
 
-                ImGui::Text("%02X", global.cpu.mem[idx]);
+                ImGui::Text("%02X", mos6502::peek(global.cpu, static_cast<Address>(idx)));
 
-                if (is_pc || is_addr) ImGui::PopStyleColor();
+                if (is_colored) ImGui::PopStyleColor();
 
                 if (j < BYTES_PER_LINE - 1) ImGui::SameLine();
             }
@@ -149,9 +406,6 @@ inline auto gui_debug() -> void {
 
     /* Compact ADDR-centered view */
     draw_memory_window("Addr Memory Neighborhood", global.cpu.temporary_address_register, 6);
-
-    /* ImGui Render */
-    ImGui::Render();
 }
 
 inline auto frame() -> void {
@@ -163,5 +417,11 @@ inline auto frame() -> void {
         global.color.background.b,
         1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
+
+    if (global.display) {
+        DISPLAY::upload(*global.display, global.cpu);
+        DISPLAY::draw(*global.display, global.renderer.blit_shader, global.renderer.blit_quad, global.renderer.draw_buffer,
+            global.renderer.imgui_io.DisplaySize.x / global.renderer.imgui_io.DisplaySize.y);
+    }
 }
 } // namespace RENDER
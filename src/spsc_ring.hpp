@@ -0,0 +1,53 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+namespace UTIL {
+// Wait-free single producer / single consumer ring. Each side only ever stores its own
+// index and loads the other one, so neither can block the other (no locks, no CAS loops).
+// Indices run freely and are masked on access, Capacity has to be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    [[nodiscard]] static constexpr auto capacity() -> size_t { return Capacity; }
+
+    // Approximate when called from the other side, exact from either owner
+    [[nodiscard]] auto size() const -> size_t {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // Producer side, returns how many elements fit
+    auto push(std::span<const T> items) -> size_t {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t count = std::min(items.size(), Capacity - (head - tail));
+        for (size_t i = 0; i < count; ++i) m_buffer[(head + i) & (Capacity - 1)] = items[i];
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side, returns how many elements were available
+    auto pop(std::span<T> items) -> size_t {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t count = std::min(items.size(), head - tail);
+        for (size_t i = 0; i < count; ++i) items[i] = m_buffer[(tail + i) & (Capacity - 1)];
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    static constexpr size_t cache_line = 64;
+
+    alignas(cache_line) std::atomic<size_t> m_head = 0; // Written by the producer only
+    alignas(cache_line) std::atomic<size_t> m_tail = 0; // Written by the consumer only
+    alignas(cache_line) std::array<T, Capacity> m_buffer = {};
+};
+} // namespace UTIL
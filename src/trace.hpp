@@ -0,0 +1,195 @@
+/* danielsinkin97@gmail.com */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "spsc_ring.hpp"
+#include "types.hpp"
+
+namespace TRACE {
+// Where a frame goes. Zones may nest (frame encloses everything else on the main thread).
+enum class Zone : uint8_t {
+    frame,
+    input,
+    emulate, // One run_until batch, turbo runs several per frame
+    gui_debug,
+    imgui_render,
+    gl_draw,
+    swap,
+    load_assets,
+    count,
+};
+
+inline constexpr std::array<const char *, static_cast<size_t>(Zone::count)> zone_names = {
+    "frame",
+    "input",
+    "emulate",
+    "gui_debug",
+    "imgui_render",
+    "gl_draw",
+    "swap",
+    "load_assets",
+};
+
+struct ZoneEvent {
+    int64_t begin_ns = 0; // Since epoch
+    int64_t end_ns = 0;
+    uint32_t thread = 0;
+    Zone zone = Zone::frame;
+};
+
+inline const auto epoch = std::chrono::steady_clock::now();
+
+[[nodiscard]] inline auto now_ns() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Every thread records into its own ring, the main thread drains all of them once per frame.
+// The registry lock is only taken when a thread records its first zone and while draining,
+// recording itself never waits. Rings outlive their threads so late events are not lost.
+struct ThreadBuffer {
+    uint32_t thread = 0;
+    UTIL::SpscRing<ZoneEvent, 4096> ring;
+    std::atomic<uint64_t> dropped = 0; // Events that found the ring full
+};
+
+inline std::mutex registry_mutex;
+inline std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+[[nodiscard]] inline auto thread_buffer() -> ThreadBuffer & {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+        const std::scoped_lock lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        buffer = registry.back().get();
+        buffer->thread = static_cast<uint32_t>(registry.size());
+    }
+    return *buffer;
+}
+
+inline auto record(Zone zone, int64_t begin_ns, int64_t end_ns) -> void {
+    ThreadBuffer &buffer = thread_buffer();
+    const ZoneEvent event{.begin_ns = begin_ns, .end_ns = end_ns, .thread = buffer.thread, .zone = zone};
+    if (buffer.ring.push(std::span<const ZoneEvent>(&event, 1)) == 0) buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+class Scope {
+public:
+    explicit Scope(Zone zone) : m_zone(zone), m_begin(now_ns()) {}
+    ~Scope() { record(m_zone, m_begin, now_ns()); }
+    Scope(const Scope &) = delete;
+    auto operator=(const Scope &) -> Scope & = delete;
+
+private:
+    Zone m_zone;
+    int64_t m_begin;
+};
+
+// Main thread side: rolling per zone durations for the debug window and an optional capture
+class Collector {
+public:
+    static constexpr size_t history = 256;
+    static constexpr size_t max_capture_events = size_t{1} << 20;
+
+    // Drains every thread's ring, once per frame
+    auto collect() -> void {
+        const std::scoped_lock lock(registry_mutex);
+        std::array<ZoneEvent, 256> batch;
+        for (const auto &buffer : registry) {
+            size_t got;
+            while ((got = buffer->ring.pop(batch)) > 0) {
+                for (size_t i = 0; i < got; ++i) add(batch[i]);
+            }
+        }
+    }
+
+    // Last `history` durations of zone in milliseconds, oldest first when full
+    [[nodiscard]] auto samples(Zone zone) const -> std::span<const float> {
+        const auto &s = m_samples[static_cast<size_t>(zone)];
+        return std::span<const float>(s.values.data(), std::min(s.count, history));
+    }
+
+    // Offset for ImGui::PlotLines so the newest sample is drawn last
+    [[nodiscard]] auto offset(Zone zone) const -> int {
+        const auto &s = m_samples[static_cast<size_t>(zone)];
+        return s.count < history ? 0 : static_cast<int>(s.count % history);
+    }
+
+    [[nodiscard]] auto last(Zone zone) const -> float {
+        const auto &s = m_samples[static_cast<size_t>(zone)];
+        return s.count == 0 ? 0.0f : s.values[(s.count - 1) % history];
+    }
+
+    // p in [0, 1] over the rolling window, nearest rank
+    [[nodiscard]] auto percentile(Zone zone, double p) const -> float {
+        const auto window = samples(zone);
+        if (window.empty()) return 0.0f;
+        std::array<float, history> sorted;
+        std::ranges::copy(window, sorted.begin());
+        const auto rank = static_cast<size_t>(p * static_cast<double>(window.size() - 1) + 0.5);
+        std::nth_element(sorted.begin(), sorted.begin() + static_cast<ptrdiff_t>(rank), sorted.begin() + static_cast<ptrdiff_t>(window.size()));
+        return sorted[rank];
+    }
+
+    auto start_capture() -> void {
+        m_capture.clear();
+        m_capturing = true;
+    }
+    auto stop_capture() -> void { m_capturing = false; }
+    [[nodiscard]] auto capturing() const -> bool { return m_capturing; }
+    [[nodiscard]] auto captured() const -> size_t { return m_capture.size(); }
+
+    [[nodiscard]] auto dropped() const -> uint64_t {
+        const std::scoped_lock lock(registry_mutex);
+        uint64_t total = 0;
+        for (const auto &buffer : registry) total += buffer->dropped.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // Trace Event Format, complete ("X") events in microseconds, opens in chrome://tracing and Perfetto
+    auto write_chrome_trace(const std::string &path) const -> bool {
+        json events = json::array();
+        for (const ZoneEvent &e : m_capture) {
+            events.push_back({
+                {"name", zone_names[static_cast<size_t>(e.zone)]},
+                {"ph", "X"},
+                {"ts", static_cast<double>(e.begin_ns) / 1000.0},
+                {"dur", static_cast<double>(e.end_ns - e.begin_ns) / 1000.0},
+                {"pid", 1},
+                {"tid", e.thread},
+            });
+        }
+        std::ofstream file(path);
+        if (!file) return false;
+        file << json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump() << '\n';
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct Samples {
+        std::array<float, history> values{};
+        size_t count = 0;
+    };
+
+    std::array<Samples, static_cast<size_t>(Zone::count)> m_samples{};
+    std::vector<ZoneEvent> m_capture;
+    bool m_capturing = false;
+
+    auto add(const ZoneEvent &event) -> void {
+        auto &s = m_samples[static_cast<size_t>(event.zone)];
+        s.values[s.count % history] = static_cast<float>(event.end_ns - event.begin_ns) / 1e6f;
+        ++s.count;
+        if (m_capturing && m_capture.size() < max_capture_events) m_capture.push_back(event);
+    }
+};
+} // namespace TRACE
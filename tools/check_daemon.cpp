@@ -0,0 +1,283 @@
+/* danielsinkin97@gmail.com */
+
+// Round trip through the daemon protocol: starts the daemon binary given on the command line on
+// a small ROM mapped image in a temporary directory, then sends every op over its socket and
+// checks the replies. Covers running to a PC and to a memory value, exact cycle budgets, overlay
+// writes and their rejection in ROM, bad requests, reset dropping a job's changes, a fresh
+// session per connection and a clean shutdown on SIGTERM.
+// Exits non-zero on the first unexpected reply.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "6502/6502.hpp"
+#include "6502/save_state.hpp"
+
+using namespace mos6502;
+using save_state_detail::Reader;
+using save_state_detail::Writer;
+using std::println;
+
+namespace {
+constexpr Address rom_addr = 0xF000;
+constexpr Address loop_end = 0xF009;
+
+// ldx #0 / inx / stx $10 / cpx #5 / bne inx / jmp * at $F000, entered there
+const std::vector<Byte> program = {0xA2, 0x00, 0xE8, 0x86, 0x10, 0xE0, 0x05, 0xD0, 0xF9, 0x4C, 0x09, 0xF0};
+
+struct Registers {
+    Address PC = 0x0000;
+    Byte A = 0, X = 0, Y = 0, SP = 0, P = 0;
+    uint64_t cycles = 0;
+};
+
+struct Reply {
+    Byte status = 0xFF;
+    std::vector<Byte> payload; // Without the status byte
+};
+
+auto connect_to(const std::string &path) -> int {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+auto exchange(int fd, const std::vector<Byte> &request) -> std::optional<Reply> {
+    std::vector<Byte> frame;
+    Writer w{.out = frame};
+    w.u32(static_cast<uint32_t>(request.size()));
+    w.bytes(request);
+    if (::write(fd, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size())) return std::nullopt;
+
+    const auto read_exact = [fd](std::vector<Byte> &into, size_t size) {
+        into.resize(size);
+        for (size_t got = 0; got < size;) {
+            const ssize_t n = ::read(fd, into.data() + got, size - got);
+            if (n <= 0) return false;
+            got += static_cast<size_t>(n);
+        }
+        return true;
+    };
+    std::vector<Byte> header;
+    if (!read_exact(header, 4)) return std::nullopt;
+    Reader r{.in = header};
+    std::vector<Byte> payload;
+    if (!read_exact(payload, r.u32()) || payload.empty()) return std::nullopt;
+    return Reply{.status = payload[0], .payload = std::vector<Byte>(payload.begin() + 1, payload.end())};
+}
+
+auto read_registers(Reader &r) -> Registers {
+    Registers regs;
+    regs.PC = r.u16();
+    regs.A = r.u8();
+    regs.X = r.u8();
+    regs.Y = r.u8();
+    regs.SP = r.u8();
+    regs.P = r.u8();
+    regs.cycles = r.u64();
+    return regs;
+}
+
+// Sends requests over one connection, remembers the first failure
+class Client {
+public:
+    explicit Client(int fd) : m_fd(fd) {}
+    ~Client() { close(m_fd); }
+    Client(const Client &) = delete;
+    auto operator=(const Client &) -> Client & = delete;
+
+    [[nodiscard]] auto ok() const -> bool { return m_ok; }
+
+    auto expect(bool condition, const char *what) -> void {
+        if (m_ok && !condition) {
+            println(std::cerr, "Unexpected reply: {}", what);
+            m_ok = false;
+        }
+    }
+
+    // Sends the request and checks the status, the payload is empty when anything failed
+    auto send(const std::vector<Byte> &request, Byte status, const char *what) -> std::vector<Byte> {
+        const auto reply = exchange(m_fd, request);
+        expect(reply.has_value(), "connection closed");
+        if (!reply) return {};
+        expect(reply->status == status, what);
+        return reply->payload;
+    }
+
+    auto regs() -> Registers {
+        const auto payload = send({7}, 0, "regs");
+        Reader r{.in = payload};
+        const Registers regs = read_registers(r);
+        expect(r.ok && r.pos == payload.size(), "regs size");
+        return regs;
+    }
+
+    auto read(Address addr, uint32_t size) -> std::vector<Byte> {
+        std::vector<Byte> request;
+        Writer w{.out = request};
+        w.u8(6);
+        w.u16(addr);
+        w.u32(size);
+        auto bytes = send(request, 0, "read");
+        expect(bytes.size() == size, "read size");
+        return bytes;
+    }
+
+    auto write(Address addr, const std::vector<Byte> &bytes, Byte status, const char *what) -> void {
+        std::vector<Byte> request;
+        Writer w{.out = request};
+        w.u8(2);
+        w.u16(addr);
+        w.bytes(bytes);
+        send(request, status, what);
+    }
+
+    auto run(uint64_t cycles) -> Registers {
+        std::vector<Byte> request;
+        Writer w{.out = request};
+        w.u8(4);
+        w.u64(cycles);
+        const auto payload = send(request, 0, "run");
+        Reader r{.in = payload};
+        return read_registers(r);
+    }
+
+    // Returns whether the condition was reached
+    auto run_until(Byte kind, Address addr, Byte value, uint64_t max, Registers &regs) -> bool {
+        std::vector<Byte> request;
+        Writer w{.out = request};
+        w.u8(5);
+        w.u8(kind);
+        w.u16(addr);
+        w.u8(value);
+        w.u64(max);
+        const auto payload = send(request, 0, "run_until");
+        Reader r{.in = payload};
+        const bool reached = r.u8() != 0;
+        regs = read_registers(r);
+        expect(r.ok, "run_until size");
+        return reached;
+    }
+
+private:
+    int m_fd;
+    bool m_ok = true;
+};
+
+auto check_job(Client &c) -> void {
+    Registers regs = c.regs();
+    c.expect(regs.PC == rom_addr && regs.SP == 0xFF, "job starts at the image's entry point");
+
+    c.expect(c.run_until(0, loop_end, 0, 1000, regs), "loop end reached");
+    c.expect(regs.PC == loop_end && regs.X == 5, "loop ran five times");
+    c.expect(c.read(0x0010, 1) == std::vector<Byte>{5}, "stx $10 visible to read");
+
+    const uint64_t before = regs.cycles;
+    c.expect(!c.run_until(1, 0x0010, 6, 100, regs), "memory condition never holds");
+    c.expect(regs.cycles == before + 100, "max bounds run_until");
+    const uint64_t start = regs.cycles;
+    c.expect(c.run(50).cycles == start + 50, "run takes exactly the budget");
+
+    c.write(rom_addr, {0xEA}, 1, "write into ROM rejected");
+    c.expect(c.read(rom_addr, 2) == std::vector<Byte>{0xA2, 0x00}, "ROM unchanged");
+    c.write(0x0200, {1, 2, 3}, 0, "write into RAM");
+    c.expect(c.read(0x01FF, 5) == std::vector<Byte>{0, 1, 2, 3, 0}, "written bytes read back");
+    c.expect(c.read(0xFFFF, 2).size() == 2, "read wraps at $FFFF");
+    c.write(0xFFFF, {1, 2}, 1, "write past the end rejected");
+
+    c.send({3, 0x00, 0x02, 0x11, 0x22, 0x33, 0xF0, 0x24}, 0, "set_regs");
+    regs = c.regs();
+    c.expect(regs.PC == 0x0200 && regs.A == 0x11 && regs.X == 0x22 && regs.Y == 0x33 && regs.SP == 0xF0 && regs.P == 0x24,
+        "set_regs visible to regs");
+
+    c.send({99}, 1, "unknown op rejected");
+    c.send({4, 1, 2}, 1, "truncated run rejected");
+    c.send({5, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, 1, "bad condition kind rejected");
+    c.send({1, 1}, 1, "reset to a missing image rejected");
+
+    c.send({1, 0}, 0, "reset");
+    regs = c.regs();
+    c.expect(regs.PC == rom_addr && regs.X == 0 && regs.cycles == 0, "reset restores the registers");
+    c.expect(c.read(0x0200, 3) == std::vector<Byte>{0, 0, 0} && c.read(0x0010, 1) == std::vector<Byte>{0},
+        "reset drops the job's writes");
+    c.write(0x0010, {0x42}, 0, "write before closing");
+}
+} // namespace
+
+// Usage: check_daemon path/to/daemon
+auto main(int argc, char *argv[]) -> int {
+    if (argc != 2) {
+        println(std::cerr, "Usage: check_daemon path/to/daemon");
+        return EXIT_FAILURE;
+    }
+    std::string dir_template = (std::filesystem::temp_directory_path() / "check_daemon.XXXXXX").string();
+    if (mkdtemp(dir_template.data()) == nullptr) {
+        println(std::cerr, "Failed to create a temporary directory");
+        return EXIT_FAILURE;
+    }
+    const std::filesystem::path dir = dir_template;
+    const std::string image_path = (dir / "image.bin").string();
+    const std::string socket_path = (dir / "daemon.sock").string();
+    std::vector<Byte> image(0x100, 0xEA);
+    std::copy(program.begin(), program.end(), image.begin());
+    std::ofstream(image_path, std::ios::binary).write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+
+    const pid_t daemon = fork();
+    if (daemon == 0) {
+        execl(argv[1], argv[1], "--socket", socket_path.c_str(), "--workers", "2", "--addr", "F000", "--rom", image_path.c_str(),
+            static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    if (daemon < 0) {
+        println(std::cerr, "Failed to fork");
+        return EXIT_FAILURE;
+    }
+
+    int fd = -1;
+    for (int tries = 0; tries < 500 && fd < 0; ++tries) {
+        fd = connect_to(socket_path);
+        if (fd < 0) std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Still loading
+    }
+    bool ok = false;
+    {
+        Client first(fd);
+        check_job(first);
+        ok = first.ok();
+    }
+    if (ok) {
+        // A new connection gets a new session on image 0, nothing of the last one survives
+        Client second(connect_to(socket_path));
+        second.expect(second.regs().PC == rom_addr && second.read(0x0010, 1) == std::vector<Byte>{0}, "fresh session");
+        ok = second.ok();
+    }
+
+    kill(daemon, SIGTERM);
+    int status = 0;
+    waitpid(daemon, &status, 0);
+    const bool clean = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS && !std::filesystem::exists(socket_path);
+    if (ok && !clean) println(std::cerr, "Daemon did not shut down cleanly");
+    std::filesystem::remove_all(dir);
+    if (!ok || !clean) return EXIT_FAILURE;
+    println("daemon: every op round tripped, clean shutdown");
+    return EXIT_SUCCESS;
+}
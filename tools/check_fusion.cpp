@@ -0,0 +1,215 @@
+/* danielsinkin97@gmail.com */
+
+// Checks hybrid execution against plain ticking: random programs built from every opcode
+// fusion.hpp handles run twice, once with config.hybrid_execution and once without, in the same
+// random run_until slices. After every slice both CPUs must agree on the architectural state,
+// the micro-op state of an instruction in flight, the cycle count and every bus cycle since the
+// last slice. A device on one data page counts cycles and raises IRQ when written to. It is
+// timing sensitive in every other program, and only then pulses NMI within an instruction, so
+// both the fused accesses and the fallback to tick() are exercised, as are interrupts arriving
+// between the two instructions of a pair.
+// Exits non-zero on the first difference.
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <random>
+#include <vector>
+
+#include "6502/6502.hpp"
+#include "6502/fusion.hpp"
+#include "6502/scheduler.hpp"
+
+static_assert(MOS6502_INSTRUMENTATION == 2, "check_fusion compares bus logs");
+
+using namespace mos6502;
+using std::println;
+
+namespace {
+constexpr Address code_addr = 0x1000;
+constexpr Address handler_addr = 0x1800;
+constexpr size_t code_size = 0x400;
+constexpr Byte data_page = 0x30;
+constexpr Byte device_page = 0x31;
+constexpr int programs = 300;
+constexpr int slices = 200;
+constexpr size_t log_capacity = 1 << 12;
+
+// Reads return the cycle they happen on and release both interrupt lines, writes fold value and
+// cycle into a sum and pull IRQ (bit 0) and, if timing sensitive, NMI (bit 1) low
+class CycleDevice final : public Device {
+public:
+    explicit CycleDevice(bool sensitive) : m_sensitive(sensitive) {}
+
+    auto read(CPU &cpu, Address /*addr*/) -> Byte override {
+        set_irq(cpu, 0x01, false);
+        set_nmi(cpu, false);
+        return static_cast<Byte>(cpu.cycles);
+    }
+    auto write(CPU &cpu, Address addr, Byte value) -> void override {
+        m_sum = m_sum * 31 + (cpu.cycles ^ addr ^ value);
+        set_irq(cpu, 0x01, (value & 0x01) != 0);
+        if (m_sensitive) set_nmi(cpu, (value & 0x02) != 0);
+    }
+    [[nodiscard]] auto peek(const CPU &cpu, Address /*addr*/) const -> Byte override { return static_cast<Byte>(cpu.cycles); }
+    [[nodiscard]] auto timing_sensitive() const -> bool override { return m_sensitive; }
+
+    [[nodiscard]] auto sum() const -> uint64_t { return m_sum; }
+
+private:
+    bool m_sensitive;
+    uint64_t m_sum = 0;
+};
+
+struct Machine {
+    CPU cpu;
+    Scheduler scheduler;
+    BusLog log{log_capacity};
+    std::unique_ptr<CycleDevice> device;
+};
+
+// Opcodes of one variant that run through a fused handler, by shape
+auto fusable_opcodes(Variant variant) -> std::vector<std::vector<Byte>> {
+    std::vector<std::vector<Byte>> by_shape(fusion_shape_count);
+    with_variant(variant, [&](auto v) {
+        for (size_t op = 0; op < 256; ++op) {
+            const FusionShape shape = fusion_shapes<decltype(v)::value>[op];
+            if (shape != FusionShape::none) by_shape[static_cast<size_t>(shape)].push_back(static_cast<Byte>(op));
+        }
+    });
+    return by_shape;
+}
+
+// Straight line code of random fusable instructions ending in a jmp back to the start. Branches
+// land on instruction boundaries, data accesses hit the data page, the device page or the zero
+// page, whose lower half holds pointers into those two pages for (zp),Y.
+auto random_program(std::mt19937 &rng, const std::vector<std::vector<Byte>> &by_shape) -> std::vector<Byte> {
+    std::vector<Byte> code;
+    std::vector<size_t> starts;
+    std::vector<size_t> branches;
+    const auto byte = [&rng] { return static_cast<Byte>(rng()); };
+    const auto page = [&rng] { return rng() % 4 == 0 ? device_page : data_page; };
+    while (code.size() < code_size - 8) {
+        size_t shape = 0;
+        do shape = 1 + rng() % (fusion_shape_count - 1); while (by_shape[shape].empty());
+        const std::vector<Byte> &ops = by_shape[shape];
+        starts.push_back(code.size());
+        code.push_back(ops[rng() % ops.size()]);
+        switch (static_cast<FusionShape>(shape)) {
+        case FusionShape::immediate:
+            code.push_back(byte());
+            break;
+        case FusionShape::zero_page:
+        case FusionShape::modify_zero_page:
+            code.push_back(static_cast<Byte>(0x80 | byte()));
+            break;
+        case FusionShape::absolute:
+        case FusionShape::modify_absolute:
+        case FusionShape::jump: // Rewritten to a forward jmp below
+            code.push_back(byte());
+            code.push_back(page());
+            break;
+        case FusionShape::indirect_y:
+            code.push_back(static_cast<Byte>(byte() & 0x7E));
+            break;
+        case FusionShape::branch:
+            branches.push_back(code.size() - 1);
+            code.push_back(0x00);
+            break;
+        default:
+            break;
+        }
+    }
+    starts.push_back(code.size());
+    for (size_t i = 0; i + 1 < starts.size(); ++i) {
+        const size_t at = starts[i];
+        if (code[at] != 0x4C) continue; // The only jump shape
+        const auto target = static_cast<Address>(code_addr + starts[std::min(starts.size() - 1, i + 1 + rng() % 4)]);
+        code[at + 1] = static_cast<Byte>(target);
+        code[at + 2] = static_cast<Byte>(target >> 8);
+    }
+    for (const size_t at : branches) {
+        for (int tries = 0; tries < 100; ++tries) {
+            const long offset = static_cast<long>(starts[rng() % starts.size()]) - static_cast<long>(at + 2);
+            if (offset >= -128 && offset <= 127) {
+                code[at + 1] = static_cast<Byte>(offset);
+                break;
+            }
+        }
+    }
+    code.insert(code.end(), {0x4C, static_cast<Byte>(code_addr), static_cast<Byte>(code_addr >> 8)});
+    return code;
+}
+
+auto setup(Machine &m, Variant variant, const std::vector<Byte> &code, bool hybrid, bool sensitive, std::mt19937 rng) -> void {
+    m.cpu.variant = variant;
+    m.cpu.config.hybrid_execution = hybrid;
+    m.cpu.config.fast_forward_idle_loops = false;
+    m.cpu.instrumentation.log = &m.log;
+    std::vector<Byte> zero_page(0x100);
+    for (size_t i = 0; i < zero_page.size(); ++i) {
+        zero_page[i] = i < 0x80 && i % 2 == 1 ? (rng() % 4 == 0 ? device_page : data_page) : static_cast<Byte>(rng());
+    }
+    load_bytes(m.cpu, 0x0000, zero_page);
+    load_bytes(m.cpu, code_addr, code);
+    // Both interrupts acknowledge the device and return
+    const Address device_addr = static_cast<Address>(device_page << 8);
+    load_bytes(m.cpu, handler_addr, std::vector<Byte>{0xAD, static_cast<Byte>(device_addr), static_cast<Byte>(device_addr >> 8), 0x40});
+    load_bytes(m.cpu, 0xFFFA, std::vector<Byte>{static_cast<Byte>(handler_addr), static_cast<Byte>(handler_addr >> 8)});
+    load_bytes(m.cpu, 0xFFFE, std::vector<Byte>{static_cast<Byte>(handler_addr), static_cast<Byte>(handler_addr >> 8)});
+    m.device = std::make_unique<CycleDevice>(sensitive);
+    attach_device(m.cpu, *m.device, device_addr, static_cast<Address>(device_addr | 0xFF));
+    m.cpu.PC = code_addr;
+    m.cpu.SP = 0xFF;
+}
+
+[[nodiscard]] auto same(const Machine &a, const Machine &b) -> bool {
+    const CPU &x = a.cpu;
+    const CPU &y = b.cpu;
+    if (state_hash(x) != state_hash(y) || x.cycles != y.cycles || x.side_effects != y.side_effects) return false;
+    if (x.instr_counter != y.instr_counter || x.instr_addr != y.instr_addr || x.tmp != y.tmp) return false;
+    if (x.temporary_address_register != y.temporary_address_register || x.addr_result.type != y.addr_result.type) return false;
+    if (x.instr.type != y.instr.type || x.instr.mode != y.instr.mode) return false;
+    if (a.device->sum() != b.device->sum() || a.log.total != b.log.total) return false;
+    for (uint64_t i = 0; i < std::min<uint64_t>(a.log.total, log_capacity); ++i) {
+        const BusCycle &c = a.log.entries[i];
+        const BusCycle &d = b.log.entries[i];
+        if (c.cycle != d.cycle || c.addr != d.addr || c.data != d.data || c.read != d.read || c.sync != d.sync) return false;
+    }
+    return true;
+}
+} // namespace
+
+auto main() -> int {
+    std::mt19937 rng(6502);
+    uint64_t cycles = 0;
+    for (const Variant variant : {Variant::nmos, Variant::nmos_undocumented, Variant::cmos}) {
+        const auto by_shape = fusable_opcodes(variant);
+        for (int program = 0; program < programs; ++program) {
+            const std::vector<Byte> code = random_program(rng, by_shape);
+            const bool sensitive = program % 2 == 1;
+            const std::mt19937 memory_rng(rng());
+            auto hybrid = std::make_unique<Machine>();
+            auto ticked = std::make_unique<Machine>();
+            setup(*hybrid, variant, code, true, sensitive, memory_rng);
+            setup(*ticked, variant, code, false, sensitive, memory_rng);
+            for (int slice = 0; slice < slices; ++slice) {
+                // Short logs per slice keep the comparison exact, the ring never wraps
+                hybrid->log.total = 0;
+                ticked->log.total = 0;
+                const uint64_t target = hybrid->cpu.cycles + 1 + rng() % 60;
+                run_until(hybrid->cpu, hybrid->scheduler, target);
+                run_until(ticked->cpu, ticked->scheduler, target);
+                if (!same(*hybrid, *ticked)) {
+                    println(std::cerr, "{} program {} slice {}: hybrid PC ${:04X} cycle {}, ticked PC ${:04X} cycle {}",
+                        to_string(variant), program, slice, hybrid->cpu.PC, hybrid->cpu.cycles, ticked->cpu.PC, ticked->cpu.cycles);
+                    return 1;
+                }
+            }
+            cycles += hybrid->cpu.cycles;
+        }
+    }
+    println("fusion: {} programs per variant, {} cycles, hybrid and ticked runs identical", programs, cycles);
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* danielsinkin97@gmail.com */
+
+// Checks the incremental state hash and hash log bisection. Random programs storing all over
+// memory run with hybrid execution on and off: after every run_until slice the page and memory
+// hashes must equal a full rehash, and the hash logs of both runs must agree entry for entry,
+// every entry taken on an instruction boundary.
+// Then one run gets a single byte poked behind the program's back at a known cycle. Comparing
+// its log with the clean one must bracket that cycle, written to and read back from files, and
+// logging the bracket again with interval 1 must put the first divergent entry on the first
+// instruction boundary after the poke.
+// Exits non-zero on the first failure.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "6502/6502.hpp"
+#include "6502/scheduler.hpp"
+#include "6502/state_hash.hpp"
+
+using namespace mos6502;
+using std::println;
+
+namespace {
+constexpr Address code_addr = 0x1000;
+constexpr size_t code_size = 0x300;
+constexpr Byte first_data_page = 0x20;
+constexpr Byte data_pages = 0xC0; // $2000-$DFFF, the program never writes above
+constexpr Address poke_addr = 0xF800;
+constexpr int programs = 30;
+constexpr uint64_t run_cycles = 200'000;
+constexpr uint64_t interval = 1000;
+
+struct Run {
+    CPU cpu;
+    Scheduler scheduler;
+    std::unique_ptr<HashLog> log;
+};
+
+// Stores, read-modify-writes and stack traffic at random addresses, ending in a jmp to the start.
+// starts marks the offsets instructions begin at.
+auto random_program(std::mt19937 &rng, std::vector<bool> &starts) -> std::vector<Byte> {
+    const auto byte = [&rng] { return static_cast<Byte>(rng()); };
+    const auto page = [&rng] { return static_cast<Byte>(first_data_page + rng() % data_pages); };
+    std::vector<Byte> code;
+    starts.assign(code_size, false);
+    while (code.size() < code_size - 3) {
+        starts[code.size()] = true;
+        switch (rng() % 10) {
+        case 0: // lda #, ldx #, ldy #
+            code.insert(code.end(), {std::array<Byte, 3>{0xA9, 0xA2, 0xA0}[rng() % 3], byte()});
+            break;
+        case 1: // sta abs, stx abs, sty abs
+            code.insert(code.end(), {std::array<Byte, 3>{0x8D, 0x8E, 0x8C}[rng() % 3], byte(), page()});
+            break;
+        case 2: // sta abs,X
+            code.insert(code.end(), {0x9D, byte(), page()});
+            break;
+        case 3: // sta (zp),Y through a pointer in the lower half of the zero page
+            code.insert(code.end(), {0x91, static_cast<Byte>(byte() & 0x7E)});
+            break;
+        case 4: // inc abs, dec abs, asl abs,X, ror abs
+            code.insert(code.end(), {std::array<Byte, 4>{0xEE, 0xCE, 0x1E, 0x6E}[rng() % 4], byte(), page()});
+            break;
+        case 5: // sta zp, inc zp, in the upper half of the zero page
+            code.insert(code.end(), {rng() % 2 == 0 ? Byte{0x85} : Byte{0xE6}, static_cast<Byte>(0x80 | byte())});
+            break;
+        case 6: // pha, pla, php
+            code.push_back(std::array<Byte, 3>{0x48, 0x68, 0x08}[rng() % 3]);
+            break;
+        case 7: // adc abs, eor abs
+            code.insert(code.end(), {rng() % 2 == 0 ? Byte{0x6D} : Byte{0x4D}, byte(), page()});
+            break;
+        case 8: // tax, tay, inx, dey
+            code.push_back(std::array<Byte, 4>{0xAA, 0xA8, 0xE8, 0x88}[rng() % 4]);
+            break;
+        default: // clc, sec, cld
+            code.push_back(std::array<Byte, 3>{0x18, 0x38, 0xD8}[rng() % 3]);
+            break;
+        }
+    }
+    starts[code.size()] = true;
+    code.insert(code.end(), {0x4C, static_cast<Byte>(code_addr), static_cast<Byte>(code_addr >> 8)});
+    return code;
+}
+
+auto setup(Run &run, const std::vector<Byte> &code, bool hybrid, uint64_t log_interval, uint64_t from, uint64_t until,
+    optional<uint64_t> poke_cycle) -> void {
+    run.cpu.config.hybrid_execution = hybrid;
+    std::vector<Byte> pointers(0x80);
+    for (size_t i = 0; i < pointers.size(); ++i) pointers[i] = i % 2 == 0 ? static_cast<Byte>(i * 37) : static_cast<Byte>(first_data_page + i);
+    load_bytes(run.cpu, 0x0000, pointers);
+    load_bytes(run.cpu, code_addr, code);
+    run.cpu.PC = code_addr;
+    run.cpu.SP = 0xFF;
+    // Scheduled before the log starts, so a log entry on the poke cycle already sees it
+    if (poke_cycle) {
+        run.scheduler.schedule(*poke_cycle, [](void *, CPU &cpu) { load_bytes(cpu, poke_addr, std::vector<Byte>{0x5A}); }, nullptr);
+    }
+    run.log = std::make_unique<HashLog>(log_interval, from, until);
+    run.log->start(run.cpu, run.scheduler);
+}
+
+[[nodiscard]] auto hash_consistent(const CPU &cpu) -> bool {
+    auto rehashed = std::make_unique<CPU>(cpu);
+    rehash_memory(*rehashed);
+    return rehashed->mem_hash == cpu.mem_hash && rehashed->page_hash == cpu.page_hash;
+}
+
+// Entries are only taken on instruction boundaries
+[[nodiscard]] auto on_boundaries(const std::vector<HashLogEntry> &entries, const std::vector<bool> &starts) -> bool {
+    return std::ranges::all_of(entries, [&](const HashLogEntry &e) {
+        return e.pc >= code_addr && e.pc < code_addr + starts.size() && starts[e.pc - code_addr];
+    });
+}
+
+auto fail(int program, uint64_t cycle, const char *what) -> int {
+    println(std::cerr, "program {}, cycle {}: {}", program, cycle, what);
+    return 1;
+}
+} // namespace
+
+auto main() -> int {
+    std::mt19937 rng(6502);
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string clean_path = (dir / "check_state_hash_clean.log").string();
+    const std::string poked_path = (dir / "check_state_hash_poked.log").string();
+    size_t entries = 0;
+    for (int program = 0; program < programs; ++program) {
+        std::vector<bool> starts;
+        const std::vector<Byte> code = random_program(rng, starts);
+        const uint64_t poke = 10'000 + rng() % (run_cycles - 20'000);
+
+        // Incremental hashes against a full rehash, hybrid and ticked runs against each other
+        auto hybrid = std::make_unique<Run>();
+        auto ticked = std::make_unique<Run>();
+        setup(*hybrid, code, true, interval, 0, no_event, std::nullopt);
+        setup(*ticked, code, false, interval, 0, no_event, std::nullopt);
+        while (hybrid->cpu.cycles < run_cycles) {
+            const uint64_t target = std::min(run_cycles, hybrid->cpu.cycles + 1 + rng() % 5000);
+            run_until(hybrid->cpu, hybrid->scheduler, target);
+            run_until(ticked->cpu, ticked->scheduler, target);
+            if (!hash_consistent(hybrid->cpu) || !hash_consistent(ticked->cpu)) {
+                return fail(program, target, "incremental hash differs from a rehash");
+            }
+        }
+        if (hybrid->log->entries().size() + 1 < run_cycles / interval || first_divergence(hybrid->log->entries(), ticked->log->entries())) {
+            return fail(program, run_cycles, "hybrid and ticked hash logs differ");
+        }
+        if (!on_boundaries(hybrid->log->entries(), starts)) return fail(program, run_cycles, "hash logged within an instruction");
+        entries += hybrid->log->entries().size();
+
+        // One byte poked behind the program's back, the logs must bracket the poke
+        auto poked = std::make_unique<Run>();
+        setup(*poked, code, true, interval, 0, no_event, poke);
+        run_until(poked->cpu, poked->scheduler, run_cycles);
+        if (!write_hash_log(clean_path, hybrid->log->entries()) || !write_hash_log(poked_path, poked->log->entries())) {
+            return fail(program, run_cycles, "failed to write the hash logs");
+        }
+        const auto clean_log = read_hash_log(clean_path);
+        const auto poked_log = read_hash_log(poked_path);
+        if (!clean_log || !poked_log || *clean_log != hybrid->log->entries() || *poked_log != poked->log->entries()) {
+            return fail(program, run_cycles, "hash logs do not survive a file round trip");
+        }
+        const auto divergence = first_divergence(*clean_log, *poked_log);
+        if (!divergence || divergence->index >= clean_log->size() || divergence->last_equal_cycle > poke ||
+            (*clean_log)[divergence->index].cycle < poke) {
+            return fail(program, poke, "hash logs do not bracket the poke");
+        }
+
+        // The bracket logged again at every instruction, the first difference is the first boundary at or after the poke
+        const uint64_t from = divergence->last_equal_cycle;
+        const uint64_t until = (*clean_log)[divergence->index].cycle;
+        auto clean_fine = std::make_unique<Run>();
+        auto poked_fine = std::make_unique<Run>();
+        setup(*clean_fine, code, true, 1, from, until, std::nullopt);
+        setup(*poked_fine, code, true, 1, from, until, poke);
+        run_until(clean_fine->cpu, clean_fine->scheduler, until + 1);
+        run_until(poked_fine->cpu, poked_fine->scheduler, until + 1);
+        const auto &fine = clean_fine->log->entries();
+        if (!on_boundaries(fine, starts)) return fail(program, poke, "hash logged within an instruction");
+        const auto fine_divergence = first_divergence(fine, poked_fine->log->entries());
+        if (!fine_divergence || fine_divergence->index >= fine.size() || fine[fine_divergence->index].cycle < poke ||
+            (fine_divergence->index > 0 && fine[fine_divergence->index - 1].cycle >= poke)) {
+            return fail(program, poke, "interval 1 does not pin the poke to the next instruction boundary");
+        }
+    }
+    std::filesystem::remove(clean_path);
+    std::filesystem::remove(poked_path);
+    println("state_hash: {} programs, {} log entries, incremental hashes exact, every poke bisected to its instruction", programs, entries);
+    return 0;
+}
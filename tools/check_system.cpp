@@ -0,0 +1,134 @@
+/* danielsinkin97@gmail.com */
+
+// Checks System against a single threaded lockstep reference: the same CPUs and programs run
+// once through System::run_until, one host thread per CPU, and once on this thread, every CPU
+// ticked one cycle at a time round robin in index order with the shared pages mapped as plain
+// RAM. The programs read, modify and write the same shared bytes, so any access served out of
+// (cycle, CPU index) order changes the outcome. Every CPU's state hash and cycle count and the
+// shared bytes must match for every quantum, with hybrid execution on and off.
+// Exits non-zero on the first difference.
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <random>
+#include <vector>
+
+#include "6502/6502.hpp"
+#include "6502/scheduler.hpp"
+#include "6502/system.hpp"
+
+using namespace mos6502;
+using std::println;
+
+namespace {
+constexpr Address code_addr = 0x1000;
+constexpr Address shared_addr = 0x8000;
+constexpr size_t shared_size = 0x100;
+constexpr size_t code_size = 0x300;
+constexpr int programs = 20;
+constexpr uint64_t run_cycles = 20'000;
+constexpr uint64_t quanta[] = {1, 2, 3, 7, 64, 1000, 100'000};
+
+// A shared region as plain RAM, the reference runs on one thread and needs no ordering
+class RegionRam final : public Device {
+public:
+    explicit RegionRam(SharedRegion &region) : m_region(region) {}
+
+    auto read(CPU & /*cpu*/, Address addr) -> Byte override { return m_region.bytes[addr - shared_addr]; }
+    auto write(CPU & /*cpu*/, Address addr, Byte value) -> void override { m_region.bytes[addr - shared_addr] = value; }
+    [[nodiscard]] auto peek(const CPU & /*cpu*/, Address addr) const -> Byte override { return m_region.bytes[addr - shared_addr]; }
+
+private:
+    SharedRegion &m_region;
+};
+
+struct Reference {
+    std::vector<std::unique_ptr<CPU>> cpus;
+    std::vector<std::unique_ptr<Scheduler>> schedulers;
+    std::vector<std::unique_ptr<RegionRam>> ports;
+    SharedRegion region;
+};
+
+// Loads, stores and read-modify-writes on the shared page and the private zero page, ending in a
+// jmp back to the start
+auto random_program(std::mt19937 &rng) -> std::vector<Byte> {
+    // lda, ldx, adc, eor, sta, stx, inc, dec, asl, rol on absolute, then on zero page
+    static constexpr Byte absolute_ops[] = {0xAD, 0xAE, 0x6D, 0x4D, 0x8D, 0x8E, 0xEE, 0xCE, 0x0E, 0x2E};
+    static constexpr Byte zero_page_ops[] = {0xA5, 0xA6, 0x65, 0x45, 0x85, 0x86, 0xE6, 0xC6, 0x06, 0x26};
+    std::vector<Byte> code;
+    while (code.size() < code_size - 3) {
+        if (rng() % 3 == 0) {
+            code.push_back(zero_page_ops[rng() % std::size(zero_page_ops)]);
+            code.push_back(static_cast<Byte>(rng() % 0x20));
+        } else {
+            code.push_back(absolute_ops[rng() % std::size(absolute_ops)]);
+            code.push_back(static_cast<Byte>(rng() % 8)); // Few bytes, so the CPUs collide often
+            code.push_back(static_cast<Byte>(shared_addr >> 8));
+        }
+    }
+    code.insert(code.end(), {0x4C, static_cast<Byte>(code_addr), static_cast<Byte>(code_addr >> 8)});
+    return code;
+}
+
+auto setup(CPU &cpu, const std::vector<Byte> &code, bool hybrid) -> void {
+    cpu.config.hybrid_execution = hybrid;
+    load_bytes(cpu, code_addr, code);
+    cpu.PC = code_addr;
+    cpu.SP = 0xFF;
+}
+
+auto run_reference(Reference &ref, uint64_t target) -> void {
+    for (uint64_t cycle = 0; cycle < target; ++cycle) {
+        for (size_t i = 0; i < ref.cpus.size(); ++i) run_until(*ref.cpus[i], *ref.schedulers[i], cycle + 1);
+    }
+}
+} // namespace
+
+auto main() -> int {
+    std::mt19937 rng(6502);
+    for (int program = 0; program < programs; ++program) {
+        const size_t cpu_count = 2 + static_cast<size_t>(program % 3);
+        std::vector<std::vector<Byte>> codes;
+        for (size_t i = 0; i < cpu_count; ++i) codes.push_back(random_program(rng));
+
+        // Ticked cycle by cycle, hybrid execution would run whole instructions past other CPUs' accesses
+        Reference ref;
+        ref.region.bytes.assign(shared_size, 0x00);
+        for (size_t i = 0; i < cpu_count; ++i) {
+            ref.cpus.push_back(std::make_unique<CPU>());
+            ref.schedulers.push_back(std::make_unique<Scheduler>());
+            ref.ports.push_back(std::make_unique<RegionRam>(ref.region));
+            setup(*ref.cpus[i], codes[i], false);
+            ref.cpus[i]->config.fast_forward_idle_loops = false;
+            attach_device(*ref.cpus[i], *ref.ports[i], shared_addr, static_cast<Address>(shared_addr + shared_size - 1));
+        }
+        run_reference(ref, run_cycles);
+
+        for (const bool hybrid : {false, true}) {
+            for (const uint64_t quantum : quanta) {
+                System system(quantum);
+                SharedRegion &region = system.add_shared_region(shared_size);
+                for (size_t i = 0; i < cpu_count; ++i) {
+                    system.add_cpu();
+                    setup(system.cpu(i), codes[i], hybrid);
+                    system.map_shared(i, region, shared_addr);
+                }
+                system.run_until(run_cycles);
+                bool same = region.bytes == ref.region.bytes;
+                for (size_t i = 0; i < cpu_count; ++i) {
+                    same = same && state_hash(system.cpu(i)) == state_hash(*ref.cpus[i]) && system.cpu(i).cycles == ref.cpus[i]->cycles;
+                }
+                if (!same) {
+                    println(std::cerr, "program {} ({} CPUs), quantum {}, hybrid {}: System differs from the lockstep reference",
+                        program, cpu_count, quantum, hybrid);
+                    return 1;
+                }
+            }
+        }
+    }
+    println("system: {} programs, quanta 1 to {}, hybrid on and off, identical to the lockstep reference", programs,
+        quanta[std::size(quanta) - 1]);
+    return 0;
+}
@@ -0,0 +1,414 @@
+/* danielsinkin97@gmail.com */
+
+// Warm instance emulation daemon. Images are loaded once at startup, then a pool of forked
+// workers serves jobs over a Unix domain socket: each worker owns one preallocated CPU and
+// answers requests on one connection at a time, starting a job is a copy of the loaded image
+// state instead of a process start plus image load. An assert in the core only takes down the
+// worker running that job, its client sees the connection close and the supervisor forks a
+// replacement, the same crash isolation fuzz uses.
+//
+// Protocol, little endian, every message is framed as u32 payload size | payload.
+//   request   u8 op | arguments
+//   response  u8 status (0 ok, 1 bad request) | result, or an error text when status is 1
+//
+//   op  name       arguments                               result
+//   1   reset      u8 image                                -
+//   2   write      u16 addr | bytes                        -
+//   3   set_regs   u16 PC | u8 A | X | Y | SP | P          -
+//   4   run        u64 cycles                              regs
+//   5   run_until  u8 kind | u16 addr | u8 value | u64 max u8 reached | regs
+//   6   read       u16 addr | u32 size (at most 65536)     bytes, wrapping at $FFFF
+//   7   regs       -                                       regs
+//
+//   regs       u16 PC | u8 A | X | Y | SP | P | u64 cycles
+//   run_until  kind 0 stops before the instruction at addr, kind 1 once mem[addr] == value,
+//              both only checked on instruction boundaries, max bounds the cycles run
+//
+// A connection starts on image 0. Writes and register changes persist until the next reset.
+// Writes into pages mapped read-only with --rom are rejected, the bus would ignore them too.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "6502/6502.hpp"
+#include "6502/loader.hpp"
+#include "6502/save_state.hpp"
+#include "6502/scheduler.hpp"
+
+using namespace mos6502;
+using save_state_detail::Reader; // Same little endian encoding as save states
+using save_state_detail::Writer;
+
+namespace {
+constexpr size_t max_workers = 256;
+constexpr uint32_t max_message_size = 1 << 20;
+
+enum class Op : Byte {
+    reset = 1,
+    write = 2,
+    set_regs = 3,
+    run = 4,
+    run_until = 5,
+    read = 6,
+    regs = 7,
+};
+
+enum class Status : Byte {
+    ok = 0,
+    bad_request = 1,
+};
+
+struct Options {
+    std::string socket_path;
+    std::vector<std::string> image_paths;
+    Address load_addr = 0x0000;
+    Variant variant = Variant::nmos;
+    bool as_rom = false;
+    size_t workers = 1;
+};
+
+// An image as every job starts from it, ROM mapped images point into files kept open here
+struct Image {
+    std::unique_ptr<CPU> cpu;
+    std::unique_ptr<MappedFile> file;
+};
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+auto on_stop(int) -> void { stop_requested = 1; }
+
+auto load(const Options &opt, const std::string &path) -> optional<Image> {
+    auto mapped = MappedFile::open(path);
+    if (!mapped) return std::nullopt;
+    auto file = std::make_unique<MappedFile>(std::move(*mapped));
+    Image image;
+    image.cpu = std::make_unique<CPU>();
+    CPU &cpu = *image.cpu;
+    cpu.variant = opt.variant;
+    optional<LoadResult> result;
+    if (opt.as_rom) {
+        result = map_rom(cpu, *file, opt.load_addr);
+        image.file = std::move(file);
+    } else {
+        if (file->size() > cpu.mem.size()) return std::nullopt; // Banked cartridges need a device per worker
+        result = load_image(cpu, file->bytes(), detect_format(path, file->bytes()), opt.load_addr);
+    }
+    if (!result) return std::nullopt;
+    cpu.PC = entry_point(cpu, *result);
+    cpu.SP = 0xFF;
+    return image;
+}
+
+auto read_exact(int fd, Byte *data, size_t size) -> bool {
+    while (size > 0) {
+        const ssize_t n = ::read(fd, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+auto write_exact(int fd, const Byte *data, size_t size) -> bool {
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+auto write_registers(Writer &w, const CPU &cpu) -> void {
+    w.u16(cpu.PC);
+    w.u8(cpu.A);
+    w.u8(cpu.X);
+    w.u8(cpu.Y);
+    w.u8(cpu.SP);
+    w.u8(cpu.P);
+    w.u64(cpu.cycles);
+}
+
+// cpu.cycles + budget, saturating so a client supplied budget cannot wrap around
+[[nodiscard]] auto cycle_target(const CPU &cpu, uint64_t budget) -> uint64_t {
+    return budget > UINT64_MAX - cpu.cycles ? UINT64_MAX : cpu.cycles + budget;
+}
+
+// Ticks until the condition holds on an instruction boundary or max cycles passed
+template <Variant V>
+auto run_to_condition(CPU &cpu, Scheduler &scheduler, Byte kind, Address addr, Byte value, uint64_t max) -> bool {
+    const uint64_t end = cycle_target(cpu, max);
+    auto reached = [&] { return kind == 0 ? cpu.PC == addr : peek(cpu, addr) == value; };
+    scheduler.dispatch_due(cpu);
+    while (cpu.instr_counter != 0 || !reached()) {
+        if (cpu.cycles >= end) return false;
+        tick<V>(cpu);
+        if (cpu.cycles >= scheduler.next_cycle()) scheduler.dispatch_due(cpu);
+    }
+    return true;
+}
+
+class Session {
+public:
+    Session(const std::vector<Image> &images, CPU &cpu)
+        : m_images(images), m_cpu(cpu) {
+        m_cpu = *m_images[0].cpu;
+    }
+
+    // Executes one request, out receives the response payload starting with the status byte
+    auto handle(std::span<const Byte> request, std::vector<Byte> &out) -> void {
+        Reader r{.in = request};
+        Writer w{.out = out};
+        out.clear();
+        w.u8(static_cast<Byte>(Status::ok));
+        const auto op = static_cast<Op>(r.u8());
+        switch (op) {
+        case Op::reset: {
+            const Byte index = r.u8();
+            if (!r.ok || index >= m_images.size()) return fail(out, "no such image");
+            m_cpu = *m_images[index].cpu;
+            m_scheduler = Scheduler();
+            break;
+        }
+        case Op::write: {
+            const Address addr = r.u16();
+            const auto bytes = request.subspan(std::min(r.pos, request.size()));
+            if (!r.ok || static_cast<size_t>(addr) + bytes.size() > m_cpu.mem.size()) return fail(out, "write outside memory");
+            for (size_t page = addr >> 8; !bytes.empty() && page <= (addr + bytes.size() - 1) >> 8; ++page) {
+                if (m_cpu.rom_pages[page] != nullptr) return fail(out, "write into ROM");
+            }
+            load_bytes(m_cpu, addr, bytes);
+            break;
+        }
+        case Op::set_regs: {
+            const Address pc = r.u16();
+            const Byte a = r.u8(), x = r.u8(), y = r.u8(), sp = r.u8(), p = r.u8();
+            if (!r.ok) return fail(out, "truncated registers");
+            m_cpu.PC = pc;
+            m_cpu.A = a;
+            m_cpu.X = x;
+            m_cpu.Y = y;
+            m_cpu.SP = sp;
+            m_cpu.P = p;
+            finished_instruction(m_cpu); // Continue with a fresh instruction at PC
+            break;
+        }
+        case Op::run: {
+            const uint64_t cycles = r.u64();
+            if (!r.ok) return fail(out, "missing cycle count");
+            run_until(m_cpu, m_scheduler, cycle_target(m_cpu, cycles));
+            write_registers(w, m_cpu);
+            break;
+        }
+        case Op::run_until: {
+            const Byte kind = r.u8();
+            const Address addr = r.u16();
+            const Byte value = r.u8();
+            const uint64_t max = r.u64();
+            if (!r.ok || kind > 1) return fail(out, "bad condition");
+            const bool reached = with_variant(m_cpu.variant, [&](auto v) {
+                return run_to_condition<decltype(v)::value>(m_cpu, m_scheduler, kind, addr, value, max);
+            });
+            w.u8(reached);
+            write_registers(w, m_cpu);
+            break;
+        }
+        case Op::read: {
+            const Address addr = r.u16();
+            const uint32_t size = r.u32();
+            if (!r.ok || size > m_cpu.mem.size()) return fail(out, "bad range");
+            for (uint32_t i = 0; i < size; ++i) w.u8(peek(m_cpu, static_cast<Address>(addr + i)));
+            break;
+        }
+        case Op::regs:
+            write_registers(w, m_cpu);
+            break;
+        default:
+            return fail(out, "unknown op");
+        }
+    }
+
+private:
+    const std::vector<Image> &m_images;
+    CPU &m_cpu;
+    Scheduler m_scheduler;
+
+    static auto fail(std::vector<Byte> &out, std::string_view message) -> void {
+        out.assign(1, static_cast<Byte>(Status::bad_request));
+        out.insert(out.end(), message.begin(), message.end());
+    }
+};
+
+// Serves one connection until the client closes it or sends something unframeable
+auto serve(int fd, const std::vector<Image> &images, CPU &cpu) -> void {
+    Session session(images, cpu);
+    std::vector<Byte> request;
+    std::vector<Byte> response;
+    response.reserve(0x10000 + 16);
+    for (;;) {
+        Byte header[4];
+        if (!read_exact(fd, header, sizeof(header))) return;
+        const uint32_t size = static_cast<uint32_t>(header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24));
+        if (size == 0 || size > max_message_size) return;
+        request.resize(size);
+        if (!read_exact(fd, request.data(), size)) return;
+
+        session.handle(request, response);
+        const auto out_size = static_cast<uint32_t>(response.size());
+        const Byte out_header[4] = {static_cast<Byte>(out_size), static_cast<Byte>(out_size >> 8),
+            static_cast<Byte>(out_size >> 16), static_cast<Byte>(out_size >> 24)};
+        if (!write_exact(fd, out_header, sizeof(out_header)) || !write_exact(fd, response.data(), response.size())) return;
+    }
+}
+
+[[noreturn]] auto run_worker(int listen_fd, const std::vector<Image> &images) -> void {
+    auto cpu = std::make_unique<CPU>(); // The warm instance, reused by every connection
+    for (;;) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        serve(fd, images, *cpu);
+        close(fd);
+    }
+}
+
+// Returns -1 when fork failed, the slot is retried later
+auto spawn_worker(int listen_fd, const std::vector<Image> &images) -> pid_t {
+    const pid_t pid = fork();
+    if (pid < 0) {
+        println(std::cerr, "Failed to fork a worker: {}", std::strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        std::signal(SIGPIPE, SIG_IGN); // A client going away mid response is not fatal
+        run_worker(listen_fd, images);
+    }
+    return pid;
+}
+
+auto listen_on(const std::string &path) -> int {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str()); // Stale socket of a previous run
+    if (bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+} // namespace
+
+// Usage: daemon --socket PATH [--workers N] [--cpu 6502|6502u|65c02] [--addr HEX] [--rom] image...
+//   --socket   Unix domain socket to listen on, replaced if it exists
+//   --workers  worker processes, i.e. concurrently served connections, one per core unless given
+//   --cpu      chip variant of every instance (6502)
+//   --addr     load address of raw images
+//   --rom      map raw images read-only instead of copying them, shared by all workers
+//   image      one or more images, selected by index with reset, image 0 is the default
+auto main(int argc, char *argv[]) -> int {
+    std::setvbuf(stdout, nullptr, _IOLBF, BUFSIZ); // Usually redirected to a log, nothing may sit in a buffer across fork
+    Options opt;
+    opt.workers = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value) {
+            opt.socket_path = argv[++i];
+        } else if (arg == "--workers" && has_value) {
+            opt.workers = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--cpu" && has_value) {
+            const auto variant = parse_variant(argv[++i]);
+            if (!variant) {
+                println(std::cerr, "Unknown CPU {}, expected 6502, 6502u or 65c02", argv[i]);
+                return EXIT_FAILURE;
+            }
+            opt.variant = *variant;
+        } else if (arg == "--addr" && has_value) {
+            opt.load_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--rom") {
+            opt.as_rom = true;
+        } else {
+            opt.image_paths.emplace_back(arg);
+        }
+    }
+    if (opt.socket_path.empty() || opt.image_paths.empty() || opt.image_paths.size() > 256 || opt.workers == 0 ||
+        opt.workers > max_workers) {
+        println(std::cerr, "Usage: daemon --socket PATH [--workers N (1-{})] [options] image...", max_workers);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Image> images;
+    for (const auto &path : opt.image_paths) {
+        auto image = load(opt, path);
+        if (!image) {
+            println(std::cerr, "Failed to load {}", path);
+            return EXIT_FAILURE;
+        }
+        println("Image {}: {}, PC = 0x{:04X}", images.size(), path, image->cpu->PC);
+        images.push_back(std::move(*image));
+    }
+
+    const int listen_fd = listen_on(opt.socket_path);
+    if (listen_fd < 0) {
+        println(std::cerr, "Failed to listen on {}", opt.socket_path);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<pid_t> pids(opt.workers);
+    for (auto &pid : pids) pid = spawn_worker(listen_fd, images);
+    println("Listening on {} with {} workers", opt.socket_path, opt.workers);
+
+    struct sigaction action{}; // Without SA_RESTART, so the signals interrupt waitpid
+    action.sa_handler = on_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    while (!stop_requested) {
+        for (auto &pid : pids) {
+            if (pid <= 0) pid = spawn_worker(listen_fd, images);
+        }
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, 0); // Interrupted by the stop signals
+        if (pid <= 0) {
+            if (errno == ECHILD) std::this_thread::sleep_for(std::chrono::seconds(1)); // Every fork failed, back off
+            continue;
+        }
+        const auto it = std::find(pids.begin(), pids.end(), pid);
+        if (it == pids.end()) continue;
+        println("Worker {} died (signal {}), respawning", it - pids.begin(), WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+        *it = spawn_worker(listen_fd, images);
+    }
+
+    for (pid_t pid : pids) {
+        if (pid > 0) kill(pid, SIGTERM); // -1 would signal every process we may signal
+    }
+    for (pid_t pid : pids) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+    }
+    close(listen_fd);
+    unlink(opt.socket_path.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,380 @@
+/* danielsinkin97@gmail.com */
+
+// Coverage guided fuzzer for guest programs. The image is booted once, every execution then
+// restores that snapshot, writes a mutated input into the configured memory region and runs
+// headless until the done address, the cycle budget or a crash (an assert in the core aborts
+// the process). Workers are forked processes sharing the coverage maps through an anonymous
+// shared mapping, so a crashing input only takes its own worker down: the supervisor saves the
+// input the worker was running, keyed by the last executed PC, and forks a replacement.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
+#include <print>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "6502/6502.hpp"
+#include "6502/fuzz.hpp"
+#include "6502/loader.hpp"
+
+namespace fs = std::filesystem;
+using namespace mos6502;
+
+namespace {
+constexpr size_t max_jobs = 64;
+constexpr size_t max_input_size = 4096;
+constexpr uint64_t sync_interval = 10'000; // Executions between corpus directory scans
+
+struct WorkerSlot {
+    std::atomic<uint64_t> execs = 0;
+    std::atomic<Address> last_pc = 0;
+    std::array<Byte, max_input_size> input = {}; // What the worker is running right now
+};
+
+// Lives in a MAP_SHARED mapping created before the workers are forked
+struct SharedState {
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> corpus_size = 0;
+    std::atomic<uint64_t> hangs = 0;
+    std::array<Byte, fuzz::map_size> virgin_bits;
+    std::array<Byte, fuzz::map_size> virgin_hangs;
+    std::array<WorkerSlot, max_jobs> workers;
+
+    SharedState() {
+        virgin_bits.fill(0xFF);
+        virgin_hangs.fill(0xFF);
+    }
+};
+
+struct Options {
+    std::string image_path;
+    Address load_addr = 0x0000;
+    Variant variant = Variant::nmos;
+    fuzz::Config config;
+    uint64_t boot_cycles = 0;
+    optional<Address> boot_until;
+    size_t jobs = 1;
+    fs::path corpus_dir = "corpus";
+    fs::path out_dir = "findings";
+    uint64_t seed = 0;
+    uint64_t seconds = 0; // 0 runs until interrupted
+    std::string repro_path;
+};
+
+std::atomic<bool> interrupted = false;
+
+auto on_sigint(int) -> void { interrupted = true; }
+
+auto read_file(const fs::path &path) -> optional<std::vector<Byte>> {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return std::nullopt;
+    return std::vector<Byte>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Written under a temporary name first so syncing workers never pick up a partial file
+auto write_file(const fs::path &path, std::span<const Byte> bytes) -> bool {
+    const fs::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!file) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+// Loads the image and runs it up to the point where inputs get injected
+auto boot(const Options &opt) -> optional<CPU> {
+    auto file = MappedFile::open(opt.image_path);
+    if (!file) return std::nullopt;
+    auto cpu = std::make_unique<CPU>();
+    cpu->variant = opt.variant;
+    const auto result = load_image(*cpu, file->bytes(), detect_format(opt.image_path, file->bytes()), opt.load_addr);
+    if (!result) return std::nullopt;
+    cpu->PC = entry_point(*cpu, *result);
+
+    while (cpu->cycles < opt.boot_cycles) tick(*cpu);
+    if (opt.boot_until) {
+        // Stop on the boundary before the instruction at boot_until, PC then points at its opcode
+        while (cpu->instr_counter != 0 || cpu->PC != *opt.boot_until) tick(*cpu);
+    }
+    return *cpu;
+}
+
+auto load_corpus(const fs::path &dir, size_t input_size) -> std::vector<std::vector<Byte>> {
+    std::vector<std::vector<Byte>> corpus;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file() || entry.path().extension() == ".tmp") continue;
+        if (auto bytes = read_file(entry.path())) {
+            bytes->resize(input_size);
+            corpus.push_back(std::move(*bytes));
+        }
+    }
+    if (corpus.empty()) corpus.emplace_back(input_size, Byte{0});
+    return corpus;
+}
+
+[[noreturn]] auto run_worker(const Options &opt, const CPU &snapshot, SharedState &shared, size_t index, uint64_t seed) -> void {
+    WorkerSlot &slot = shared.workers[index];
+    const size_t size = opt.config.input_size;
+    auto corpus = load_corpus(opt.corpus_dir, size);
+    std::unordered_set<std::string> known;
+    for (const auto &entry : fs::directory_iterator(opt.corpus_dir)) known.insert(entry.path().filename().string());
+
+    fuzz::Mutator mutator(seed);
+    auto cpu = std::make_unique<CPU>();
+    auto trace = std::make_unique<fuzz::TraceMap>();
+    std::vector<Byte> input;
+    uint64_t saved = 0;
+
+    while (!shared.stop.load(std::memory_order_relaxed)) {
+        input = corpus[mutator.uniform(0, corpus.size() - 1)];
+        mutator.mutate(input, corpus);
+        std::copy(input.begin(), input.end(), slot.input.begin());
+
+        const auto outcome = fuzz::execute(*cpu, snapshot, opt.config, input, *trace, &slot.last_pc);
+        const uint64_t execs = slot.execs.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        if (outcome == fuzz::Outcome::timeout && opt.config.done_addr) {
+            // A hang is only worth keeping when it hangs somewhere new
+            if (fuzz::merge_new_bits(*trace, shared.virgin_hangs)) {
+                const auto n = shared.hangs.fetch_add(1, std::memory_order_relaxed);
+                write_file(opt.out_dir / "hangs" / ("hang-" + std::to_string(n)), input);
+            }
+        } else if (fuzz::merge_new_bits(*trace, shared.virgin_bits)) {
+            const std::string name = "w" + std::to_string(index) + "-" + std::to_string(saved++);
+            if (write_file(opt.corpus_dir / name, input)) known.insert(name);
+            shared.corpus_size.fetch_add(1, std::memory_order_relaxed);
+            corpus.push_back(input);
+        }
+
+        if (execs % sync_interval == 0) { // Pick up what the other workers found
+            for (const auto &entry : fs::directory_iterator(opt.corpus_dir)) {
+                const std::string name = entry.path().filename().string();
+                if (entry.path().extension() == ".tmp" || !known.insert(name).second) continue;
+                if (auto bytes = read_file(entry.path())) {
+                    bytes->resize(size);
+                    corpus.push_back(std::move(*bytes));
+                }
+            }
+        }
+    }
+    std::_Exit(EXIT_SUCCESS);
+}
+
+// Returns -1 when fork failed, the slot is retried on the next status tick
+auto spawn_worker(const Options &opt, const CPU &snapshot, SharedState &shared, size_t index, uint64_t seed) -> pid_t {
+    const pid_t pid = fork();
+    if (pid < 0) {
+        println(std::cerr, "Failed to fork worker {}: {}", index, std::strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        std::signal(SIGINT, SIG_IGN); // The supervisor decides when to stop
+        run_worker(opt, snapshot, shared, index, seed);
+    }
+    return pid;
+}
+
+// Whether a worker died of its input: an assert in the core (SIGABRT, -ftrapv aborts too) or a
+// fault. Clean exits and kills from outside, like the OOM killer's SIGKILL, are not crashes.
+auto crashed(int status) -> bool {
+    if (!WIFSIGNALED(status)) return false;
+    switch (WTERMSIG(status)) {
+    case SIGABRT:
+    case SIGSEGV:
+    case SIGBUS:
+    case SIGFPE:
+    case SIGILL:
+    case SIGTRAP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+auto repro(const Options &opt, const CPU &snapshot) -> int {
+    const auto input = read_file(opt.repro_path);
+    if (!input) {
+        println(std::cerr, "Failed to read {}", opt.repro_path);
+        return EXIT_FAILURE;
+    }
+    auto cpu = std::make_unique<CPU>();
+    auto trace = std::make_unique<fuzz::TraceMap>();
+    std::atomic<Address> last_pc = 0;
+    const auto outcome = fuzz::execute(*cpu, snapshot, opt.config, *input, *trace, &last_pc);
+    println("{} after {} cycles, last PC 0x{:04X}", outcome == fuzz::Outcome::done ? "Done" : "Budget exhausted",
+        cpu->cycles - snapshot.cycles, last_pc.load());
+    return EXIT_SUCCESS;
+}
+
+auto fuzz_main(const Options &opt, const CPU &snapshot) -> int {
+    std::error_code ec;
+    fs::create_directories(opt.corpus_dir, ec);
+    fs::create_directories(opt.out_dir / "crashes", ec);
+    fs::create_directories(opt.out_dir / "hangs", ec);
+    if (ec) {
+        println(std::cerr, "Failed to create output directories: {}", ec.message());
+        return EXIT_FAILURE;
+    }
+
+    void *mapping = mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        println(std::cerr, "Failed to map shared state");
+        return EXIT_FAILURE;
+    }
+    auto &shared = *new (mapping) SharedState();
+    shared.corpus_size = load_corpus(opt.corpus_dir, opt.config.input_size).size();
+
+    std::vector<pid_t> pids(opt.jobs);
+    uint64_t spawned = 0;
+    for (size_t i = 0; i < opt.jobs; ++i) pids[i] = spawn_worker(opt, snapshot, shared, i, opt.seed + spawned++);
+
+    std::signal(SIGINT, on_sigint);
+    std::set<Address> crash_sites;
+    uint64_t crashes = 0;
+    uint64_t last_execs = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (!interrupted) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        for (size_t i = 0; i < opt.jobs; ++i) {
+            if (pids[i] <= 0) pids[i] = spawn_worker(opt, snapshot, shared, i, opt.seed + spawned++);
+        }
+
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            const auto it = std::find(pids.begin(), pids.end(), pid);
+            if (it == pids.end()) continue;
+            const auto index = static_cast<size_t>(it - pids.begin());
+            const WorkerSlot &slot = shared.workers[index];
+            const Address site = slot.last_pc.load();
+            if (!crashed(status)) {
+                println("Worker {} ended without crashing ({} {}), restarting it", index,
+                    WIFSIGNALED(status) ? "signal" : "exit status", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+            } else {
+                ++crashes;
+                if (crash_sites.insert(site).second) {
+                    char name[32];
+                    std::snprintf(name, sizeof(name), "crash-%04X", site);
+                    write_file(opt.out_dir / "crashes" / name, std::span(slot.input).first(opt.config.input_size));
+                    println("Worker {} crashed at 0x{:04X} (signal {})", index, site, WTERMSIG(status));
+                }
+            }
+            *it = spawn_worker(opt, snapshot, shared, index, opt.seed + spawned++);
+        }
+
+        uint64_t execs = 0;
+        for (size_t i = 0; i < opt.jobs; ++i) execs += shared.workers[i].execs.load(std::memory_order_relaxed);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+        println("[{:>5}s] execs {} ({}/s) edges {} corpus {} crashes {} ({} unique) hangs {}", elapsed.count(), execs,
+            execs - last_execs, fuzz::covered_edges(shared.virgin_bits), shared.corpus_size.load(), crashes,
+            crash_sites.size(), shared.hangs.load());
+        last_execs = execs;
+        if (opt.seconds > 0 && static_cast<uint64_t>(elapsed.count()) >= opt.seconds) break;
+    }
+
+    shared.stop = true;
+    for (pid_t pid : pids) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+    }
+    munmap(mapping, sizeof(SharedState));
+    return EXIT_SUCCESS;
+}
+} // namespace
+
+// Usage: fuzz --input HEX --size N [--addr HEX] [--cpu 6502|6502u|65c02] [--boot-cycles N] [--boot-until HEX]
+//             [--budget N] [--done HEX] [--jobs N] [--corpus DIR] [--out DIR] [--seed N] [--time SECONDS] image
+//        fuzz ... --repro FILE image
+//   --input        memory region every input is written to before the run
+//   --cpu          chip variant, 6502u adds the undocumented opcodes (6502)
+//   --boot-cycles  cycles to run before taking the snapshot executions start from
+//   --boot-until   then keep running until the instruction at the given address is next
+//   --budget       cycles per execution (1000000)
+//   --done         reaching the given address ends an execution, running out of budget is then a hang
+//   --jobs         worker processes, one per core unless given
+//   --corpus       seeds and inputs with new coverage (corpus/), shared by all workers
+//   --out          crashes/ keyed by the last executed PC and hangs/ (findings/)
+//   --repro        run a single input, e.g. a saved crash, and report where it ended
+auto main(int argc, char *argv[]) -> int {
+    Options opt;
+    opt.jobs = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, max_jobs);
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--input" && has_value) {
+            opt.config.input_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--size" && has_value) {
+            opt.config.input_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--addr" && has_value) {
+            opt.load_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--cpu" && has_value) {
+            const auto variant = parse_variant(argv[++i]);
+            if (!variant) {
+                println(std::cerr, "Unknown CPU {}, expected 6502, 6502u or 65c02", argv[i]);
+                return EXIT_FAILURE;
+            }
+            opt.variant = *variant;
+        } else if (arg == "--boot-cycles" && has_value) {
+            opt.boot_cycles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--boot-until" && has_value) {
+            opt.boot_until = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--budget" && has_value) {
+            opt.config.cycle_budget = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--done" && has_value) {
+            opt.config.done_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else if (arg == "--jobs" && has_value) {
+            opt.jobs = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--corpus" && has_value) {
+            opt.corpus_dir = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            opt.out_dir = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            opt.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--time" && has_value) {
+            opt.seconds = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repro" && has_value) {
+            opt.repro_path = argv[++i];
+        } else {
+            opt.image_path = arg;
+        }
+    }
+    if (opt.image_path.empty() || opt.config.input_size == 0 || opt.config.input_size > max_input_size ||
+        opt.config.input_addr + opt.config.input_size > 0x10000 || opt.jobs == 0 || opt.jobs > max_jobs) {
+        println(std::cerr, "Usage: fuzz --input HEX --size N (1-{}) [--jobs N (1-{})] [options] image", max_input_size, max_jobs);
+        return EXIT_FAILURE;
+    }
+
+    const auto snapshot = boot(opt);
+    if (!snapshot) {
+        println(std::cerr, "Failed to load {}", opt.image_path);
+        return EXIT_FAILURE;
+    }
+    println("Booted {} to cycle {}, PC = 0x{:04X}", opt.image_path, snapshot->cycles, snapshot->PC);
+
+    if (!opt.repro_path.empty()) return repro(opt, *snapshot);
+    return fuzz_main(opt, *snapshot);
+}
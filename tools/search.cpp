@@ -0,0 +1,149 @@
+/* danielsinkin97@gmail.com */
+
+// Headless "run until condition": runs an image for a cycle budget while keeping checkpoints,
+// then searches the whole run for the first instruction where the condition holds, replaying
+// the stretches between checkpoints on all cores. Prints where it first held and the state
+// hash there, which matches single stepping to that point.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "6502/6502.hpp"
+#include "6502/loader.hpp"
+#include "6502/scheduler.hpp"
+#include "6502/search.hpp"
+#include "6502/state_hash.hpp"
+
+using namespace mos6502;
+using std::println;
+
+namespace {
+struct Options {
+    std::string image_path;
+    std::optional<Condition> condition;
+    Address load_addr = 0x0000;
+    Variant variant = Variant::nmos;
+    uint64_t cycles = 100'000'000;
+    uint64_t interval = 1'000'000;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+// pc==HEX, mem[HEX]==HEX, mem[HEX]!=HEX, a==HEX, x==HEX or y==HEX
+auto parse_condition(const char *text) -> std::optional<Condition> {
+    unsigned addr = 0, value = 0;
+    char op = 0;
+    int end = 0;
+    const auto fits = [&](unsigned max) { return text[end] == '\0' && value <= max && addr <= 0xFFFF; };
+    if (std::sscanf(text, "pc==%x%n", &value, &end) == 1 && fits(0xFFFF)) {
+        return Condition{.kind = Condition::Kind::pc_equals, .addr = static_cast<Address>(value)};
+    }
+    if (std::sscanf(text, "mem[%x]%c=%x%n", &addr, &op, &value, &end) == 3 && (op == '=' || op == '!') && fits(0xFF)) {
+        return Condition{.kind = op == '=' ? Condition::Kind::mem_equals : Condition::Kind::mem_not_equals,
+            .addr = static_cast<Address>(addr),
+            .value = static_cast<Byte>(value)};
+    }
+    char reg = 0;
+    if (std::sscanf(text, "%c==%x%n", &reg, &value, &end) == 2 && fits(0xFF)) {
+        const Byte v = static_cast<Byte>(value);
+        switch (reg) {
+        case 'a': return Condition{.kind = Condition::Kind::a_equals, .value = v};
+        case 'x': return Condition{.kind = Condition::Kind::x_equals, .value = v};
+        case 'y': return Condition{.kind = Condition::Kind::y_equals, .value = v};
+        default: break;
+        }
+    }
+    return std::nullopt;
+}
+} // namespace
+
+// Usage: search --until COND [--cycles N] [--interval N] [--threads N] [--cpu 6502|6502u|65c02] [--addr HEX] image
+//   --until     pc==HEX, mem[HEX]==HEX, mem[HEX]!=HEX, a==HEX, x==HEX or y==HEX
+//   --cycles    length of the run searched (100000000)
+//   --interval  cycles between checkpoints, doubled whenever the history fills up (1000000)
+//   --threads   replay workers (all cores)
+//   --cpu       chip variant (6502)
+//   --addr      load address of raw images
+auto main(int argc, char *argv[]) -> int {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--until" && has_value) {
+            opt.condition = parse_condition(argv[++i]);
+            if (!opt.condition) {
+                println(std::cerr, "Unknown condition {}, expected e.g. mem[0200]==FF", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--cycles" && has_value) {
+            opt.cycles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--interval" && has_value) {
+            opt.interval = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && has_value) {
+            opt.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--cpu" && has_value) {
+            const auto variant = parse_variant(argv[++i]);
+            if (!variant) {
+                println(std::cerr, "Unknown CPU {}, expected 6502, 6502u or 65c02", argv[i]);
+                return EXIT_FAILURE;
+            }
+            opt.variant = *variant;
+        } else if (arg == "--addr" && has_value) {
+            opt.load_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else {
+            opt.image_path = arg;
+        }
+    }
+    if (opt.image_path.empty() || !opt.condition) {
+        println(std::cerr, "Usage: search --until COND [--cycles N] [--interval N] [--threads N] [options] image");
+        return EXIT_FAILURE;
+    }
+
+    auto cpu = std::make_unique<CPU>();
+    cpu->variant = opt.variant;
+    const auto file = MappedFile::open(opt.image_path);
+    if (!file || file->size() > cpu->mem.size()) {
+        println(std::cerr, "Failed to load {}", opt.image_path);
+        return EXIT_FAILURE;
+    }
+    const auto loaded = load_image(*cpu, file->bytes(), detect_format(opt.image_path, file->bytes()), opt.load_addr);
+    if (!loaded) {
+        println(std::cerr, "Failed to load {}", opt.image_path);
+        return EXIT_FAILURE;
+    }
+    cpu->PC = entry_point(*cpu, *loaded);
+    cpu->SP = 0xFF;
+
+    // The run being searched, at full speed
+    const auto run_start = std::chrono::steady_clock::now();
+    Scheduler scheduler;
+    History history(opt.interval);
+    history.record(*cpu);
+    while (cpu->cycles < opt.cycles) {
+        run_until(*cpu, scheduler, std::min(opt.cycles, cpu->cycles + history.interval()));
+        history.record(*cpu);
+    }
+    const double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    println("Ran {} cycles in {:.3f} s, {} checkpoints every {} cycles ({:.2f} MB)", cpu->cycles, run_seconds,
+        history.checkpoints().size(), history.interval(), static_cast<double>(history.bytes()) / (1024.0 * 1024.0));
+
+    const Condition condition = *opt.condition;
+    const auto result = search_first(*cpu, history.checkpoints(), cpu->cycles,
+        [condition](const CPU &c) { return condition.holds(c); }, opt.threads);
+    println("Replayed {} cycles in {:.3f} s on {} threads, {:.2f} emulated MHz", result.replayed_cycles, result.seconds,
+        opt.threads, static_cast<double>(result.replayed_cycles) / result.seconds / 1e6);
+    if (!result.cpu) {
+        println("Condition never held within {} cycles", cpu->cycles);
+        return EXIT_FAILURE;
+    }
+    println("First held at cycle {} PC 0x{:04X} hash {:016x}", result.cpu->cycles, result.cpu->PC, state_hash(*result.cpu));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/* danielsinkin97@gmail.com */
+
+// Headless runner for boards with several 6502s. Every image becomes one CPU, the --shared
+// ranges are backed by one region each and mapped at the same addresses into every CPU.
+// All CPUs run in parallel up to the cycle budget, then the final state of each one and of
+// every shared region is printed as hashes: identical runs (any quantum, any host load)
+// print identical hashes.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "6502/6502.hpp"
+#include "6502/loader.hpp"
+#include "6502/system.hpp"
+
+using namespace mos6502;
+using std::println;
+
+namespace {
+struct Range {
+    Address first = 0x0000;
+    Address last = 0x0000;
+};
+
+struct Options {
+    std::vector<std::string> image_paths;
+    std::vector<Range> shared;
+    Address load_addr = 0x0000;
+    Variant variant = Variant::nmos;
+    uint64_t cycles = 1'000'000;
+    uint64_t quantum = default_quantum;
+};
+
+auto load(CPU &cpu, const Options &opt, const std::string &path) -> bool {
+    const auto file = MappedFile::open(path);
+    if (!file || file->size() > cpu.mem.size()) return false;
+    const auto result = load_image(cpu, file->bytes(), detect_format(path, file->bytes()), opt.load_addr);
+    if (!result) return false;
+    cpu.PC = entry_point(cpu, *result);
+    cpu.SP = 0xFF;
+    return true;
+}
+
+// FNV-1a, the region is not part of any CPU's state_hash
+auto region_hash(const SharedRegion &region) -> uint64_t {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const Byte b : region.bytes) {
+        h ^= b;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+} // namespace
+
+// Usage: system [--cycles N] [--quantum N] [--shared HEX-HEX]... [--cpu 6502|6502u|65c02] [--addr HEX] image...
+//   --cycles   cycles every CPU runs (1000000)
+//   --quantum  cycles a CPU runs between publishing its progress to the others (64)
+//   --shared   page aligned address range backed by RAM common to all CPUs, repeatable
+//   --cpu      chip variant of every CPU (6502)
+//   --addr     load address of raw images
+//   image      one image per CPU, at most 255
+auto main(int argc, char *argv[]) -> int {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--cycles" && has_value) {
+            opt.cycles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--quantum" && has_value) {
+            opt.quantum = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--shared" && has_value) {
+            unsigned first = 0, last = 0;
+            if (std::sscanf(argv[++i], "%x-%x", &first, &last) != 2 || first > last || last > 0xFFFF || (first & 0xFF) != 0 ||
+                (last & 0xFF) != 0xFF) {
+                println(std::cerr, "Shared range {} must cover whole pages, e.g. 8000-80FF", argv[i]);
+                return EXIT_FAILURE;
+            }
+            opt.shared.push_back({static_cast<Address>(first), static_cast<Address>(last)});
+        } else if (arg == "--cpu" && has_value) {
+            const auto variant = parse_variant(argv[++i]);
+            if (!variant) {
+                println(std::cerr, "Unknown CPU {}, expected 6502, 6502u or 65c02", argv[i]);
+                return EXIT_FAILURE;
+            }
+            opt.variant = *variant;
+        } else if (arg == "--addr" && has_value) {
+            opt.load_addr = static_cast<Address>(std::strtoul(argv[++i], nullptr, 16));
+        } else {
+            opt.image_paths.emplace_back(arg);
+        }
+    }
+    if (opt.image_paths.empty() || opt.image_paths.size() > System::max_cpus) {
+        println(std::cerr, "Usage: system [--cycles N] [--quantum N] [--shared HEX-HEX]... [options] image...");
+        return EXIT_FAILURE;
+    }
+
+    System system(opt.quantum);
+    for (const auto &path : opt.image_paths) {
+        const size_t index = system.add_cpu(opt.variant);
+        if (!load(system.cpu(index), opt, path)) {
+            println(std::cerr, "Failed to load {}", path);
+            return EXIT_FAILURE;
+        }
+    }
+    for (const Range &range : opt.shared) {
+        SharedRegion &region = system.add_shared_region(static_cast<size_t>(range.last - range.first) + 1);
+        for (size_t i = 0; i < system.size(); ++i) system.map_shared(i, region, range.first);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    system.run_until(opt.cycles);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < system.size(); ++i) {
+        const CPU &cpu = system.cpu(i);
+        println("cpu {}: cycles {} PC 0x{:04X} hash {:016x}", i, cpu.cycles, cpu.PC, state_hash(cpu));
+    }
+    for (size_t i = 0; i < system.regions().size(); ++i) {
+        println("shared {}: hash {:016x}", i, region_hash(*system.regions()[i]));
+    }
+    println("{} CPUs, {:.3f} s, {:.2f} emulated MHz in total", system.size(), seconds,
+        static_cast<double>(opt.cycles * system.size()) / seconds / 1e6);
+    return EXIT_SUCCESS;
+}